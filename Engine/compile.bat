@@ -1,5 +1,13 @@
 D:\VulkanSDK\Bin\glslc.exe simple_shader.frag -o simple_shader.frag.spv 
 D:\VulkanSDK\Bin\glslc.exe simple_shader.vert -o simple_shader.vert.spv 
+D:\VulkanSDK\Bin\glslc.exe -DMOCHA_VERTEX_FORMAT=1 simple_shader.vert -o simple_shader_compact.vert.spv 
+D:\VulkanSDK\Bin\glslc.exe simple_shader_instanced.vert -o simple_shader_instanced.vert.spv 
+D:\VulkanSDK\Bin\glslc.exe -DMOCHA_VERTEX_FORMAT=1 simple_shader_instanced.vert -o simple_shader_instanced_compact.vert.spv 
+D:\VulkanSDK\Bin\glslc.exe simple_shader_gpu.vert -o simple_shader_gpu.vert.spv 
+D:\VulkanSDK\Bin\glslc.exe -DMOCHA_VERTEX_FORMAT=1 simple_shader_gpu.vert -o simple_shader_gpu_compact.vert.spv 
+D:\VulkanSDK\Bin\glslc.exe cull.comp -o cull.comp.spv 
+D:\VulkanSDK\Bin\glslc.exe meshlet_cull.comp -o meshlet_cull.comp.spv 
+D:\VulkanSDK\Bin\glslc.exe light_cluster.comp -o light_cluster.comp.spv 
 D:\VulkanSDK\Bin\glslc.exe point_light.frag -o point_light.frag.spv 
 D:\VulkanSDK\Bin\glslc.exe point_light.vert -o point_light.vert.spv 
 pause
\ No newline at end of file
@@ -2,10 +2,17 @@
 
 #include "m_imgui.hpp"
 #include "keyboard_movement_controller.hpp"
+#include "light_cluster_system.hpp"
 #include "m_buffer.hpp"
 #include "m_camera.hpp"
+#include "m_frame_capture.hpp"
+#include "m_gpu_profiler.hpp"
+#include "m_job_system.hpp"
+#include "m_trace.hpp"
+#include "m_upload_manager.hpp"
 #include "point_light_system.hpp"
 #include "simple_render_system.hpp"
+#include "transform_system.hpp"
 
 // libs
 #include <imgui.h>
@@ -20,28 +27,62 @@
 #include <array>
 #include <cassert>
 #include <chrono>
+#include <iostream>
 #include <stdexcept>
 
 namespace m {
 
 
-    FirstApp::FirstApp() {
+    FirstApp::FirstApp() : FirstApp(Settings{}) {}
+
+    FirstApp::FirstApp(const Settings& settings) : settings{ settings } {
         globalPool =
             MDescriptorPool::Builder(mDevice)
             .setMaxSets(MSwapChain::MAX_FRAMES_IN_FLIGHT)
             .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, MSwapChain::MAX_FRAMES_IN_FLIGHT)
+            .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * MSwapChain::MAX_FRAMES_IN_FLIGHT)
             .build();
-        loadGameObjects();
+        bindlessTable = std::make_unique<MBindlessTable>(mDevice);
+        textureStreamer = std::make_unique<MTextureStreamer>(mDevice, *bindlessTable);
+        meshPool = std::make_unique<MMeshPool>(mDevice, 1 << 20, 1 << 22, 1 << 16);
+        if (settings.benchmark) {
+            benchmark = std::make_unique<MBenchmark>(mDevice, settings.benchmarkConfig);
+            benchmark->createScene(registry, sceneGraph, meshPool.get());
+            lightRig = benchmark->getLightRig();
+        }
+        else {
+            loadGameObjects();
+        }
+        if (!settings.streamedTextures.empty()) {
+            streamTextures();
+        }
+        // the streamer's view runs next to other tasks of the frame graph, where it can't add
+        // the pool without racing them
+        registry.pool<StreamedTextureComponent>();
+        mDevice.getAllocator().printStats(std::cout);
     }
 
     FirstApp::~FirstApp() {}
 
     void FirstApp::run() {
-        MImgui lveImgui{
-            mWindow,
-            mDevice,
-            mRenderer.getSwapChainRenderPass(),
-            mRenderer.getImageCount() };
+        // imgui needs a glfw window to hook into
+        std::unique_ptr<MImgui> lveImgui;
+        if (!settings.headless) {
+            lveImgui = std::make_unique<MImgui>(
+                mWindow,
+                mDevice,
+                mRenderer.getSwapChainRenderPass(),
+                mRenderer.getImageCount());
+        }
+
+        MGpuProfiler gpuProfiler{ mDevice };
+
+        std::unique_ptr<MFrameCapture> frameCapture;
+        if (settings.headless && !settings.outputDirectory.empty()) {
+            frameCapture = std::make_unique<MFrameCapture>(settings.outputDirectory);
+            mRenderer.setReadbackCallback(
+                [&](const MSwapChain::FrameImage& image) { frameCapture->capture(image); });
+        }
 
         std::vector<std::unique_ptr<MBuffer>> uboBuffers(MSwapChain::MAX_FRAMES_IN_FLIGHT);
         for (int i = 0; i < uboBuffers.size(); i++) {
@@ -56,42 +97,82 @@ namespace m {
 
         auto globalSetLayout =
             MDescriptorSetLayout::Builder(mDevice)
-            .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS)
+            .addBinding(
+                0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT)
             .build();
 
+        // owns the light and cluster buffers the global sets point at
+        LightClusterSystem lightClusterSystem{ mDevice, globalSetLayout->getDescriptorSetLayout() };
+
         std::vector<VkDescriptorSet> globalDescriptorSets(MSwapChain::MAX_FRAMES_IN_FLIGHT);
         for (int i = 0; i < globalDescriptorSets.size(); i++) {
             auto bufferInfo = uboBuffers[i]->descriptorInfo();
+            auto lightInfos = lightClusterSystem.getDescriptorInfos(i);
             MDescriptorWriter(*globalSetLayout, *globalPool)
                 .writeBuffer(0, &bufferInfo)
+                .writeBuffer(1, &lightInfos.lights)
+                .writeBuffer(2, &lightInfos.clusterCounts)
+                .writeBuffer(3, &lightInfos.clusterIndices)
                 .build(globalDescriptorSets[i]);
         }
 
         SimpleRenderSystem simpleRenderSystem{
             mDevice,
             mRenderer.getSwapChainRenderPass(),
-            globalSetLayout->getDescriptorSetLayout() };
+            globalSetLayout->getDescriptorSetLayout(),
+            bindlessTable->getDescriptorSetLayout(),
+            settings.renderMode,
+            meshPool.get() };
+        simpleRenderSystem.setMeshletCulling(settings.meshletCulling);
+        simpleRenderSystem.setConeCulling(settings.coneCulling);
             PointLightSystem pointLightSystem{
                mDevice,
                mRenderer.getSwapChainRenderPass(),
                globalSetLayout->getDescriptorSetLayout() };
             MCamera camera{};
 
-        auto viewerObject = MGameObject::createGameObject();
-        viewerObject.transform.translation.z = -2.5f;
+        TransformSystem transformSystem{};
+        TransformComponent viewerTransform{};
+        viewerTransform.setTranslation({ 0.f, 0.f, -2.5f });
         KeyboardMovementController cameraController{};
+        MCameraPath recordedPath{};
+        float elapsedTime = 0.f;
 
+        MTaskGraph frameGraph{};
+        uint32_t framesRendered = 0;
         auto currentTime = std::chrono::high_resolution_clock::now();
-        while (!mWindow.shouldClose()) {
-            glfwPollEvents();
-
+        while (!mWindow.shouldClose() &&
+            (settings.frameCount == 0 || framesRendered < settings.frameCount) &&
+            !(benchmark && benchmark->isDone())) {
+            M_TRACE_ZONE("FirstApp::run frame");
             auto newTime = std::chrono::high_resolution_clock::now();
             float frameTime =
                 std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
             currentTime = newTime;
 
-            cameraController.moveInPlaneXZ(mWindow.getGLFWwindow(), frameTime, viewerObject);
-            camera.setViewYXZ(viewerObject.transform.translation, viewerObject.transform.rotation);
+            if (settings.headless) {
+                // a fixed step keeps image sequences the same from run to run
+                frameTime = HEADLESS_FRAME_TIME;
+            }
+            else {
+                M_TRACE_ZONE("glfwPollEvents");
+                glfwPollEvents();
+            }
+
+            if (benchmark) {
+                benchmark->placeViewer(viewerTransform);
+            }
+            else if (!settings.headless) {
+                cameraController.moveInPlaneXZ(mWindow.getGLFWwindow(), frameTime, viewerTransform);
+            }
+            if (!settings.recordPathFile.empty()) {
+                recordedPath.addKeyframe(elapsedTime, viewerTransform.getTranslation(), viewerTransform.getRotation());
+            }
+            elapsedTime += frameTime;
+            camera.setViewYXZ(viewerTransform.getTranslation(), viewerTransform.getRotation());
 
             float aspect = mRenderer.getAspectRatio();
             camera.setPerspectiveProjection(glm::radians(50.f), aspect, 0.1f, 100.f);
@@ -104,65 +185,147 @@ namespace m {
                     commandBuffer,
                     camera,
                     globalDescriptorSets[frameIndex],
-                    gameObjects };
+                    registry };
+                M_TRACE_ZONE("FirstApp::run record");
+                frameInfo.profiler = &gpuProfiler;
+                bindlessTable->beginFrame();
+                frameInfo.bindlessDescriptorSet = bindlessTable->getDescriptorSet();
+                frameInfo.extent = mRenderer.getSwapChainExtent();
+                gpuProfiler.beginFrame(commandBuffer, frameIndex);
+                if (benchmark) {
+                    benchmark->beginFrame(frameInfo);
+                }
 
                 // update
                 GlobalUbo ubo{};
                 ubo.projection = camera.getProjection();
                 ubo.view = camera.getView();
                 ubo.inverseView = camera.getInverseView();
-                pointLightSystem.update(frameInfo, ubo);
-                uboBuffers[frameIndex]->writeToBuffer(&ubo);
-                uboBuffers[frameIndex]->flush();
+                VkExtent2D extent = frameInfo.extent;
+                ubo.screenSize = { static_cast<float>(extent.width), static_cast<float>(extent.height) };
+                // the light upload and the object gathering only read transforms, so they run
+                // side by side once the matrices are up to date. the scene has created every
+                // component pool by now, so the views don't add any while the tasks run
+                frameGraph.clear();
+                auto moveLights = frameGraph.add(
+                    "update lights", [&]() { pointLightSystem.update(frameInfo, lightRig); });
+                auto updateTransforms = frameGraph.add(
+                    "update transforms",
+                    [&]() {
+                        transformSystem.update(registry);
+                        sceneGraph.update();
+                    },
+                    { moveLights });
+                frameGraph.add(
+                    "upload lights",
+                    [&]() {
+                        lightClusterSystem.update(frameInfo, ubo);
+                        uboBuffers[frameIndex]->writeToBuffer(&ubo);
+                        uboBuffers[frameIndex]->flush();
+                    },
+                    { updateTransforms });
+                auto streamTextures = frameGraph.add(
+                    "stream textures",
+                    [&]() { textureStreamer->update(frameInfo, static_cast<float>(extent.height)); },
+                    { updateTransforms });
+                frameGraph.add(
+                    "collect objects", [&]() { simpleRenderSystem.collectObjects(frameInfo); }, { streamTextures });
+                frameGraph.run();
 
                 // tell imgui that we're starting a new frame
-                lveImgui.newFrame();
+                if (lveImgui) lveImgui->newFrame();
                 
                 // render
-                mRenderer.beginSwapChainRenderPass(commandBuffer);
+                lightClusterSystem.prepareFrame(frameInfo);
+                simpleRenderSystem.prepareFrame(frameInfo);
+                if (settings.parallelRecording) {
+                    mRenderer.beginSwapChainRenderPass(commandBuffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+                    frameInfo.renderer = &mRenderer;
+                }
+                else {
+                    mRenderer.beginSwapChainRenderPass(commandBuffer);
+                }
 
                 // order here matters
                 simpleRenderSystem.renderGameObjects(frameInfo);
+
+                // the rest is recorded on this thread, into one more secondary buffer if the pass
+                // takes them
+                if (frameInfo.renderer != nullptr) {
+                    frameInfo.commandBuffer = mRenderer.beginSecondaryCommandBuffer(0);
+                }
                 pointLightSystem.render(frameInfo);
 
                 // example code telling imgui what windows to render, and their contents
                 // this can be replaced with whatever code/classes you set up configuring your
                 // desired engine UI
-                lveImgui.runExample();
+                if (lveImgui) {
+                    lveImgui->runExample();
+                    gpuProfiler.drawImGui();
 
-                // as last step in render pass, record the imgui draw commands
-                lveImgui.render(commandBuffer);
+                    // as last step in render pass, record the imgui draw commands
+                    MGpuProfiler::Scope scope{ &gpuProfiler, frameInfo.commandBuffer, "ImGui" };
+                    lveImgui->render(frameInfo.commandBuffer);
+                }
 
+                if (frameInfo.renderer != nullptr) {
+                    mRenderer.endSecondaryCommandBuffer(frameInfo.commandBuffer);
+                    vkCmdExecuteCommands(commandBuffer, 1, &frameInfo.commandBuffer);
+                    frameInfo.commandBuffer = commandBuffer;
+                    frameInfo.renderer = nullptr;
+                }
                 mRenderer.endSwapChainRenderPass(commandBuffer);
+                if (benchmark) {
+                    benchmark->endFrame(frameInfo);
+                }
                 mRenderer.endFrame();
+                framesRendered++;
             }
         }
 
-        vkDeviceWaitIdle(mDevice.device());
+        mRenderer.finishFrames();
+        mRenderer.setReadbackCallback(nullptr);
+
+        if (benchmark) {
+            benchmark->finish();
+            if (!benchmark->writeReport()) {
+                throw std::runtime_error("failed to write the benchmark report");
+            }
+        }
+        if (!settings.gpuProfileFile.empty() && !gpuProfiler.writeJson(settings.gpuProfileFile)) {
+            throw std::runtime_error("failed to write the GPU profile to " + settings.gpuProfileFile);
+        }
+        if (!settings.recordPathFile.empty() && !recordedPath.save(settings.recordPathFile)) {
+            throw std::runtime_error("failed to save the camera path to " + settings.recordPathFile);
+        }
+        if (frameCapture && frameCapture->wait() > 0) {
+            throw std::runtime_error("failed to write some captured frames");
+        }
     }
 
     void FirstApp::loadGameObjects() {
-        std::shared_ptr<MModel> mModel =
-            MModel::createModelFromFile(mDevice, "models/flat_vase.obj");
-        auto flatVase = MGameObject::createGameObject();
-        flatVase.model = mModel;
-        flatVase.transform.translation = { -.5f, .5f, 0.f };
-        flatVase.transform.scale = { 3.f, 1.5f, 3.f };
-        gameObjects.emplace(flatVase.getId(), std::move(flatVase));
-
-        mModel = MModel::createModelFromFile(mDevice, "models/smooth_vase.obj");
-        auto smoothVase = MGameObject::createGameObject();
-        smoothVase.model = mModel;
-        smoothVase.transform.translation = { .5f, .5f, 0.f };
-        smoothVase.transform.scale = { 3.f, 1.5f, 3.f };
-        gameObjects.emplace(smoothVase.getId(), std::move(smoothVase));
-
-        mModel = MModel::createModelFromFile(mDevice, "models/quad.obj");
-        auto floor = MGameObject::createGameObject();
-        floor.model = mModel;
-        floor.transform.translation = { 0.f, .5f, 0.f };
-        floor.transform.scale = { 3.f, 1.f, 3.f };
-        gameObjects.emplace(floor.getId(), std::move(floor));
+        auto models = MModel::createModelsFromFiles(
+            mDevice,
+            { "models/flat_vase.obj", "models/smooth_vase.obj", "models/quad.obj" },
+            meshPool.get());
+
+        auto flatVase = MGameObject::makeModel(registry, std::move(models[0]));
+        auto& flatVaseTransform = registry.get<TransformComponent>(flatVase);
+        flatVaseTransform.setTranslation({ -.5f, .5f, 0.f });
+        flatVaseTransform.setScale({ 3.f, 1.5f, 3.f });
+        flatVaseTransform.setStatic(true);
+
+        auto smoothVase = MGameObject::makeModel(registry, std::move(models[1]));
+        auto& smoothVaseTransform = registry.get<TransformComponent>(smoothVase);
+        smoothVaseTransform.setTranslation({ .5f, .5f, 0.f });
+        smoothVaseTransform.setScale({ 3.f, 1.5f, 3.f });
+        smoothVaseTransform.setStatic(true);
+
+        auto floor = MGameObject::makeModel(registry, std::move(models[2]));
+        auto& floorTransform = registry.get<TransformComponent>(floor);
+        floorTransform.setTranslation({ 0.f, .5f, 0.f });
+        floorTransform.setScale({ 3.f, 1.f, 3.f });
+        floorTransform.setStatic(true);
 
         std::vector<glm::vec3> lightColors{
         {1.f, .1f, .1f},
@@ -172,16 +335,32 @@ namespace m {
         {.1f, 1.f, 1.f},
         {1.f, 1.f, 1.f}};
 
+        lightRig = MGameObject::createGameObject(registry);
         for (int i = 0; i < lightColors.size(); i++) {
-            auto pointLight = MGameObject::makePointLight(0.2f);
-            pointLight.color = lightColors[i];
+            auto pointLight = MGameObject::makePointLight(registry, 0.2f, 0.1f, lightColors[i]);
+            sceneGraph.setParent(pointLight, lightRig);
             auto rotateLight = glm::rotate(
                 glm::mat4(1.f),
                 (i * glm::two_pi<float>()) / lightColors.size(),
                 { 0.f, -1.f, 0.f });
-            pointLight.transform.translation = glm::vec3(rotateLight * glm::vec4(-1.f, -1.f, -1.f, 1.f));
-            gameObjects.emplace(pointLight.getId(), std::move(pointLight));
+            registry.get<TransformComponent>(pointLight).setTranslation(
+                glm::vec3(rotateLight * glm::vec4(-1.f, -1.f, -1.f, 1.f)));
+        }
+
+        // all model uploads above go out as one transfer submission
+        mDevice.getUploadManager().flush();
+    }
+
+    void FirstApp::streamTextures() {
+        std::vector<MTextureStreamer::Handle> handles;
+        for (const std::string& filepath : settings.streamedTextures) {
+            handles.push_back(textureStreamer->load(filepath));
         }
+
+        size_t next = 0;
+        registry.view<ModelComponent>().each([&](MEntity entity, ModelComponent&) {
+            registry.add<StreamedTextureComponent>(entity, handles[next++ % handles.size()]);
+        });
     }
 
 }
\ No newline at end of file
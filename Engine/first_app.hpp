@@ -1,13 +1,21 @@
 #pragma once
 
+#include "m_benchmark.hpp"
+#include "m_bindless_table.hpp"
 #include "m_descriptors.hpp"
 #include "m_device.hpp"
 #include "m_game_object.hpp"
+#include "m_mesh_pool.hpp"
 #include "m_renderer.hpp"
+#include "m_scene_graph.hpp"
+#include "m_texture_streamer.hpp"
 #include "m_window.hpp"
+#include "simple_render_system.hpp"
 
 // std
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace m {
@@ -15,8 +23,32 @@ namespace m {
 	public:
 		static constexpr int WIDTH = 800;
 		static constexpr int HEIGHT = 600;
+		static constexpr float HEADLESS_FRAME_TIME = 1.f / 60.f;
+
+		struct Settings {
+			int width = WIDTH;
+			int height = HEIGHT;
+			bool headless = false;  // render offscreen, without a window or ImGui
+			uint32_t frameCount = 0;  // stop after this many frames, 0 runs until the window closes
+			std::string outputDirectory;  // headless frames are written here as ppm when set
+			std::string recordPathFile;  // the viewer's path is saved here on exit when set
+			std::string gpuProfileFile;  // per scope GPU timings are written here on exit when set
+			SimpleRenderSystem::RenderMode renderMode = SimpleRenderSystem::RenderMode::GpuDriven;
+			// record the swap chain pass in secondary command buffers, Direct mode on several threads
+			bool parallelRecording = true;
+			// see SimpleRenderSystem::setMeshletCulling and setConeCulling
+			bool meshletCulling = true;
+			bool coneCulling = false;
+			// KTX2 or DDS files streamed by MTextureStreamer, handed out to the scene's models in turn
+			std::vector<std::string> streamedTextures;
+
+			// runs MBenchmark's scene and camera path instead, and stops when it is done
+			bool benchmark = false;
+			MBenchmark::Config benchmarkConfig{};
+		};
 
 		FirstApp();
+		explicit FirstApp(const Settings& settings);
 		~FirstApp();
 
 		FirstApp(const FirstApp&) = delete;
@@ -26,13 +58,21 @@ namespace m {
 
 	private:
 		void loadGameObjects();
+		void streamTextures();
 
-		MWindow mWindow{ WIDTH, HEIGHT, "Mocha Engine" };
+		Settings settings;
+		MWindow mWindow{ settings.width, settings.height, "Mocha Engine", settings.headless };
 		MDevice mDevice{ mWindow };
 		MRenderer mRenderer{ mWindow, mDevice };
 
 		// note: order of declarations matters
 		std::unique_ptr<MDescriptorPool> globalPool{};
-		MGameObject::Map gameObjects;
+		std::unique_ptr<MBindlessTable> bindlessTable{};
+		std::unique_ptr<MTextureStreamer> textureStreamer{};
+		std::unique_ptr<MMeshPool> meshPool{};
+		std::unique_ptr<MBenchmark> benchmark{};
+		MRegistry registry;
+		MSceneGraph sceneGraph{ registry };
+		MEntity lightRig{};  // the point lights are its children
 	};
 }
\ No newline at end of file
@@ -6,22 +6,24 @@
 namespace m {
 
     void KeyboardMovementController::moveInPlaneXZ(
-        GLFWwindow* window, float dt, MGameObject& gameObject) {
+        GLFWwindow* window, float dt, TransformComponent& transform) {
         glm::vec3 rotate{ 0 };
         if (glfwGetKey(window, keys.lookRight) == GLFW_PRESS) rotate.y += 1.f;
         if (glfwGetKey(window, keys.lookLeft) == GLFW_PRESS) rotate.y -= 1.f;
         if (glfwGetKey(window, keys.lookUp) == GLFW_PRESS) rotate.x += 1.f;
         if (glfwGetKey(window, keys.lookDown) == GLFW_PRESS) rotate.x -= 1.f;
 
+        glm::vec3 rotation = transform.getRotation();
         if (glm::dot(rotate, rotate) > std::numeric_limits<float>::epsilon()) {
-            gameObject.transform.rotation += lookSpeed * dt * glm::normalize(rotate);
+            rotation += lookSpeed * dt * glm::normalize(rotate);
         }
 
         // limit pitch values between about +/- 85ish degrees
-        gameObject.transform.rotation.x = glm::clamp(gameObject.transform.rotation.x, -1.5f, 1.5f);
-        gameObject.transform.rotation.y = glm::mod(gameObject.transform.rotation.y, glm::two_pi<float>());
+        rotation.x = glm::clamp(rotation.x, -1.5f, 1.5f);
+        rotation.y = glm::mod(rotation.y, glm::two_pi<float>());
+        transform.setRotation(rotation);
 
-        float yaw = gameObject.transform.rotation.y;
+        float yaw = rotation.y;
         const glm::vec3 forwardDir{ sin(yaw), 0.f, cos(yaw) };
         const glm::vec3 rightDir{ forwardDir.z, 0.f, -forwardDir.x };
         const glm::vec3 upDir{ 0.f, -1.f, 0.f };
@@ -35,7 +37,7 @@ namespace m {
         if (glfwGetKey(window, keys.moveDown) == GLFW_PRESS) moveDir -= upDir;
 
         if (glm::dot(moveDir, moveDir) > std::numeric_limits<float>::epsilon()) {
-            gameObject.transform.translation += moveSpeed * dt * glm::normalize(moveDir);
+            transform.setTranslation(transform.getTranslation() + moveSpeed * dt * glm::normalize(moveDir));
         }
     }
 }
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include "light_cluster_system.hpp"
+
+#include "m_gpu_profiler.hpp"
+#include "m_swap_chain.hpp"
+#include "m_trace.hpp"
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+namespace m {
+
+    LightClusterSystem::LightClusterSystem(MDevice& device, VkDescriptorSetLayout globalSetLayout)
+        : mDevice{ device } {
+        createPipelineLayout(globalSetLayout);
+        createPipeline();
+
+        frames.resize(MSwapChain::MAX_FRAMES_IN_FLIGHT);
+        for (auto& frame : frames) {
+            frame.lightBuffer = std::make_unique<MBuffer>(
+                mDevice,
+                sizeof(PointLight),
+                MAX_LIGHTS,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            frame.lightBuffer->map();
+
+            frame.clusterCountBuffer = std::make_unique<MBuffer>(
+                mDevice,
+                sizeof(uint32_t),
+                CLUSTER_COUNT,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            frame.clusterIndexBuffer = std::make_unique<MBuffer>(
+                mDevice,
+                sizeof(uint32_t),
+                CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        }
+        lightScratch.reserve(MAX_LIGHTS);
+    }
+
+    LightClusterSystem::~LightClusterSystem() {
+        vkDestroyPipelineLayout(mDevice.device(), pipelineLayout, nullptr);
+    }
+
+    void LightClusterSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+        // everything the pass reads and writes is in the global set
+        std::vector<VkDescriptorSetLayout> descriptorSetLayouts{ globalSetLayout };
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+        pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = 0;
+        pipelineLayoutInfo.pPushConstantRanges = nullptr;
+        if (vkCreatePipelineLayout(mDevice.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("failed to create light cluster pipeline layout!");
+        }
+    }
+
+    void LightClusterSystem::createPipeline() {
+        assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
+        mPipeline = std::make_unique<MPipeline>(mDevice, "light_cluster.comp.spv", pipelineLayout);
+    }
+
+    LightClusterSystem::DescriptorInfos LightClusterSystem::getDescriptorInfos(int frameIndex) {
+        ClusterFrame& frame = frames[frameIndex];
+        return {
+            frame.lightBuffer->descriptorInfo(),
+            frame.clusterCountBuffer->descriptorInfo(),
+            frame.clusterIndexBuffer->descriptorInfo() };
+    }
+
+    void LightClusterSystem::update(FrameInfo& frameInfo, GlobalUbo& ubo) {
+        M_TRACE_ZONE("LightClusterSystem::update");
+        lightScratch.clear();
+        frameInfo.registry.view<TransformComponent, PointLightComponent>().each(
+            [&](MEntity, TransformComponent& transform, PointLightComponent& light) {
+            assert(lightScratch.size() < MAX_LIGHTS && "Point lights exceed maximum specified");
+            if (lightScratch.size() == MAX_LIGHTS) return;
+
+            // intensity / d^2 falls to the cutoff at this distance
+            float range = std::sqrt(glm::max(light.lightIntensity, 0.f) / LIGHT_CUTOFF);
+
+            PointLight& gpuLight = lightScratch.emplace_back();
+            gpuLight.position = glm::vec4(transform.getWorldPosition(), range);
+            gpuLight.color = glm::vec4(light.color, light.lightIntensity);
+        });
+        ubo.numLights = static_cast<int>(lightScratch.size());
+
+        if (!lightScratch.empty()) {
+            MBuffer& lightBuffer = *frames[frameInfo.frameIndex].lightBuffer;
+            lightBuffer.writeToBuffer(lightScratch.data(), sizeof(PointLight) * lightScratch.size());
+            lightBuffer.flush();
+        }
+
+        // slice = log(z) * scale + bias puts the slice boundaries at near * (far / near)^(i / CLUSTER_Z)
+        float nearPlane = frameInfo.camera.getNear();
+        float farPlane = frameInfo.camera.getFar();
+        float logDepthRange = std::log(farPlane / nearPlane);
+        float sliceCount = static_cast<float>(CLUSTER_Z);
+        ubo.clusterDepth = {
+            nearPlane,
+            farPlane,
+            sliceCount / logDepthRange,
+            -sliceCount * std::log(nearPlane) / logDepthRange };
+    }
+
+    void LightClusterSystem::prepareFrame(FrameInfo& frameInfo) {
+        VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+        MGpuProfiler::Scope scope{ frameInfo.profiler, commandBuffer, "LightCluster" };
+
+        // every cluster writes its count, so the pass also clears the last frame's lists
+        mPipeline->bind(commandBuffer);
+        vkCmdBindDescriptorSets(
+            commandBuffer,
+            VK_PIPELINE_BIND_POINT_COMPUTE,
+            pipelineLayout,
+            0,
+            1,
+            &frameInfo.globalDescriptorSet,
+            0,
+            nullptr);
+        vkCmdDispatch(commandBuffer, (CLUSTER_COUNT + 127) / 128, 1, 1);
+
+        VkMemoryBarrier clusterBarrier{};
+        clusterBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        clusterBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        clusterBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0,
+            1,
+            &clusterBarrier,
+            0,
+            nullptr,
+            0,
+            nullptr);
+    }
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "m_buffer.hpp"
+#include "m_device.hpp"
+#include "m_frame_info.hpp"
+#include "m_pipeline.hpp"
+
+// std
+#include <memory>
+#include <vector>
+
+namespace m {
+    // Clustered forward lighting. The view frustum is split into a grid of clusters, screen tiles
+    // in x and y and exponential depth slices in z. Every frame the point lights are copied to a
+    // storage buffer and a compute pass bins them into the clusters they touch, so a fragment only
+    // loops over the lights of its own cluster.
+    //
+    // The light, count and index buffers go into the global set at bindings 1 to 3, written from
+    // getDescriptorInfos. The clusters assume a perspective projection.
+    class LightClusterSystem {
+    public:
+        // must match light_cluster.comp and simple_shader.frag
+        static constexpr uint32_t CLUSTER_X = 16;
+        static constexpr uint32_t CLUSTER_Y = 9;
+        static constexpr uint32_t CLUSTER_Z = 24;
+        static constexpr uint32_t CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+        static constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 128;
+
+        // a light's range ends where its falloff drops below this intensity
+        static constexpr float LIGHT_CUTOFF = .005f;
+
+        struct DescriptorInfos {
+            VkDescriptorBufferInfo lights;
+            VkDescriptorBufferInfo clusterCounts;
+            VkDescriptorBufferInfo clusterIndices;
+        };
+
+        LightClusterSystem(MDevice& device, VkDescriptorSetLayout globalSetLayout);
+        ~LightClusterSystem();
+
+        LightClusterSystem(const LightClusterSystem&) = delete;
+        LightClusterSystem& operator=(const LightClusterSystem&) = delete;
+
+        DescriptorInfos getDescriptorInfos(int frameIndex);
+
+        // uploads the point lights and fills in the cluster fields of the ubo
+        void update(FrameInfo& frameInfo, GlobalUbo& ubo);
+
+        // records the binning pass, call it after the ubo is written and before
+        // beginSwapChainRenderPass
+        void prepareFrame(FrameInfo& frameInfo);
+
+    private:
+        struct ClusterFrame {
+            std::unique_ptr<MBuffer> lightBuffer;
+            std::unique_ptr<MBuffer> clusterCountBuffer;
+            std::unique_ptr<MBuffer> clusterIndexBuffer;
+        };
+
+        void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
+        void createPipeline();
+
+        MDevice& mDevice;
+
+        std::unique_ptr<MPipeline> mPipeline;
+        VkPipelineLayout pipelineLayout;
+
+        std::vector<ClusterFrame> frames;
+        std::vector<PointLight> lightScratch;
+    };
+}
@@ -0,0 +1,304 @@
+#include "m_benchmark.hpp"
+
+#include "light_cluster_system.hpp"
+#include "m_mesh_optimizer.hpp"
+#include "m_swap_chain.hpp"
+#include "m_upload_manager.hpp"
+
+// libs
+#include <glm/gtc/constants.hpp>
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+namespace m {
+
+    // a uv sphere with its radius pushed around by a few random waves, so every mesh differs
+    static MModel::Builder makeSyntheticMesh(std::mt19937& rng, uint32_t rings, uint32_t segments) {
+        std::uniform_real_distribution<float> unit{ 0.f, 1.f };
+        glm::vec3 color{ .2f + .8f * unit(rng), .2f + .8f * unit(rng), .2f + .8f * unit(rng) };
+        float waveA = 2.f + std::floor(unit(rng) * 6.f);
+        float waveB = 2.f + std::floor(unit(rng) * 6.f);
+        float amplitude = .05f + .2f * unit(rng);
+
+        MModel::Builder builder{};
+        builder.vertices.reserve((rings + 1) * (segments + 1));
+        for (uint32_t ring = 0; ring <= rings; ring++) {
+            float theta = glm::pi<float>() * ring / rings;
+            for (uint32_t segment = 0; segment <= segments; segment++) {
+                float phi = glm::two_pi<float>() * segment / segments;
+                glm::vec3 normal{
+                    glm::sin(theta) * glm::cos(phi), glm::cos(theta), glm::sin(theta) * glm::sin(phi) };
+                float radius = 1.f + amplitude * glm::sin(waveA * theta) * glm::cos(waveB * phi);
+
+                MModel::Vertex vertex{};
+                vertex.position = normal * radius;
+                vertex.color = color;
+                vertex.normal = normal;
+                vertex.uv = { static_cast<float>(segment) / segments, static_cast<float>(ring) / rings };
+                builder.vertices.push_back(vertex);
+            }
+        }
+
+        builder.indices.reserve(rings * segments * 6);
+        for (uint32_t ring = 0; ring < rings; ring++) {
+            for (uint32_t segment = 0; segment < segments; segment++) {
+                uint32_t a = ring * (segments + 1) + segment;
+                uint32_t b = a + segments + 1;
+                builder.indices.insert(builder.indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+            }
+        }
+
+        builder.bounds = builder.computeBounds();
+        builder.splitSubmeshes();
+        builder.generateLods();
+        MMeshOptimizer::optimize(builder);
+        builder.buildMeshlets();
+        return builder;
+    }
+
+    MBenchmark::MBenchmark(MDevice& device, const Config& config)
+        : mDevice{ device }, config{ config } {
+        if (this->config.lightCount > MAX_LIGHTS) {
+            std::cout << "benchmark: clamping " << this->config.lightCount << " lights to " << MAX_LIGHTS
+                << std::endl;
+            this->config.lightCount = MAX_LIGHTS;
+        }
+        this->config.meshCount = std::max(this->config.meshCount, 1u);
+
+        if (!this->config.cameraPathFile.empty() && !cameraPath.load(this->config.cameraPathFile)) {
+            throw std::runtime_error("failed to load camera path " + this->config.cameraPathFile);
+        }
+
+        createQueryPool();
+        samples.reserve(this->config.frameCount);
+    }
+
+    MBenchmark::~MBenchmark() {
+        vkDestroyQueryPool(mDevice.device(), queryPool, nullptr);
+    }
+
+    void MBenchmark::createQueryPool() {
+        pendingSample.assign(MSwapChain::MAX_FRAMES_IN_FLIGHT, -1);
+
+        uint32_t validBits = mDevice.getFeatures().timestampValidBits;
+        if (validBits == 0) {
+            std::cout << "benchmark: the graphics queue has no timestamps, GPU time is not reported"
+                << std::endl;
+            return;
+        }
+        timestampsSupported = true;
+        timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+        timestampPeriodNs = mDevice.properties.limits.timestampPeriod;
+
+        // a start and an end timestamp per frame in flight
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = 2 * MSwapChain::MAX_FRAMES_IN_FLIGHT;
+        if (vkCreateQueryPool(mDevice.device(), &poolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+    }
+
+    void MBenchmark::createScene(MRegistry& registry, MSceneGraph& sceneGraph, MMeshPool* meshPool) {
+        std::mt19937 rng{ config.seed };
+        std::uniform_real_distribution<float> unit{ 0.f, 1.f };
+
+        meshes.reserve(config.meshCount);
+        for (uint32_t i = 0; i < config.meshCount; i++) {
+            uint32_t rings = 8 + static_cast<uint32_t>(unit(rng) * 24.f);
+            MModel::Builder builder = makeSyntheticMesh(rng, rings, rings * 2);
+            meshes.push_back(std::make_shared<MModel>(mDevice, builder, meshPool));
+        }
+
+        // objects fill a box that grows with their count, keeping the density the same
+        float extent = std::cbrt(static_cast<float>(config.objectCount)) * .75f;
+        for (uint32_t i = 0; i < config.objectCount; i++) {
+            auto& model = meshes[static_cast<uint32_t>(unit(rng) * config.meshCount) % config.meshCount];
+            MEntity object = MGameObject::makeModel(registry, model);
+            auto& transform = registry.get<TransformComponent>(object);
+            transform.setTranslation({
+                (unit(rng) - .5f) * extent, (unit(rng) - .5f) * extent, (unit(rng) - .5f) * extent });
+            transform.setRotation(glm::vec3{ unit(rng), unit(rng), unit(rng) } * glm::two_pi<float>());
+            transform.setScale(glm::vec3{ .1f + .15f * unit(rng) });
+            transform.setStatic(true);
+        }
+
+        // lights reach less far as there are more of them, so each one touches a similar share of
+        // the clusters whatever the count
+        float lightRange = extent * .5f / std::cbrt(std::max(config.lightCount, 6u) / 6.f);
+        float lightIntensity = LightClusterSystem::LIGHT_CUTOFF * lightRange * lightRange;
+        lightRig = MGameObject::createGameObject(registry);
+        for (uint32_t i = 0; i < config.lightCount; i++) {
+            glm::vec3 color{ .2f + .8f * unit(rng), .2f + .8f * unit(rng), .2f + .8f * unit(rng) };
+            MEntity light = MGameObject::makePointLight(registry, lightIntensity, .1f, color);
+            sceneGraph.setParent(light, lightRig);
+            registry.get<TransformComponent>(light).setTranslation({
+                (unit(rng) - .5f) * extent, (unit(rng) - .5f) * extent, (unit(rng) - .5f) * extent });
+        }
+
+        if (cameraPath.empty()) {
+            float duration = (config.warmupFrames + config.frameCount) * FRAME_STEP;
+            cameraPath = MCameraPath::orbit(glm::vec3{ 0.f }, extent, extent * .5f, duration);
+        }
+
+        mDevice.getUploadManager().flush();
+    }
+
+    void MBenchmark::placeViewer(TransformComponent& viewer) const {
+        glm::vec3 position;
+        glm::vec3 rotation;
+        cameraPath.sample(framesStarted * FRAME_STEP, position, rotation);
+        viewer.setTranslation(position);
+        viewer.setRotation(rotation);
+    }
+
+    void MBenchmark::beginFrame(FrameInfo& frameInfo) {
+        previousFrameStart = frameStart;
+        frameStart = std::chrono::steady_clock::now();
+
+        // the renderer waited on this frame's fence, so the last timestamps written here are in
+        resolveTimestamps(frameInfo.frameIndex);
+
+        if (framesStarted >= config.warmupFrames && !isDone()) {
+            currentSample = static_cast<int64_t>(samples.size());
+            samples.emplace_back();
+            if (framesStarted > config.warmupFrames) {
+                samples.back().frameMs =
+                    std::chrono::duration<double, std::milli>(frameStart - previousFrameStart).count();
+            }
+        }
+        else {
+            currentSample = -1;
+        }
+        framesStarted++;
+
+        if (timestampsSupported) {
+            uint32_t firstQuery = 2 * static_cast<uint32_t>(frameInfo.frameIndex);
+            vkCmdResetQueryPool(frameInfo.commandBuffer, queryPool, firstQuery, 2);
+            vkCmdWriteTimestamp(
+                frameInfo.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, firstQuery);
+        }
+    }
+
+    void MBenchmark::endFrame(FrameInfo& frameInfo) {
+        if (timestampsSupported) {
+            vkCmdWriteTimestamp(
+                frameInfo.commandBuffer,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                queryPool,
+                2 * static_cast<uint32_t>(frameInfo.frameIndex) + 1);
+            pendingSample[frameInfo.frameIndex] = currentSample;
+        }
+
+        if (currentSample >= 0) {
+            Sample& sample = samples[currentSample];
+            sample.cpuMs = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - frameStart).count();
+            sample.stats = frameInfo.stats;
+        }
+    }
+
+    void MBenchmark::resolveTimestamps(int frameIndex) {
+        int64_t sampleIndex = pendingSample[frameIndex];
+        pendingSample[frameIndex] = -1;
+        if (sampleIndex < 0) {
+            return;
+        }
+
+        uint64_t timestamps[2];
+        VkResult result = vkGetQueryPoolResults(
+            mDevice.device(),
+            queryPool,
+            2 * static_cast<uint32_t>(frameIndex),
+            2,
+            sizeof(timestamps),
+            timestamps,
+            sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT);
+        if (result != VK_SUCCESS) {
+            return;
+        }
+
+        uint64_t ticks = ((timestamps[1] & timestampMask) - (timestamps[0] & timestampMask)) & timestampMask;
+        samples[sampleIndex].gpuMs = ticks * timestampPeriodNs * 1e-6;
+    }
+
+    void MBenchmark::finish() {
+        for (int i = 0; i < MSwapChain::MAX_FRAMES_IN_FLIGHT; i++) {
+            resolveTimestamps(i);
+        }
+    }
+
+    // nearest rank on a sorted copy
+    static double percentile(const std::vector<double>& sorted, double p) {
+        if (sorted.empty()) return 0.0;
+        size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+        return sorted[std::min(std::max(rank, size_t{ 1 }) - 1, sorted.size() - 1)];
+    }
+
+    static void writeDistribution(std::ostream& out, const char* name, std::vector<double> values) {
+        out << "  \"" << name << "\": ";
+        if (values.empty()) {
+            out << "null";
+            return;
+        }
+
+        std::sort(values.begin(), values.end());
+        double sum = 0.0;
+        for (double value : values) sum += value;
+        out << "{ \"mean\": " << sum / values.size() << ", \"min\": " << values.front()
+            << ", \"p50\": " << percentile(values, 50) << ", \"p90\": " << percentile(values, 90)
+            << ", \"p95\": " << percentile(values, 95) << ", \"p99\": " << percentile(values, 99)
+            << ", \"max\": " << values.back() << " }";
+    }
+
+    bool MBenchmark::writeReport() const {
+        std::vector<double> frameMs, cpuMs, gpuMs, drawCalls, objectsDrawn, objectsCulled, objectsSubmitted;
+        for (size_t i = 0; i < samples.size(); i++) {
+            const Sample& sample = samples[i];
+            // the first recorded frame has no previous frame to measure from
+            if (i > 0) frameMs.push_back(sample.frameMs);
+            cpuMs.push_back(sample.cpuMs);
+            if (sample.gpuMs >= 0.0) gpuMs.push_back(sample.gpuMs);
+            drawCalls.push_back(sample.stats.drawCalls);
+            objectsDrawn.push_back(sample.stats.objectsDrawn);
+            objectsCulled.push_back(sample.stats.objectsCulled);
+            objectsSubmitted.push_back(sample.stats.objectsSubmitted);
+        }
+
+        std::ofstream out{ config.reportPath, std::ios::trunc };
+        if (!out.is_open()) {
+            return false;
+        }
+
+        out << "{\n";
+        out << "  \"device\": \"" << mDevice.properties.deviceName << "\",\n";
+        out << "  \"config\": { \"objects\": " << config.objectCount << ", \"lights\": " << config.lightCount
+            << ", \"meshes\": " << config.meshCount << ", \"frames\": " << config.frameCount
+            << ", \"warmupFrames\": " << config.warmupFrames << ", \"seed\": " << config.seed << " },\n";
+        out << "  \"framesRecorded\": " << samples.size() << ",\n";
+        writeDistribution(out, "frameMs", frameMs);
+        out << ",\n";
+        writeDistribution(out, "cpuMs", cpuMs);
+        out << ",\n";
+        writeDistribution(out, "gpuMs", gpuMs);
+        out << ",\n";
+        writeDistribution(out, "drawCalls", drawCalls);
+        out << ",\n";
+        writeDistribution(out, "objectsDrawn", objectsDrawn);
+        out << ",\n";
+        writeDistribution(out, "objectsCulled", objectsCulled);
+        out << ",\n";
+        writeDistribution(out, "objectsSubmitted", objectsSubmitted);
+        out << "\n}\n";
+        return out.good();
+    }
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "m_camera_path.hpp"
+#include "m_device.hpp"
+#include "m_frame_info.hpp"
+#include "m_game_object.hpp"
+#include "m_mesh_pool.hpp"
+#include "m_scene_graph.hpp"
+
+// std
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace m {
+
+    // Synthetic scene plus a fixed camera path and frame count, so two builds can be compared
+    // frame for frame. Everything random comes from config.seed. Per frame it records the CPU
+    // frame time, the GPU time between timestamps at the start and end of the command buffer,
+    // and the draw stats the render systems leave in FrameInfo, then reports percentiles as JSON.
+    class MBenchmark {
+    public:
+        struct Config {
+            uint32_t objectCount = 1000;
+            uint32_t lightCount = 6;  // clamped to MAX_LIGHTS
+            uint32_t meshCount = 8;  // unique meshes the objects are spread over
+            uint32_t frameCount = 1000;  // frames recorded, after the warmup
+            uint32_t warmupFrames = 60;  // not recorded, covers uploads and pipeline warmup
+            uint32_t seed = 1;
+            std::string cameraPathFile;  // orbits the scene when empty
+            std::string reportPath = "benchmark.json";
+        };
+
+        // the camera path is sampled at this step rather than by wall time
+        static constexpr float FRAME_STEP = 1.f / 60.f;
+
+        MBenchmark(MDevice& device, const Config& config);
+        ~MBenchmark();
+
+        MBenchmark(const MBenchmark&) = delete;
+        MBenchmark& operator=(const MBenchmark&) = delete;
+
+        void createScene(MRegistry& registry, MSceneGraph& sceneGraph, MMeshPool* meshPool);
+
+        // the lights created by createScene are its children
+        MEntity getLightRig() const { return lightRig; }
+
+        // moves the viewer to where the path is at the current frame
+        void placeViewer(TransformComponent& viewer) const;
+
+        // call right after MRenderer::beginFrame and right before MRenderer::endFrame, outside
+        // the render pass
+        void beginFrame(FrameInfo& frameInfo);
+        void endFrame(FrameInfo& frameInfo);
+
+        bool isDone() const { return framesStarted >= config.warmupFrames + config.frameCount; }
+
+        // collects the timestamps still in flight, call once the device is idle
+        void finish();
+        bool writeReport() const;
+
+    private:
+        struct Sample {
+            double frameMs = 0.0;  // start of the previous frame to start of this one
+            double cpuMs = 0.0;  // beginFrame to endFrame, the recording work
+            double gpuMs = -1.0;  // negative until resolved
+            FrameStats stats{};
+        };
+
+        void createQueryPool();
+        void resolveTimestamps(int frameIndex);
+
+        MDevice& mDevice;
+        Config config;
+        MCameraPath cameraPath;
+        std::vector<std::shared_ptr<MModel>> meshes;
+        MEntity lightRig{};
+
+        VkQueryPool queryPool = VK_NULL_HANDLE;
+        bool timestampsSupported = false;
+        uint64_t timestampMask = ~0ull;
+        double timestampPeriodNs = 1.0;
+        std::vector<int64_t> pendingSample;  // per frame in flight, -1 when nothing to resolve
+
+        std::vector<Sample> samples;
+        uint32_t framesStarted = 0;
+        int64_t currentSample = -1;
+        std::chrono::steady_clock::time_point frameStart{};
+        std::chrono::steady_clock::time_point previousFrameStart{};
+    };
+
+}
@@ -0,0 +1,146 @@
+#include "m_bindless_table.hpp"
+
+#include "m_swap_chain.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace m {
+
+    MBindlessTable::MBindlessTable(MDevice& device) : mDevice{ device } {
+        constexpr VkDescriptorBindingFlags arrayFlags =
+            VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+            VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+        setLayout =
+            MDescriptorSetLayout::Builder(mDevice)
+            .addBinding(
+                TEXTURE_BINDING,
+                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT,
+                MAX_TEXTURES,
+                arrayFlags)
+            .addBinding(
+                BUFFER_BINDING,
+                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT,
+                MAX_BUFFERS,
+                arrayFlags)
+            .build();
+        descriptorPool =
+            MDescriptorPool::Builder(mDevice)
+            .setMaxSets(1)
+            .setPoolFlags(VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT)
+            .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_TEXTURES)
+            .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, MAX_BUFFERS)
+            .build();
+        if (!descriptorPool->allocateDescriptor(setLayout->getDescriptorSetLayout(), descriptorSet)) {
+            throw std::runtime_error("failed to allocate bindless descriptor set!");
+        }
+
+        createSampler();
+
+        whiteTexture = MTexture::createSolidColor(mDevice, 0xffffffff);
+        uint32_t whiteIndex = addTexture(*whiteTexture);
+        assert(whiteIndex == WHITE_TEXTURE && "The white texture must take the first slot");
+    }
+
+    MBindlessTable::~MBindlessTable() {
+        vkDestroySampler(mDevice.device(), sampler, nullptr);
+    }
+
+    void MBindlessTable::createSampler() {
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.anisotropyEnable = VK_TRUE;
+        samplerInfo.maxAnisotropy = std::min(16.f, mDevice.properties.limits.maxSamplerAnisotropy);
+        samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+        samplerInfo.minLod = 0.f;
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+        samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+
+        if (vkCreateSampler(mDevice.device(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create bindless sampler!");
+        }
+    }
+
+    uint32_t MBindlessTable::addTexture(const MTexture& texture) {
+        std::lock_guard<std::mutex> lock{ mutex };
+        uint32_t index = textureSlots.allocate();
+        VkDescriptorImageInfo imageInfo = texture.descriptorInfo(sampler);
+        MDescriptorWriter(*setLayout, *descriptorPool)
+            .writeImage(TEXTURE_BINDING, &imageInfo, index)
+            .overwrite(descriptorSet);
+        return index;
+    }
+
+    uint32_t MBindlessTable::addBuffer(const VkDescriptorBufferInfo& bufferInfo) {
+        std::lock_guard<std::mutex> lock{ mutex };
+        uint32_t index = bufferSlots.allocate();
+        VkDescriptorBufferInfo info = bufferInfo;
+        MDescriptorWriter(*setLayout, *descriptorPool)
+            .writeBuffer(BUFFER_BINDING, &info, index)
+            .overwrite(descriptorSet);
+        return index;
+    }
+
+    void MBindlessTable::removeTexture(uint32_t index) {
+        assert(index != WHITE_TEXTURE && "The white texture stays for the table's lifetime");
+        std::lock_guard<std::mutex> lock{ mutex };
+        textureSlots.release(index, frameNumber);
+    }
+
+    void MBindlessTable::removeBuffer(uint32_t index) {
+        std::lock_guard<std::mutex> lock{ mutex };
+        bufferSlots.release(index, frameNumber);
+    }
+
+    void MBindlessTable::beginFrame() {
+        std::lock_guard<std::mutex> lock{ mutex };
+        frameNumber++;
+        if (frameNumber < MSwapChain::MAX_FRAMES_IN_FLIGHT) {
+            return;
+        }
+        // the fence of the frame that used this frame's resources last has been waited on
+        uint64_t completedFrame = frameNumber - MSwapChain::MAX_FRAMES_IN_FLIGHT;
+        textureSlots.recycle(completedFrame);
+        bufferSlots.recycle(completedFrame);
+    }
+
+    uint32_t MBindlessTable::SlotAllocator::allocate() {
+        if (!freeSlots.empty()) {
+            uint32_t index = freeSlots.back();
+            freeSlots.pop_back();
+            return index;
+        }
+        if (nextUnused == capacity) {
+            throw std::runtime_error("bindless table is full!");
+        }
+        return nextUnused++;
+    }
+
+    void MBindlessTable::SlotAllocator::release(uint32_t index, uint64_t frame) {
+        assert(index < nextUnused && "Releasing a slot that was never handed out");
+        retiredSlots.push_back({ frame, index });
+    }
+
+    void MBindlessTable::SlotAllocator::recycle(uint64_t completedFrame) {
+        auto stillInUse = std::partition(
+            retiredSlots.begin(),
+            retiredSlots.end(),
+            [completedFrame](const std::pair<uint64_t, uint32_t>& slot) { return slot.first <= completedFrame; });
+        for (auto it = retiredSlots.begin(); it != stillInUse; ++it) {
+            freeSlots.push_back(it->second);
+        }
+        retiredSlots.erase(retiredSlots.begin(), stillInUse);
+    }
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "m_descriptors.hpp"
+#include "m_device.hpp"
+#include "m_texture.hpp"
+
+// std
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace m {
+
+    // One descriptor set with large arrays of textures and storage buffers that shaders index
+    // by number, so a draw picks its material from push constants or instance data instead of
+    // binding a set of its own. The arrays are partially bound and update after bind: slots are
+    // written while frames reading other slots are in flight, and the set is bound once per
+    // command buffer as set 1 of the render systems' pipeline layouts.
+    //
+    // Texture 0 is white, for anything without a texture of its own.
+    class MBindlessTable {
+    public:
+        // must match simple_shader.frag
+        static constexpr uint32_t TEXTURE_BINDING = 0;
+        static constexpr uint32_t BUFFER_BINDING = 1;
+        static constexpr uint32_t MAX_TEXTURES = 16384;
+        static constexpr uint32_t MAX_BUFFERS = 4096;
+        static constexpr uint32_t WHITE_TEXTURE = 0;
+
+        explicit MBindlessTable(MDevice& device);
+        ~MBindlessTable();
+
+        MBindlessTable(const MBindlessTable&) = delete;
+        MBindlessTable& operator=(const MBindlessTable&) = delete;
+
+        // return the index shaders look the descriptor up by. thread safe, the texture or buffer
+        // has to outlive its slot
+        uint32_t addTexture(const MTexture& texture);
+        uint32_t addBuffer(const VkDescriptorBufferInfo& bufferInfo);
+
+        // the slot is handed out again once the frames in flight that may still read it are done
+        void removeTexture(uint32_t index);
+        void removeBuffer(uint32_t index);
+
+        // call once per frame after MRenderer::beginFrame
+        void beginFrame();
+
+        VkDescriptorSetLayout getDescriptorSetLayout() const { return setLayout->getDescriptorSetLayout(); }
+        VkDescriptorSet getDescriptorSet() const { return descriptorSet; }
+        VkSampler getSampler() const { return sampler; }
+
+    private:
+        class SlotAllocator {
+        public:
+            explicit SlotAllocator(uint32_t capacity) : capacity{ capacity } {}
+
+            uint32_t allocate();
+            void release(uint32_t index, uint64_t frame);
+            void recycle(uint64_t completedFrame);
+
+        private:
+            uint32_t capacity;
+            uint32_t nextUnused = 0;
+            std::vector<uint32_t> freeSlots;
+            std::vector<std::pair<uint64_t, uint32_t>> retiredSlots;  // frame released, slot
+        };
+
+        void createSampler();
+
+        MDevice& mDevice;
+        std::unique_ptr<MDescriptorSetLayout> setLayout;
+        std::unique_ptr<MDescriptorPool> descriptorPool;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        VkSampler sampler = VK_NULL_HANDLE;
+
+        std::unique_ptr<MTexture> whiteTexture;
+
+        SlotAllocator textureSlots{ MAX_TEXTURES };
+        SlotAllocator bufferSlots{ MAX_BUFFERS };
+        uint64_t frameNumber = 0;
+        std::mutex mutex;
+    };
+
+}
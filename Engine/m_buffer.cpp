@@ -28,7 +28,8 @@ namespace m {
         uint32_t instanceCount,
         VkBufferUsageFlags usageFlags,
         VkMemoryPropertyFlags memoryPropertyFlags,
-        VkDeviceSize minOffsetAlignment)
+        VkDeviceSize minOffsetAlignment,
+        MAllocationKind allocationKind)
         : mDevice{ device },
         instanceSize{ instanceSize },
         instanceCount{ instanceCount },
@@ -36,18 +37,21 @@ namespace m {
         memoryPropertyFlags{ memoryPropertyFlags } {
         alignmentSize = getAlignment(instanceSize, minOffsetAlignment);
         bufferSize = alignmentSize * instanceCount;
-        device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, memory);
+        device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, memory, allocationKind);
     }
 
     MBuffer::~MBuffer() {
         unmap();
         vkDestroyBuffer(mDevice.device(), buffer, nullptr);
-        vkFreeMemory(mDevice.device(), memory, nullptr);
+        mDevice.freeMemory(memory);
     }
 
     /**
      * Map a memory range of this buffer. If successful, mapped points to the specified buffer range.
      *
+     * @note Host visible blocks are persistently mapped by the allocator, this only resolves the
+     * pointer into that mapping
+     *
      * @param size (Optional) Size of the memory range to map. Pass VK_WHOLE_SIZE to map the complete
      * buffer range.
      * @param offset (Optional) Byte offset from beginning
@@ -55,21 +59,22 @@ namespace m {
      * @return VkResult of the buffer mapping call
      */
     VkResult MBuffer::map(VkDeviceSize size, VkDeviceSize offset) {
-        assert(buffer && memory && "Called map on buffer before create!");
+        assert(buffer && memory.memory && "Called map on buffer before create!");
 
-        return vkMapMemory(mDevice.device(), memory, offset, size, 0, &mapped);
+        if (memory.mapped == nullptr) {
+            return VK_ERROR_MEMORY_MAP_FAILED;
+        }
+        mapped = static_cast<char*>(memory.mapped) + offset;
+        return VK_SUCCESS;
     }
 
     /**
      * Unmap a mapped memory range
      *
-     * @note Does not return a result as vkUnmapMemory can't fail
+     * @note The block mapping is owned by the allocator and stays valid, only our view is dropped
      */
     void MBuffer::unmap() {
-        if (mapped) {
-            vkUnmapMemory(mDevice.device(), memory);
-            mapped = nullptr;
-        }
+        mapped = nullptr;
     }
 
     /**
@@ -106,11 +111,7 @@ namespace m {
      * @return VkResult of the flush call
      */
     VkResult MBuffer::flush(VkDeviceSize size, VkDeviceSize offset) {
-        VkMappedMemoryRange mappedRange = {};
-        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = memory;
-        mappedRange.offset = offset;
-        mappedRange.size = size;
+        VkMappedMemoryRange mappedRange = mDevice.getAllocator().mappedRange(memory, size, offset);
         return vkFlushMappedMemoryRanges(mDevice.device(), 1, &mappedRange);
     }
 
@@ -126,11 +127,7 @@ namespace m {
      * @return VkResult of the invalidate call
      */
     VkResult MBuffer::invalidate(VkDeviceSize size, VkDeviceSize offset) {
-        VkMappedMemoryRange mappedRange = {};
-        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = memory;
-        mappedRange.offset = offset;
-        mappedRange.size = size;
+        VkMappedMemoryRange mappedRange = mDevice.getAllocator().mappedRange(memory, size, offset);
         return vkInvalidateMappedMemoryRanges(mDevice.device(), 1, &mappedRange);
     }
 
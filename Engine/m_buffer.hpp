@@ -12,7 +12,8 @@ namespace m {
             uint32_t instanceCount,
             VkBufferUsageFlags usageFlags,
             VkMemoryPropertyFlags memoryPropertyFlags,
-            VkDeviceSize minOffsetAlignment = 1);
+            VkDeviceSize minOffsetAlignment = 1,
+            MAllocationKind allocationKind = MAllocationKind::Buffer);
         ~MBuffer();
 
         MBuffer(const MBuffer&) = delete;
@@ -46,7 +47,7 @@ namespace m {
         MDevice& mDevice;
         void* mapped = nullptr;
         VkBuffer buffer = VK_NULL_HANDLE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        MAllocation memory{};
 
         VkDeviceSize bufferSize;
         uint32_t instanceCount;
@@ -15,6 +15,8 @@ namespace m {
         projectionMatrix[3][0] = -(right + left) / (right - left);
         projectionMatrix[3][1] = -(bottom + top) / (bottom - top);
         projectionMatrix[3][2] = -near / (far - near);
+        nearPlane = near;
+        farPlane = far;
     }
 
     void MCamera::setPerspectiveProjection(float fovy, float aspect, float near, float far) {
@@ -26,6 +28,8 @@ namespace m {
         projectionMatrix[2][2] = far / (far - near);
         projectionMatrix[2][3] = 1.f;
         projectionMatrix[3][2] = -(far * near) / (far - near);
+        nearPlane = near;
+        farPlane = far;
     }
 
     void MCamera::setViewDirection(glm::vec3 position, glm::vec3 direction, glm::vec3 up) {
@@ -105,4 +109,35 @@ namespace m {
         inverseViewMatrix[3][2] = position.z;
     }
 
+    bool MFrustum::intersectsSphere(const glm::vec3& center, float radius) const {
+        for (const auto& plane : planes) {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    MFrustum MCamera::getFrustum() const {
+        // Gribb/Hartmann plane extraction, with the near plane at z = 0 for the 0..1 depth range
+        const glm::mat4 m = projectionMatrix * viewMatrix;
+        const glm::vec4 row0{ m[0][0], m[1][0], m[2][0], m[3][0] };
+        const glm::vec4 row1{ m[0][1], m[1][1], m[2][1], m[3][1] };
+        const glm::vec4 row2{ m[0][2], m[1][2], m[2][2], m[3][2] };
+        const glm::vec4 row3{ m[0][3], m[1][3], m[2][3], m[3][3] };
+
+        MFrustum frustum{};
+        frustum.planes[MFrustum::Left] = row3 + row0;
+        frustum.planes[MFrustum::Right] = row3 - row0;
+        frustum.planes[MFrustum::Bottom] = row3 + row1;
+        frustum.planes[MFrustum::Top] = row3 - row1;
+        frustum.planes[MFrustum::Near] = row2;
+        frustum.planes[MFrustum::Far] = row3 - row2;
+
+        for (auto& plane : frustum.planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        return frustum;
+    }
+
 }
\ No newline at end of file
@@ -7,6 +7,16 @@
 
 namespace m {
 
+    // planes as (normal, distance) with normals pointing inwards, so dot(normal, p) + distance is
+    // negative for points outside
+    struct MFrustum {
+        enum Plane { Left = 0, Right, Bottom, Top, Near, Far, Count };
+
+        glm::vec4 planes[Count];
+
+        bool intersectsSphere(const glm::vec3& center, float radius) const;
+    };
+
     class MCamera {
     public:
         void setOrthographicProjection(
@@ -24,10 +34,17 @@ namespace m {
         const glm::mat4& getView() const { return viewMatrix; }
         const glm::mat4& getInverseView() const { return inverseViewMatrix; }
         const glm::vec3 getPosition() const { return glm::vec3(inverseViewMatrix[3]); }
+        float getNear() const { return nearPlane; }
+        float getFar() const { return farPlane; }
+
+        // world space planes of projection * view
+        MFrustum getFrustum() const;
 
     private:
         glm::mat4 projectionMatrix{ 1.f };
         glm::mat4 viewMatrix{ 1.f };
         glm::mat4 inverseViewMatrix{ 1.f };
+        float nearPlane = .1f;
+        float farPlane = 100.f;
     };
 }
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include "m_camera_path.hpp"
+
+// libs
+#include <glm/gtc/constants.hpp>
+
+// std
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace m {
+
+    MCameraPath MCameraPath::orbit(glm::vec3 center, float radius, float height, float duration) {
+        // enough keyframes that the chords between them read as a circle
+        constexpr int KEYFRAME_COUNT = 64;
+
+        MCameraPath path{};
+        float pitch = -glm::atan(height, radius);  // negative y is up, so this looks down
+        for (int i = 0; i <= KEYFRAME_COUNT; i++) {
+            float t = static_cast<float>(i) / KEYFRAME_COUNT;
+            float yaw = t * glm::two_pi<float>();
+            glm::vec3 forward{ glm::sin(yaw), 0.f, glm::cos(yaw) };
+            path.addKeyframe(
+                t * duration,
+                center - forward * radius + glm::vec3{ 0.f, -height, 0.f },
+                { pitch, yaw, 0.f });
+        }
+        return path;
+    }
+
+    bool MCameraPath::load(const std::string& filepath) {
+        std::ifstream file{ filepath };
+        if (!file.is_open()) {
+            return false;
+        }
+
+        std::vector<Keyframe> loaded;
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') continue;
+
+            std::istringstream stream{ line };
+            Keyframe keyframe{};
+            stream >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z >>
+                keyframe.rotation.x >> keyframe.rotation.y >> keyframe.rotation.z;
+            if (stream.fail() || (!loaded.empty() && keyframe.time < loaded.back().time)) {
+                return false;
+            }
+            loaded.push_back(keyframe);
+        }
+
+        keyframes = std::move(loaded);
+        return !keyframes.empty();
+    }
+
+    bool MCameraPath::save(const std::string& filepath) const {
+        std::ofstream file{ filepath, std::ios::trunc };
+        if (!file.is_open()) {
+            return false;
+        }
+
+        file << "# time px py pz rx ry rz\n";
+        for (const auto& keyframe : keyframes) {
+            file << keyframe.time << " " << keyframe.position.x << " " << keyframe.position.y << " "
+                << keyframe.position.z << " " << keyframe.rotation.x << " " << keyframe.rotation.y << " "
+                << keyframe.rotation.z << "\n";
+        }
+        return file.good();
+    }
+
+    void MCameraPath::addKeyframe(float time, const glm::vec3& position, const glm::vec3& rotation) {
+        keyframes.push_back({ time, position, rotation });
+    }
+
+    void MCameraPath::sample(float time, glm::vec3& position, glm::vec3& rotation) const {
+        if (keyframes.empty()) {
+            return;
+        }
+        if (time <= keyframes.front().time) {
+            position = keyframes.front().position;
+            rotation = keyframes.front().rotation;
+            return;
+        }
+        if (time >= keyframes.back().time) {
+            position = keyframes.back().position;
+            rotation = keyframes.back().rotation;
+            return;
+        }
+
+        auto next = std::upper_bound(
+            keyframes.begin(),
+            keyframes.end(),
+            time,
+            [](float t, const Keyframe& keyframe) { return t < keyframe.time; });
+        const Keyframe& b = *next;
+        const Keyframe& a = *(next - 1);
+        float span = b.time - a.time;
+        float t = span > 0.f ? (time - a.time) / span : 0.f;
+        position = glm::mix(a.position, b.position, t);
+        rotation = glm::mix(a.rotation, b.rotation, t);
+    }
+
+}
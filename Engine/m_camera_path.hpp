@@ -0,0 +1,44 @@
+#pragma once
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <string>
+#include <vector>
+
+namespace m {
+
+    // Keyframed camera positions and MCamera::setViewYXZ rotations, played back by the benchmark
+    // and recorded from an interactive session. Files are plain text, one keyframe per line:
+    // time px py pz rx ry rz
+    class MCameraPath {
+    public:
+        struct Keyframe {
+            float time;
+            glm::vec3 position;
+            glm::vec3 rotation;
+        };
+
+        // circles center once per duration seconds, looking at it from height above
+        static MCameraPath orbit(glm::vec3 center, float radius, float height, float duration);
+
+        bool load(const std::string& filepath);
+        bool save(const std::string& filepath) const;
+
+        // keyframes must be added in time order
+        void addKeyframe(float time, const glm::vec3& position, const glm::vec3& rotation);
+
+        // linear between keyframes, held at the ends
+        void sample(float time, glm::vec3& position, glm::vec3& rotation) const;
+
+        bool empty() const { return keyframes.empty(); }
+        float duration() const { return keyframes.empty() ? 0.f : keyframes.back().time; }
+
+    private:
+        std::vector<Keyframe> keyframes;
+    };
+
+}
@@ -12,7 +12,8 @@ namespace m {
         uint32_t binding,
         VkDescriptorType descriptorType,
         VkShaderStageFlags stageFlags,
-        uint32_t count) {
+        uint32_t count,
+        VkDescriptorBindingFlags flags) {
         assert(bindings.count(binding) == 0 && "Binding already in use");
         VkDescriptorSetLayoutBinding layoutBinding{};
         layoutBinding.binding = binding;
@@ -20,21 +21,31 @@ namespace m {
         layoutBinding.descriptorCount = count;
         layoutBinding.stageFlags = stageFlags;
         bindings[binding] = layoutBinding;
+        if (flags != 0) {
+            bindingFlags[binding] = flags;
+        }
         return *this;
     }
 
     std::unique_ptr<MDescriptorSetLayout> MDescriptorSetLayout::Builder::build() const {
-        return std::make_unique<MDescriptorSetLayout>(mDevice, bindings);
+        return std::make_unique<MDescriptorSetLayout>(mDevice, bindings, bindingFlags);
     }
 
     // *************** Descriptor Set Layout *********************
 
     MDescriptorSetLayout::MDescriptorSetLayout(
-        MDevice& mDevice, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings)
+        MDevice& mDevice,
+        std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings,
+        const std::unordered_map<uint32_t, VkDescriptorBindingFlags>& bindingFlags)
         : mDevice{ mDevice }, bindings{ bindings } {
         std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
+        std::vector<VkDescriptorBindingFlags> setLayoutBindingFlags{};
+        VkDescriptorBindingFlags allFlags = 0;
         for (auto kv : bindings) {
             setLayoutBindings.push_back(kv.second);
+            auto flags = bindingFlags.find(kv.first);
+            setLayoutBindingFlags.push_back(flags != bindingFlags.end() ? flags->second : 0);
+            allFlags |= setLayoutBindingFlags.back();
         }
 
         VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
@@ -42,6 +53,18 @@ namespace m {
         descriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
         descriptorSetLayoutInfo.pBindings = setLayoutBindings.data();
 
+        // the flags are parallel to pBindings
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+        bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        bindingFlagsInfo.bindingCount = static_cast<uint32_t>(setLayoutBindingFlags.size());
+        bindingFlagsInfo.pBindingFlags = setLayoutBindingFlags.data();
+        if (allFlags != 0) {
+            descriptorSetLayoutInfo.pNext = &bindingFlagsInfo;
+        }
+        if (allFlags & VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT) {
+            descriptorSetLayoutInfo.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+        }
+
         if (vkCreateDescriptorSetLayout(
             mDevice.device(),
             &descriptorSetLayoutInfo,
@@ -135,19 +158,20 @@ namespace m {
     MDescriptorWriter::MDescriptorWriter(MDescriptorSetLayout& setLayout, MDescriptorPool& pool) : setLayout{ setLayout }, pool{ pool } {}
 
     MDescriptorWriter& MDescriptorWriter::writeBuffer(
-        uint32_t binding, VkDescriptorBufferInfo* bufferInfo) {
+        uint32_t binding, VkDescriptorBufferInfo* bufferInfo, uint32_t arrayElement) {
         assert(setLayout.bindings.count(binding) == 1 && "Layout does not contain specified binding");
 
         auto& bindingDescription = setLayout.bindings[binding];
 
         assert(
-            bindingDescription.descriptorCount == 1 &&
-            "Binding single descriptor info, but binding expects multiple");
+            arrayElement < bindingDescription.descriptorCount &&
+            "Array element is past the end of the binding");
 
         VkWriteDescriptorSet write{};
         write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         write.descriptorType = bindingDescription.descriptorType;
         write.dstBinding = binding;
+        write.dstArrayElement = arrayElement;
         write.pBufferInfo = bufferInfo;
         write.descriptorCount = 1;
 
@@ -156,19 +180,20 @@ namespace m {
     }
 
     MDescriptorWriter& MDescriptorWriter::writeImage(
-        uint32_t binding, VkDescriptorImageInfo* imageInfo) {
+        uint32_t binding, VkDescriptorImageInfo* imageInfo, uint32_t arrayElement) {
         assert(setLayout.bindings.count(binding) == 1 && "Layout does not contain specified binding");
 
         auto& bindingDescription = setLayout.bindings[binding];
 
         assert(
-            bindingDescription.descriptorCount == 1 &&
-            "Binding single descriptor info, but binding expects multiple");
+            arrayElement < bindingDescription.descriptorCount &&
+            "Array element is past the end of the binding");
 
         VkWriteDescriptorSet write{};
         write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         write.descriptorType = bindingDescription.descriptorType;
         write.dstBinding = binding;
+        write.dstArrayElement = arrayElement;
         write.pImageInfo = imageInfo;
         write.descriptorCount = 1;
 
@@ -15,20 +15,27 @@ namespace m {
         public:
             Builder(MDevice& mDevice) : mDevice{ mDevice } {}
 
+            // bindingFlags are the descriptor indexing flags. a binding with
+            // VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT makes the layout update after bind,
+            // and sets with it have to come from a pool with the matching flag
             Builder& addBinding(
                 uint32_t binding,
                 VkDescriptorType descriptorType,
                 VkShaderStageFlags stageFlags,
-                uint32_t count = 1);
+                uint32_t count = 1,
+                VkDescriptorBindingFlags bindingFlags = 0);
             std::unique_ptr<MDescriptorSetLayout> build() const;
 
         private:
             MDevice& mDevice;
             std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings{};
+            std::unordered_map<uint32_t, VkDescriptorBindingFlags> bindingFlags{};
         };
 
         MDescriptorSetLayout(
-            MDevice& mDevice, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings);
+            MDevice& mDevice,
+            std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings,
+            const std::unordered_map<uint32_t, VkDescriptorBindingFlags>& bindingFlags = {});
         ~MDescriptorSetLayout();
         MDescriptorSetLayout(const MDescriptorSetLayout&) = delete;
         MDescriptorSetLayout& operator=(const MDescriptorSetLayout&) = delete;
@@ -88,8 +95,11 @@ namespace m {
     public:
         MDescriptorWriter(MDescriptorSetLayout& setLayout, MDescriptorPool& pool);
 
-        MDescriptorWriter& writeBuffer(uint32_t binding, VkDescriptorBufferInfo* bufferInfo);
-        MDescriptorWriter& writeImage(uint32_t binding, VkDescriptorImageInfo* imageInfo);
+        // arrayElement picks the descriptor to write in an array binding
+        MDescriptorWriter& writeBuffer(
+            uint32_t binding, VkDescriptorBufferInfo* bufferInfo, uint32_t arrayElement = 0);
+        MDescriptorWriter& writeImage(
+            uint32_t binding, VkDescriptorImageInfo* imageInfo, uint32_t arrayElement = 0);
 
         bool build(VkDescriptorSet& set);
         void overwrite(VkDescriptorSet& set);
@@ -1,7 +1,11 @@
 #include "m_device.hpp"
 
+#include "m_upload_manager.hpp"
+
 // std headers
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <set>
 #include <unordered_set>
@@ -47,17 +51,42 @@ namespace m {
         }
     }
 
+    // written in front of the driver's blob. the driver validates its own header too, but a
+    // driver update keeps the cache UUID on some implementations while changing the format
+    struct PipelineCacheFileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        uint64_t dataSize;
+    };
+
+    static constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x4350504d;  // "MPPC"
+    static constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
     // class member functions
     MDevice::MDevice(MWindow& window) : window{ window } {
+        if (window.isHeadless()) {
+            deviceExtensions.clear();
+        }
         createInstance();
         setupDebugMessenger(); //disable on released builds
         createSurface();
         pickPhysicalDevice();
         createLogicalDevice();
         createCommandPool();
+        createAllocator();
+        createPipelineCache();
+        uploadManager = std::make_unique<MUploadManager>(*this);
     }
 
     MDevice::~MDevice() {
+        uploadManager.reset();
+        allocator.reset();
+        savePipelineCache();
+        vkDestroyPipelineCache(device_, pipelineCache_, nullptr);
         vkDestroyCommandPool(device_, commandPool, nullptr);
         vkDestroyDevice(device_, nullptr);
 
@@ -80,7 +109,7 @@ namespace m {
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "No Engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        appInfo.apiVersion = VK_API_VERSION_1_2;
 
         VkInstanceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -140,6 +169,9 @@ namespace m {
 
         std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
         std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily };
+        if (indices.transferFamilyHasValue) {
+            uniqueQueueFamilies.insert(indices.transferFamily);
+        }
 
         float queuePriority = 1.0f;
         for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -151,8 +183,49 @@ namespace m {
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
-        VkPhysicalDeviceFeatures deviceFeatures = {};
-        deviceFeatures.samplerAnisotropy = VK_TRUE;
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+        // 1.2 features can only be queried and enabled through the features2 chain
+        VkPhysicalDeviceVulkan12Features supportedFeatures12 = {};
+        supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 query = {};
+        query.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        query.pNext = &supportedFeatures12;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &query);
+
+        features.multiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+        features.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+        features.drawIndirectCount = supportedFeatures12.drawIndirectCount == VK_TRUE;
+        features.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery == VK_TRUE;
+        features.textureCompressionBC = supportedFeatures.textureCompressionBC == VK_TRUE;
+
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+        features.timestampValidBits = queueFamilies[indices.graphicsFamily].timestampValidBits;
+
+        VkPhysicalDeviceVulkan12Features deviceFeatures12 = {};
+        deviceFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        deviceFeatures12.drawIndirectCount = supportedFeatures12.drawIndirectCount;
+        // required by isDeviceSuitable, MBindlessTable is built on them
+        deviceFeatures12.descriptorIndexing = VK_TRUE;
+        deviceFeatures12.runtimeDescriptorArray = VK_TRUE;
+        deviceFeatures12.descriptorBindingPartiallyBound = VK_TRUE;
+        deviceFeatures12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        deviceFeatures12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        deviceFeatures12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        deviceFeatures12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+
+        VkPhysicalDeviceFeatures2 deviceFeatures = {};
+        deviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        deviceFeatures.pNext = &deviceFeatures12;
+        deviceFeatures.features.samplerAnisotropy = VK_TRUE;
+        deviceFeatures.features.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+        deviceFeatures.features.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+        deviceFeatures.features.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+        deviceFeatures.features.textureCompressionBC = supportedFeatures.textureCompressionBC;
 
         VkDeviceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -160,7 +233,8 @@ namespace m {
         createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
-        createInfo.pEnabledFeatures = &deviceFeatures;
+        createInfo.pNext = &deviceFeatures;
+        createInfo.pEnabledFeatures = nullptr;
         createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
         createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
@@ -178,8 +252,19 @@ namespace m {
             throw std::runtime_error("failed to create logical device!");
         }
 
+        graphicsFamily_ = indices.graphicsFamily;
         vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
         vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+
+        // without a copy engine uploads share the graphics queue, see getQueueMutex
+        if (indices.transferFamilyHasValue) {
+            transferFamily_ = indices.transferFamily;
+            vkGetDeviceQueue(device_, indices.transferFamily, 0, &transferQueue_);
+        }
+        else {
+            transferFamily_ = indices.graphicsFamily;
+            transferQueue_ = graphicsQueue_;
+        }
     }
 
     void MDevice::createCommandPool() {
@@ -196,15 +281,111 @@ namespace m {
         }
     }
 
-    void MDevice::createSurface() { window.createWindowSurface(instance, &surface_); }
+    void MDevice::createAllocator() {
+        allocator = std::make_unique<MMemoryAllocator>(device_, physicalDevice);
+    }
+
+    void MDevice::createPipelineCache() {
+        // a missing, stale or foreign cache file just means starting with an empty cache
+        std::vector<char> initialData;
+        std::ifstream file{ PIPELINE_CACHE_PATH, std::ios::binary | std::ios::ate };
+        if (file.is_open()) {
+            size_t fileSize = static_cast<size_t>(file.tellg());
+            PipelineCacheFileHeader header{};
+            if (fileSize >= sizeof(header)) {
+                file.seekg(0);
+                file.read(reinterpret_cast<char*>(&header), sizeof(header));
+            }
+
+            bool valid = file.good() &&
+                header.magic == PIPELINE_CACHE_MAGIC &&
+                header.version == PIPELINE_CACHE_VERSION &&
+                header.vendorID == properties.vendorID &&
+                header.deviceID == properties.deviceID &&
+                header.driverVersion == properties.driverVersion &&
+                std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0 &&
+                header.dataSize == fileSize - sizeof(header);
+            if (valid) {
+                initialData.resize(header.dataSize);
+                file.read(initialData.data(), header.dataSize);
+                if (!file.good()) {
+                    initialData.clear();
+                }
+            }
+            else {
+                std::cout << "ignoring stale pipeline cache " << PIPELINE_CACHE_PATH << std::endl;
+            }
+        }
+
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = initialData.size();
+        cacheInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+        if (vkCreatePipelineCache(device_, &cacheInfo, nullptr, &pipelineCache_) != VK_SUCCESS) {
+            // the driver may still reject data that passed our checks
+            cacheInfo.initialDataSize = 0;
+            cacheInfo.pInitialData = nullptr;
+            if (vkCreatePipelineCache(device_, &cacheInfo, nullptr, &pipelineCache_) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create pipeline cache!");
+            }
+        }
+    }
+
+    bool MDevice::savePipelineCache() {
+        size_t dataSize = 0;
+        if (vkGetPipelineCacheData(device_, pipelineCache_, &dataSize, nullptr) != VK_SUCCESS) {
+            return false;
+        }
+        std::vector<char> data(dataSize);
+        if (vkGetPipelineCacheData(device_, pipelineCache_, &dataSize, data.data()) != VK_SUCCESS) {
+            return false;
+        }
+
+        PipelineCacheFileHeader header{};
+        header.magic = PIPELINE_CACHE_MAGIC;
+        header.version = PIPELINE_CACHE_VERSION;
+        header.vendorID = properties.vendorID;
+        header.deviceID = properties.deviceID;
+        header.driverVersion = properties.driverVersion;
+        std::memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+        header.dataSize = dataSize;
+
+        // write to the side and swap it in, so a crash mid write can't leave a torn cache
+        std::string tempPath = std::string{ PIPELINE_CACHE_PATH } + ".tmp";
+        {
+            std::ofstream out{ tempPath, std::ios::binary | std::ios::trunc };
+            if (!out.is_open()) {
+                return false;
+            }
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(data.data(), dataSize);
+            if (!out.good()) {
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, PIPELINE_CACHE_PATH, error);
+        if (error) {
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+        return true;
+    }
+
+    void MDevice::createSurface() {
+        if (window.isHeadless()) return;
+        window.createWindowSurface(instance, &surface_);
+    }
 
     bool MDevice::isDeviceSuitable(VkPhysicalDevice device) {
         QueueFamilyIndices indices = findQueueFamilies(device);
 
         bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-        bool swapChainAdequate = false;
-        if (extensionsSupported) {
+        bool swapChainAdequate = window.isHeadless();
+        if (extensionsSupported && !swapChainAdequate) {
             SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
             swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
         }
@@ -212,8 +393,29 @@ namespace m {
         VkPhysicalDeviceFeatures supportedFeatures;
         vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
+        // MBindlessTable needs descriptor indexing, which is core in 1.2
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(device, &deviceProperties);
+        bool descriptorIndexingSupported = false;
+        if (deviceProperties.apiVersion >= VK_API_VERSION_1_2) {
+            VkPhysicalDeviceVulkan12Features supportedFeatures12 = {};
+            supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+            VkPhysicalDeviceFeatures2 query = {};
+            query.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            query.pNext = &supportedFeatures12;
+            vkGetPhysicalDeviceFeatures2(device, &query);
+            descriptorIndexingSupported =
+                supportedFeatures12.descriptorIndexing &&
+                supportedFeatures12.runtimeDescriptorArray &&
+                supportedFeatures12.descriptorBindingPartiallyBound &&
+                supportedFeatures12.descriptorBindingUpdateUnusedWhilePending &&
+                supportedFeatures12.descriptorBindingSampledImageUpdateAfterBind &&
+                supportedFeatures12.descriptorBindingStorageBufferUpdateAfterBind &&
+                supportedFeatures12.shaderSampledImageArrayNonUniformIndexing;
+        }
+
         return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-            supportedFeatures.samplerAnisotropy;
+            supportedFeatures.samplerAnisotropy && descriptorIndexingSupported;
     }
 
     void MDevice::populateDebugMessengerCreateInfo(
@@ -264,11 +466,13 @@ namespace m {
     }
 
     std::vector<const char*> MDevice::getRequiredExtensions() {
-        uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions;
-        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-        std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        std::vector<const char*> extensions;
+        if (!window.isHeadless()) {
+            uint32_t glfwExtensionCount = 0;
+            const char** glfwExtensions;
+            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+            extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        }
 
         if (enableValidationLayers) {
             extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -330,19 +534,37 @@ namespace m {
         vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
         int i = 0;
+        bool transferIsCopyOnly = false;
         for (const auto& queueFamily : queueFamilies) {
-            if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-                indices.graphicsFamily = i;
-                indices.graphicsFamilyHasValue = true;
-            }
-            VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
-            if (queueFamily.queueCount > 0 && presentSupport) {
-                indices.presentFamily = i;
-                indices.presentFamilyHasValue = true;
+            if (!indices.isComplete()) {
+                if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                    indices.graphicsFamily = i;
+                    indices.graphicsFamilyHasValue = true;
+                }
+                // headless frames are never presented, the graphics queue stands in
+                VkBool32 presentSupport = false;
+                if (window.isHeadless()) {
+                    presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+                }
+                else {
+                    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+                }
+                if (queueFamily.queueCount > 0 && presentSupport) {
+                    indices.presentFamily = i;
+                    indices.presentFamilyHasValue = true;
+                }
             }
-            if (indices.isComplete()) {
-                break;
+
+            // a family without graphics is a separate copy engine on most hardware, prefer one
+            // that can't do compute either since that is the dedicated DMA queue
+            if (queueFamily.queueCount > 0 && (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+                !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+                bool copyOnly = !(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT);
+                if (!indices.transferFamilyHasValue || (copyOnly && !transferIsCopyOnly)) {
+                    indices.transferFamily = i;
+                    indices.transferFamilyHasValue = true;
+                    transferIsCopyOnly = copyOnly;
+                }
             }
 
             i++;
@@ -412,13 +634,22 @@ namespace m {
         VkBufferUsageFlags usage,
         VkMemoryPropertyFlags properties,
         VkBuffer& buffer,
-        VkDeviceMemory& bufferMemory) {
+        MAllocation& bufferMemory,
+        MAllocationKind kind) {
         VkBufferCreateInfo bufferInfo{};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.size = size;
         bufferInfo.usage = usage;
         bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+        // upload destinations are written from the transfer queue and read on the graphics queue
+        uint32_t families[] = { getGraphicsQueueFamily(), transferFamily_ };
+        if ((usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) && families[0] != families[1]) {
+            bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            bufferInfo.queueFamilyIndexCount = 2;
+            bufferInfo.pQueueFamilyIndices = families;
+        }
+
         if (vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
             throw std::runtime_error("failed to create vertex buffer!");
         }
@@ -426,16 +657,14 @@ namespace m {
         VkMemoryRequirements memRequirements;
         vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+        bufferMemory = allocator->allocate(
+            memRequirements,
+            findMemoryType(memRequirements.memoryTypeBits, properties),
+            kind);
 
-        if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate vertex buffer memory!");
+        if (vkBindBufferMemory(device_, buffer, bufferMemory.memory, bufferMemory.offset) != VK_SUCCESS) {
+            throw std::runtime_error("failed to bind vertex buffer memory!");
         }
-
-        vkBindBufferMemory(device_, buffer, bufferMemory, 0);
     }
 
     VkCommandBuffer MDevice::beginSingleTimeCommands() {
@@ -464,6 +693,7 @@ namespace m {
         submitInfo.commandBufferCount = 1;
         submitInfo.pCommandBuffers = &commandBuffer;
 
+        std::lock_guard<std::mutex> lock{ queueMutex };
         vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
         vkQueueWaitIdle(graphicsQueue_);
 
@@ -513,7 +743,7 @@ namespace m {
         const VkImageCreateInfo& imageInfo,
         VkMemoryPropertyFlags properties,
         VkImage& image,
-        VkDeviceMemory& imageMemory) {
+        MAllocation& imageMemory) {
         if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS) {
             throw std::runtime_error("failed to create image!");
         }
@@ -521,16 +751,13 @@ namespace m {
         VkMemoryRequirements memRequirements;
         vkGetImageMemoryRequirements(device_, image, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate image memory!");
-        }
+        imageMemory = allocator->allocate(
+            memRequirements,
+            findMemoryType(memRequirements.memoryTypeBits, properties),
+            imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL ? MAllocationKind::Image
+                                                        : MAllocationKind::Buffer);
 
-        if (vkBindImageMemory(device_, image, imageMemory, 0) != VK_SUCCESS) {
+        if (vkBindImageMemory(device_, image, imageMemory.memory, imageMemory.offset) != VK_SUCCESS) {
             throw std::runtime_error("failed to bind image memory!");
         }
     }
@@ -1,13 +1,18 @@
 #pragma once
 
+#include "m_memory_allocator.hpp"
 #include "m_window.hpp"
 
 //std lib headers
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 namespace m {
 
+    class MUploadManager;
+
     struct SwapChainSupportDetails {
         VkSurfaceCapabilitiesKHR capabilities;
         std::vector<VkSurfaceFormatKHR> formats;
@@ -17,11 +22,23 @@ namespace m {
     struct QueueFamilyIndices {
         uint32_t graphicsFamily;
         uint32_t presentFamily;
+        uint32_t transferFamily;
         bool graphicsFamilyHasValue = false;
         bool presentFamilyHasValue = false;
+        bool transferFamilyHasValue = false;  // optional, only set for a family without graphics
         bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
     };
 
+    // optional features, enabled when the physical device has them
+    struct DeviceFeatures {
+        bool multiDrawIndirect = false;
+        bool drawIndirectFirstInstance = false;
+        bool drawIndirectCount = false;  // vkCmdDrawIndexedIndirectCount, core in 1.2
+        bool pipelineStatisticsQuery = false;
+        bool textureCompressionBC = false;  // BC1 to BC7 images can be sampled
+        uint32_t timestampValidBits = 0;  // of the graphics queue, 0 when it can't write timestamps
+    };
+
     class MDevice {
     public:
 #ifdef NDEBUG
@@ -41,13 +58,24 @@ namespace m {
 
         VkCommandPool getCommandPool() { return commandPool; }
         VkDevice device() { return device_; }
-        VkSurfaceKHR surface() { return surface_; }
+        VkSurfaceKHR surface() { return surface_; }  // VK_NULL_HANDLE when headless
+        bool isHeadless() const { return window.isHeadless(); }
         VkQueue graphicsQueue() { return graphicsQueue_; }
         VkQueue presentQueue() { return presentQueue_; }
+        VkQueue transferQueue() { return transferQueue_; }
+
+        // shared by every pipeline, loaded from PIPELINE_CACHE_PATH and written back on destruction
+        VkPipelineCache pipelineCache() { return pipelineCache_; }
+        bool savePipelineCache();
+
+        // guards submissions to queues that may be shared between the render loop and uploads
+        std::mutex& getQueueMutex() { return queueMutex; }
 
         VkInstance getInstance() { return instance; }
         VkPhysicalDevice getPhysicalDevice() { return physicalDevice; }
-        uint32_t getGraphicsQueueFamily() { return findPhysicalQueueFamilies().graphicsFamily; }
+        const DeviceFeatures& getFeatures() const { return features; }
+        uint32_t getGraphicsQueueFamily() { return graphicsFamily_; }
+        uint32_t getTransferQueueFamily() { return transferFamily_; }
 
         SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
         uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
@@ -56,12 +84,14 @@ namespace m {
             const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
         // Buffer Helper Functions
+        // Staging is only for buffers freed once their copy is done, it goes to the linear pools
         void createBuffer(
             VkDeviceSize size,
             VkBufferUsageFlags usage,
             VkMemoryPropertyFlags properties,
             VkBuffer& buffer,
-            VkDeviceMemory& bufferMemory);
+            MAllocation& bufferMemory,
+            MAllocationKind kind = MAllocationKind::Buffer);
         VkCommandBuffer beginSingleTimeCommands();
         void endSingleTimeCommands(VkCommandBuffer commandBuffer);
         void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
@@ -72,10 +102,16 @@ namespace m {
             const VkImageCreateInfo& imageInfo,
             VkMemoryPropertyFlags properties,
             VkImage& image,
-            VkDeviceMemory& imageMemory);
+            MAllocation& imageMemory);
+
+        void freeMemory(MAllocation& allocation) { allocator->free(allocation); }
+        MMemoryAllocator& getAllocator() { return *allocator; }
+        MUploadManager& getUploadManager() { return *uploadManager; }
 
         VkPhysicalDeviceProperties properties;
 
+        static constexpr const char* PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
     private:
         void createInstance();
         void setupDebugMessenger();
@@ -83,6 +119,8 @@ namespace m {
         void pickPhysicalDevice();
         void createLogicalDevice();
         void createCommandPool();
+        void createAllocator();
+        void createPipelineCache();
 
         // helper functions
         bool isDeviceSuitable(VkPhysicalDevice device);
@@ -99,14 +137,23 @@ namespace m {
         VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
         MWindow& window;
         VkCommandPool commandPool;
+        std::unique_ptr<MMemoryAllocator> allocator;
+        std::unique_ptr<MUploadManager> uploadManager;
 
         VkDevice device_;
-        VkSurfaceKHR surface_;
+        VkSurfaceKHR surface_ = VK_NULL_HANDLE;
         VkQueue graphicsQueue_;
         VkQueue presentQueue_;
+        VkQueue transferQueue_;
+        VkPipelineCache pipelineCache_ = VK_NULL_HANDLE;
+        uint32_t graphicsFamily_;
+        uint32_t transferFamily_;
+        std::mutex queueMutex;
+        DeviceFeatures features{};
 
         const std::vector<const char*> validationLayers = { "VK_LAYER_KHRONOS_validation" };
-        const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+        // cleared when headless, nothing is presented
+        std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
     };
 
 }
\ No newline at end of file
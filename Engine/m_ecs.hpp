@@ -0,0 +1,240 @@
+#pragma once
+
+// std
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace m {
+
+    // Handle to an entity in an MRegistry. The generation changes whenever the index is reused,
+    // so a handle to a destroyed entity never aliases a newer one.
+    struct MEntity {
+        static constexpr uint32_t NULL_INDEX = std::numeric_limits<uint32_t>::max();
+
+        uint32_t index = NULL_INDEX;
+        uint32_t generation = 0;
+
+        bool isNull() const { return index == NULL_INDEX; }
+        bool operator==(const MEntity& other) const {
+            return index == other.index && generation == other.generation;
+        }
+        bool operator!=(const MEntity& other) const { return !(*this == other); }
+    };
+
+    class MComponentPoolBase {
+    public:
+        virtual ~MComponentPoolBase() = default;
+
+        virtual bool contains(uint32_t entityIndex) const = 0;
+        virtual void remove(uint32_t entityIndex) = 0;
+        virtual size_t size() const = 0;
+    };
+
+    // Sparse set: components of one type packed in a dense array, with a sparse array mapping the
+    // entity index to its slot. Removal swaps the last component into the hole, so the dense array
+    // never has gaps but its order is not stable.
+    template <typename T>
+    class MComponentPool : public MComponentPoolBase {
+    public:
+        static constexpr uint32_t EMPTY_SLOT = std::numeric_limits<uint32_t>::max();
+
+        bool contains(uint32_t entityIndex) const override {
+            return entityIndex < sparse.size() && sparse[entityIndex] != EMPTY_SLOT;
+        }
+
+        size_t size() const override { return components.size(); }
+
+        template <typename... Args>
+        T& emplace(MEntity entity, Args&&... args) {
+            assert(!contains(entity.index) && "Entity already has this component");
+            if (entity.index >= sparse.size()) {
+                sparse.resize(entity.index + 1, EMPTY_SLOT);
+            }
+            sparse[entity.index] = static_cast<uint32_t>(components.size());
+            entities.push_back(entity);
+            components.push_back(T{ std::forward<Args>(args)... });
+            return components.back();
+        }
+
+        void remove(uint32_t entityIndex) override {
+            if (!contains(entityIndex)) return;
+
+            uint32_t slot = sparse[entityIndex];
+            uint32_t last = static_cast<uint32_t>(components.size() - 1);
+            if (slot != last) {
+                components[slot] = std::move(components[last]);
+                entities[slot] = entities[last];
+                sparse[entities[slot].index] = slot;
+            }
+            components.pop_back();
+            entities.pop_back();
+            sparse[entityIndex] = EMPTY_SLOT;
+        }
+
+        T& get(uint32_t entityIndex) {
+            assert(contains(entityIndex) && "Entity does not have this component");
+            return components[sparse[entityIndex]];
+        }
+
+        T* tryGet(uint32_t entityIndex) {
+            return contains(entityIndex) ? &components[sparse[entityIndex]] : nullptr;
+        }
+
+        // dense arrays, entities()[i] owns components()[i]
+        std::vector<T>& data() { return components; }
+        const std::vector<MEntity>& owners() const { return entities; }
+
+    private:
+        std::vector<uint32_t> sparse;
+        std::vector<MEntity> entities;
+        std::vector<T> components;
+    };
+
+    class MRegistry {
+    public:
+        // Iterates every entity that has all of Ts. Walks the smallest of the pools densely and
+        // looks the others up through their sparse arrays. Components must not be added to or
+        // removed from these pools while iterating.
+        template <typename... Ts>
+        class View {
+        public:
+            explicit View(MRegistry& registry) : pools{ &registry.pool<Ts>()... } {}
+
+            template <typename F>
+            void each(F&& function) {
+                std::apply(
+                    [&](auto*... pool) {
+                        const std::vector<MEntity>* candidates = nullptr;
+                        ((candidates = candidates == nullptr || pool->size() < candidates->size()
+                            ? &pool->owners() : candidates), ...);
+
+                        for (size_t i = 0; i < candidates->size(); i++) {
+                            MEntity entity = (*candidates)[i];
+                            if ((pool->contains(entity.index) && ...)) {
+                                function(entity, pool->get(entity.index)...);
+                            }
+                        }
+                    },
+                    pools);
+            }
+
+        private:
+            std::tuple<MComponentPool<Ts>*...> pools;
+        };
+
+        MRegistry() = default;
+
+        MRegistry(const MRegistry&) = delete;
+        MRegistry& operator=(const MRegistry&) = delete;
+
+        MEntity create() {
+            MEntity entity{};
+            if (!freeIndices.empty()) {
+                entity.index = freeIndices.back();
+                freeIndices.pop_back();
+            }
+            else {
+                entity.index = static_cast<uint32_t>(generations.size());
+                generations.push_back(0);
+            }
+            entity.generation = generations[entity.index];
+            aliveCount++;
+            return entity;
+        }
+
+        void destroy(MEntity entity) {
+            if (!valid(entity)) return;
+
+            for (auto& pool : pools) {
+                if (pool != nullptr) {
+                    pool->remove(entity.index);
+                }
+            }
+            generations[entity.index]++;
+            freeIndices.push_back(entity.index);
+            aliveCount--;
+        }
+
+        bool valid(MEntity entity) const {
+            return entity.index < generations.size() &&
+                generations[entity.index] == entity.generation;
+        }
+
+        size_t size() const { return aliveCount; }
+
+        template <typename T, typename... Args>
+        T& add(MEntity entity, Args&&... args) {
+            assert(valid(entity) && "Adding a component to a destroyed entity");
+            return pool<T>().emplace(entity, std::forward<Args>(args)...);
+        }
+
+        template <typename T>
+        void remove(MEntity entity) {
+            assert(valid(entity) && "Removing a component from a destroyed entity");
+            pool<T>().remove(entity.index);
+        }
+
+        template <typename T>
+        bool has(MEntity entity) const {
+            auto* typed = findPool<T>();
+            return valid(entity) && typed != nullptr && typed->contains(entity.index);
+        }
+
+        template <typename T>
+        T& get(MEntity entity) {
+            assert(valid(entity) && "Getting a component of a destroyed entity");
+            return pool<T>().get(entity.index);
+        }
+
+        template <typename T>
+        T* tryGet(MEntity entity) {
+            return valid(entity) ? pool<T>().tryGet(entity.index) : nullptr;
+        }
+
+        template <typename... Ts>
+        View<Ts...> view() {
+            return View<Ts...>{ *this };
+        }
+
+        template <typename T>
+        MComponentPool<T>& pool() {
+            size_t id = componentTypeId<T>();
+            if (id >= pools.size()) {
+                pools.resize(id + 1);
+            }
+            if (pools[id] == nullptr) {
+                pools[id] = std::make_unique<MComponentPool<T>>();
+            }
+            return static_cast<MComponentPool<T>&>(*pools[id]);
+        }
+
+    private:
+        static size_t nextComponentTypeId() {
+            static size_t nextId = 0;
+            return nextId++;
+        }
+
+        template <typename T>
+        static size_t componentTypeId() {
+            static const size_t id = nextComponentTypeId();
+            return id;
+        }
+
+        template <typename T>
+        const MComponentPool<T>* findPool() const {
+            size_t id = componentTypeId<T>();
+            return id < pools.size() ? static_cast<const MComponentPool<T>*>(pools[id].get()) : nullptr;
+        }
+
+        std::vector<uint32_t> generations;
+        std::vector<uint32_t> freeIndices;
+        size_t aliveCount = 0;
+        std::vector<std::unique_ptr<MComponentPoolBase>> pools;
+    };
+
+}
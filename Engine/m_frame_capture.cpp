@@ -0,0 +1,95 @@
+#include "m_frame_capture.hpp"
+
+#include "m_job_system.hpp"
+
+// std
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace m {
+
+    MFrameCapture::MFrameCapture(const std::string& outputDirectory)
+        : outputDirectory{ outputDirectory } {
+        std::error_code error;
+        std::filesystem::create_directories(outputDirectory, error);
+        if (error) {
+            throw std::runtime_error("failed to create output directory " + outputDirectory);
+        }
+    }
+
+    MFrameCapture::~MFrameCapture() { wait(); }
+
+    void MFrameCapture::capture(const MSwapChain::FrameImage& image) {
+        bool bgra = image.format == VK_FORMAT_B8G8R8A8_SRGB || image.format == VK_FORMAT_B8G8R8A8_UNORM;
+        if (!bgra && image.format != VK_FORMAT_R8G8B8A8_SRGB && image.format != VK_FORMAT_R8G8B8A8_UNORM) {
+            throw std::runtime_error("Unsupported format for frame capture!");
+        }
+
+        while (pendingWrites.size() >= MAX_PENDING_WRITES) {
+            waitOldest();
+        }
+
+        char filename[32];
+        std::snprintf(filename, sizeof(filename), "frame_%05llu.ppm",
+            static_cast<unsigned long long>(image.frameNumber));
+        std::string filepath = (std::filesystem::path{ outputDirectory } / filename).string();
+
+        std::vector<uint8_t> pixels(
+            image.pixels, image.pixels + size_t{ image.width } * image.height * 4);
+        uint32_t width = image.width;
+        uint32_t height = image.height;
+        pendingWrites.push_back(MJobSystem::shared().submit(
+            [filepath, pixels = std::move(pixels), width, height, bgra]() {
+                return writePpm(filepath, pixels.data(), width, height, bgra);
+            }));
+    }
+
+    int MFrameCapture::wait() {
+        while (!pendingWrites.empty()) {
+            waitOldest();
+        }
+        return failedWrites;
+    }
+
+    void MFrameCapture::waitOldest() {
+        if (!pendingWrites.front().get()) {
+            failedWrites++;
+        }
+        pendingWrites.pop_front();
+    }
+
+    bool MFrameCapture::writePpm(
+        const std::string& filepath,
+        const uint8_t* pixels,
+        uint32_t width,
+        uint32_t height,
+        bool bgra) {
+        // the bytes are already sRGB encoded, which is what ppm viewers expect
+        std::vector<uint8_t> rgb(size_t{ width } * height * 3);
+        size_t pixelCount = size_t{ width } * height;
+        for (size_t i = 0; i < pixelCount; i++) {
+            const uint8_t* source = pixels + i * 4;
+            uint8_t* target = rgb.data() + i * 3;
+            target[0] = bgra ? source[2] : source[0];
+            target[1] = source[1];
+            target[2] = bgra ? source[0] : source[2];
+        }
+
+        std::ofstream out{ filepath, std::ios::binary | std::ios::trunc };
+        if (!out.is_open()) {
+            std::cerr << "failed to open " << filepath << std::endl;
+            return false;
+        }
+        out << "P6\n" << width << " " << height << "\n255\n";
+        out.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+        if (!out.good()) {
+            std::cerr << "failed to write " << filepath << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "m_swap_chain.hpp"
+
+// std
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <string>
+#include <vector>
+
+namespace m {
+
+    // Writes frames read back from a headless swap chain to outputDirectory/frame_NNNNN.ppm.
+    // The pixels are copied out of the readback buffer on the render thread, the conversion and
+    // the file write happen on the shared job system.
+    class MFrameCapture {
+    public:
+        explicit MFrameCapture(const std::string& outputDirectory);
+        ~MFrameCapture();
+
+        MFrameCapture(const MFrameCapture&) = delete;
+        MFrameCapture& operator=(const MFrameCapture&) = delete;
+
+        void capture(const MSwapChain::FrameImage& image);
+        // blocks until every captured frame is on disk, returns the number of failed writes
+        int wait();
+
+        static bool writePpm(
+            const std::string& filepath,
+            const uint8_t* pixels,
+            uint32_t width,
+            uint32_t height,
+            bool bgra);
+
+    private:
+        // frames queued beyond this make capture block, so a slow disk can't eat all memory
+        static constexpr size_t MAX_PENDING_WRITES = 8;
+
+        void waitOldest();
+
+        std::string outputDirectory;
+        std::deque<std::future<bool>> pendingWrites;
+        int failedWrites = 0;
+    };
+
+}
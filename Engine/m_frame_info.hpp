@@ -7,10 +7,14 @@
 #include <vulkan/vulkan.h>
 
 namespace m {
-	#define MAX_LIGHTS 10
+	class MGpuProfiler;
+	class MRenderer;
 
+	#define MAX_LIGHTS 4096
+
+	// element of the light storage buffer, see LightClusterSystem
 	struct PointLight {
-		glm::vec4 position{};  // ignore w
+		glm::vec4 position{};  // w is the range the light is cut off at
 		glm::vec4 color{};     // w is intensity
 	};
 
@@ -19,15 +23,33 @@ namespace m {
 		glm::mat4 view{ 1.f };
 		glm::mat4 inverseView{ 1.f };
 		glm::vec4 ambientLightColor{ 1.f, 1.f, 1.f, .02f };  // w is intensity
-		PointLight pointLights[MAX_LIGHTS];
-		int numLights;
+		glm::vec4 clusterDepth{};  // near, far, slice scale, slice bias
+		glm::vec2 screenSize{};
+		int numLights = 0;
+	};
+	// filled in by the render systems while they record the frame
+	struct FrameStats {
+		uint32_t drawCalls = 0;  // draw commands recorded, an indirect draw counts once
+		uint32_t objectsDrawn = 0;
+		uint32_t objectsCulled = 0;
+		// handed to GPU culling, which decides how many of them are drawn. they are in neither
+		// objectsDrawn nor objectsCulled
+		uint32_t objectsSubmitted = 0;
 	};
+
 	struct FrameInfo {
 		int frameIndex;
 		float frameTime;
 		VkCommandBuffer commandBuffer;
 		MCamera& camera;
 		VkDescriptorSet globalDescriptorSet;
-		MGameObject::Map& gameObjects;
+		MRegistry& registry;
+		FrameStats stats{};
+		MGpuProfiler* profiler = nullptr;  // systems open their GPU scopes on it when set
+		// set while the swap chain pass only takes secondary command buffers. systems then record
+		// into buffers from its beginSecondaryCommandBuffer and execute them on commandBuffer
+		MRenderer* renderer = nullptr;
+		VkDescriptorSet bindlessDescriptorSet = VK_NULL_HANDLE;  // MBindlessTable's set, bound as set 1
+		VkExtent2D extent{};  // of the swap chain images being rendered
 	};
 }
\ No newline at end of file
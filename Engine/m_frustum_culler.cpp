@@ -0,0 +1,81 @@
+#include "m_frustum_culler.hpp"
+
+#include "m_job_system.hpp"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define MOCHA_CULL_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace m {
+
+    void MFrustumCuller::clear() {
+        centersX.clear();
+        centersY.clear();
+        centersZ.clear();
+        radii.clear();
+    }
+
+    void MFrustumCuller::addSphere(const glm::vec3& center, float radius) {
+        centersX.push_back(center.x);
+        centersY.push_back(center.y);
+        centersZ.push_back(center.z);
+        radii.push_back(radius);
+    }
+
+    void MFrustumCuller::cull(const MFrustum& frustum, std::vector<uint8_t>& visible) const {
+        visible.resize(size());
+        MJobSystem::shared().parallelFor(size(), GRAIN_SIZE, [&](size_t begin, size_t end) {
+            cullRange(frustum, begin, end, visible);
+        });
+    }
+
+    void MFrustumCuller::cullRange(
+        const MFrustum& frustum, size_t begin, size_t end, std::vector<uint8_t>& visible) const {
+        size_t i = begin;
+#ifdef MOCHA_CULL_SSE
+        __m128 planeX[MFrustum::Count];
+        __m128 planeY[MFrustum::Count];
+        __m128 planeZ[MFrustum::Count];
+        __m128 planeW[MFrustum::Count];
+        for (int p = 0; p < MFrustum::Count; p++) {
+            planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+            planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+            planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+            planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+        }
+
+        for (; i + 4 <= end; i += 4) {
+            __m128 x = _mm_loadu_ps(&centersX[i]);
+            __m128 y = _mm_loadu_ps(&centersY[i]);
+            __m128 z = _mm_loadu_ps(&centersZ[i]);
+            __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radii[i]));
+
+            // a sphere is outside once its distance to any plane is below -radius
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < MFrustum::Count; p++) {
+                __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(x, planeX[p]), _mm_mul_ps(y, planeY[p])),
+                    _mm_add_ps(_mm_mul_ps(z, planeZ[p]), planeW[p]));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+            }
+
+            int mask = _mm_movemask_ps(inside);
+            visible[i + 0] = static_cast<uint8_t>((mask >> 0) & 1);
+            visible[i + 1] = static_cast<uint8_t>((mask >> 1) & 1);
+            visible[i + 2] = static_cast<uint8_t>((mask >> 2) & 1);
+            visible[i + 3] = static_cast<uint8_t>((mask >> 3) & 1);
+        }
+#endif
+        cullScalar(frustum, i, end, visible);
+    }
+
+    void MFrustumCuller::cullScalar(
+        const MFrustum& frustum, size_t begin, size_t end, std::vector<uint8_t>& visible) const {
+        for (size_t i = begin; i < end; i++) {
+            visible[i] = frustum.intersectsSphere({ centersX[i], centersY[i], centersZ[i] }, radii[i])
+                ? 1 : 0;
+        }
+    }
+
+}
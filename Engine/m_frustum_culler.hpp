@@ -0,0 +1,40 @@
+#pragma once
+
+#include "m_camera.hpp"
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace m {
+
+    // Tests batches of world space bounding spheres against a frustum. The spheres are kept as
+    // separate x, y, z and radius arrays so four of them go through each plane test at once.
+    class MFrustumCuller {
+    public:
+        // spheres per job, a multiple of 4 so every job but the last fills whole SSE lanes
+        static constexpr size_t GRAIN_SIZE = 4096;
+
+        void clear();
+        void addSphere(const glm::vec3& center, float radius);
+        size_t size() const { return radii.size(); }
+
+        // visible[i] is set to 1 for every sphere added since clear() that touches the frustum
+        void cull(const MFrustum& frustum, std::vector<uint8_t>& visible) const;
+
+    private:
+        void cullRange(
+            const MFrustum& frustum, size_t begin, size_t end, std::vector<uint8_t>& visible) const;
+        void cullScalar(
+            const MFrustum& frustum, size_t begin, size_t end, std::vector<uint8_t>& visible) const;
+
+        std::vector<float> centersX;
+        std::vector<float> centersY;
+        std::vector<float> centersZ;
+        std::vector<float> radii;
+    };
+
+}
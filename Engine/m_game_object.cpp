@@ -1,70 +1,50 @@
 #include "m_game_object.hpp"
 
+#include "transform_system.hpp"
+
 namespace m {
 
-    glm::mat4 TransformComponent::mat4() {
-        const float c3 = glm::cos(rotation.z);
-        const float s3 = glm::sin(rotation.z);
-        const float c2 = glm::cos(rotation.x);
-        const float s2 = glm::sin(rotation.x);
-        const float c1 = glm::cos(rotation.y);
-        const float s1 = glm::sin(rotation.y);
-        return glm::mat4{
-            {
-                scale.x * (c1 * c3 + s1 * s2 * s3),
-                scale.x * (c2 * s3),
-                scale.x * (c1 * s2 * s3 - c3 * s1),
-                0.0f,
-            },
-            {
-                scale.y * (c3 * s1 * s2 - c1 * s3),
-                scale.y * (c2 * c3),
-                scale.y * (c1 * c3 * s2 + s1 * s3),
-                0.0f,
-            },
-            {
-                scale.z * (c2 * s1),
-                scale.z * (-s2),
-                scale.z * (c1 * c2),
-                0.0f,
-            },
-            {translation.x, translation.y, translation.z, 1.0f} };
+    const glm::mat4& TransformComponent::mat4() const {
+        if (dirty) {
+            storeMatrices(TransformSystem::rotationMatrix(rotation));
+        }
+        return worldMatrix;
+    }
+
+    const glm::mat3& TransformComponent::normalMatrix() const {
+        if (dirty) {
+            storeMatrices(TransformSystem::rotationMatrix(rotation));
+        }
+        return normal;
     }
 
-    glm::mat3 TransformComponent::normalMatrix() {
-        const float c3 = glm::cos(rotation.z);
-        const float s3 = glm::sin(rotation.z);
-        const float c2 = glm::cos(rotation.x);
-        const float s2 = glm::sin(rotation.x);
-        const float c1 = glm::cos(rotation.y);
-        const float s1 = glm::sin(rotation.y);
+    void TransformComponent::storeMatrices(const glm::mat3& rotationMatrix) const {
         const glm::vec3 invScale = 1.0f / scale;
+        for (int i = 0; i < 3; i++) {
+            worldMatrix[i] = glm::vec4(rotationMatrix[i] * scale[i], 0.0f);
+            normal[i] = rotationMatrix[i] * invScale[i];
+        }
+        worldMatrix[3] = glm::vec4(translation, 1.0f);
+        dirty = false;
+    }
+
+    MEntity MGameObject::createGameObject(MRegistry& registry) {
+        MEntity entity = registry.create();
+        registry.add<TransformComponent>(entity);
+        return entity;
+    }
 
-        return glm::mat3{
-            {
-                invScale.x * (c1 * c3 + s1 * s2 * s3),
-                invScale.x * (c2 * s3),
-                invScale.x * (c1 * s2 * s3 - c3 * s1),
-            },
-            {
-                invScale.y * (c3 * s1 * s2 - c1 * s3),
-                invScale.y * (c2 * c3),
-                invScale.y * (c1 * c3 * s2 + s1 * s3),
-            },
-            {
-                invScale.z * (c2 * s1),
-                invScale.z * (-s2),
-                invScale.z * (c1 * c2),
-            },
-        };
+    MEntity MGameObject::makeModel(MRegistry& registry, std::shared_ptr<MModel> model) {
+        MEntity entity = createGameObject(registry);
+        registry.add<ModelComponent>(entity, std::move(model));
+        return entity;
     }
 
-    MGameObject MGameObject::makePointLight(float intensity, float radius, glm::vec3 color) {
-        MGameObject gameObj = MGameObject::createGameObject();
-        gameObj.color = color;
-        gameObj.transform.scale.x = radius;
-        gameObj.pointLight = std::make_unique<PointLightComponent>();
-        gameObj.pointLight->lightIntensity = intensity;
-        return gameObj;
+    MEntity MGameObject::makePointLight(
+        MRegistry& registry, float intensity, float radius, glm::vec3 color) {
+        MEntity entity = createGameObject(registry);
+        registry.get<TransformComponent>(entity).setScale({ radius, 1.f, 1.f });
+        registry.add<PointLightComponent>(entity, intensity, color);
+        return entity;
     }
 }
\ No newline at end of file
@@ -1,60 +1,111 @@
 #pragma once
 
+#include "m_ecs.hpp"
 #include "m_model.hpp"
 
 //libs
 #include <glm/gtc/matrix_transform.hpp>
 
 // std
+#include <cassert>
+#include <cstdint>
 #include <memory>
-#include <unordered_map>
 
 namespace m {
 
-    struct TransformComponent {
-        glm::vec3 translation{};  // (position offset)
-        glm::vec3 scale{ 1.f, 1.f, 1.f };
-        glm::vec3 rotation;
+    // Translation, Tait-Bryan YXZ rotation and scale, with the world and normal matrices cached.
+    // The setters mark the transform dirty, TransformSystem recomputes every dirty transform in
+    // one batch per frame, and reading the matrices of a transform still dirty recomputes them
+    // there and then. That makes the reads not thread safe until the batch has run.
+    //
+    // For an entity with a parent in MSceneGraph, translation, rotation and scale are relative to
+    // the parent, and the matrices are the world ones once the graph has been updated.
+    class TransformComponent {
+    public:
+        const glm::vec3& getTranslation() const { return translation; }
+        const glm::vec3& getRotation() const { return rotation; }
+        const glm::vec3& getScale() const { return scale; }
 
-        glm::mat4 mat4();
+        void setTranslation(const glm::vec3& value) {
+            translation = value;
+            markDirty();
+        }
+        void setRotation(const glm::vec3& value) {
+            rotation = value;
+            markDirty();
+        }
+        void setScale(const glm::vec3& value) {
+            scale = value;
+            markDirty();
+        }
 
-        glm::mat3 normalMatrix();
-    };
+        // a static transform is set up once and never moved after, which debug builds assert
+        void setStatic(bool value) { staticTransform = value; }
+        bool isStatic() const { return staticTransform; }
+        bool isDirty() const { return dirty; }
 
-    struct PointLightComponent {
-        float lightIntensity = 1.0f;
-    };
+        const glm::mat4& mat4() const;
+        const glm::mat3& normalMatrix() const;
+        glm::vec3 getWorldPosition() const { return glm::vec3(mat4()[3]); }
 
-    class MGameObject {
-    public:
-        using id_t = unsigned int;
-        using Map = std::unordered_map<id_t, MGameObject>;
+    private:
+        friend class MSceneGraph;
+        friend class TransformSystem;
 
-        static MGameObject createGameObject() {
-            static id_t currentId = 0;
-            return MGameObject{ currentId++ };
+        void markDirty() {
+            assert(!staticTransform && "Static transforms must not be moved");
+            invalidate();
         }
 
-        static MGameObject makePointLight(
-            float intensity = 10.f, float radius = 0.1f, glm::vec3 color = glm::vec3(1.f));
+        void invalidate() {
+            dirty = true;
+            version++;
+        }
 
-        MGameObject(const MGameObject&) = delete;
-        MGameObject& operator=(const MGameObject&) = delete;
-        MGameObject(MGameObject&&) = default;
-        MGameObject& operator=(MGameObject&&) = default;
+        // scales rotationMatrix into the world and normal matrices and clears the dirty flag
+        void storeMatrices(const glm::mat3& rotationMatrix) const;
 
-        id_t getId() { return id; }
+        glm::vec3 translation{};  // (position offset)
+        glm::vec3 scale{ 1.f, 1.f, 1.f };
+        glm::vec3 rotation{};
 
-        glm::vec3 color{};
-        TransformComponent transform{};
+        mutable glm::mat4 worldMatrix{ 1.f };
+        mutable glm::mat3 normal{ 1.f };
+        mutable bool dirty = true;
+        bool staticTransform = false;
+        uint32_t version = 0;  // bumped on every change, lets the scene graph spot moved nodes
+    };
 
-        // Optional pointer components
+    struct ModelComponent {
         std::shared_ptr<MModel> model{};
-        std::unique_ptr<PointLightComponent> pointLight = nullptr;
+        uint32_t textureIndex = 0;  // into MBindlessTable, 0 is white
+        uint32_t lod = 0;  // drawn last frame, SimpleRenderSystem moves it with hysteresis
+    };
 
-    private:
-        MGameObject(id_t objId) : id{ objId } {}
+    // a model textured by MTextureStreamer, which points textureIndex at the texture's resident
+    // mips every frame and streams finer ones as the model grows on screen
+    struct StreamedTextureComponent {
+        uint32_t texture = 0;  // handle from MTextureStreamer::load
+    };
+
+    struct PointLightComponent {
+        float lightIntensity = 1.0f;
+        glm::vec3 color{ 1.f };
+    };
+
+    // Factories for the entity kinds the app spawns. The components themselves live in the
+    // registry, packed per type.
+    class MGameObject {
+    public:
+        // an entity with just a transform
+        static MEntity createGameObject(MRegistry& registry);
+
+        static MEntity makeModel(MRegistry& registry, std::shared_ptr<MModel> model);
 
-        id_t id;
+        static MEntity makePointLight(
+            MRegistry& registry,
+            float intensity = 10.f,
+            float radius = 0.1f,
+            glm::vec3 color = glm::vec3(1.f));
     };
 }
\ No newline at end of file
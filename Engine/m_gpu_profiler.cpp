@@ -0,0 +1,283 @@
+#include "m_gpu_profiler.hpp"
+
+#include "m_swap_chain.hpp"
+
+// libs
+#include <imgui.h>
+
+// std
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace m {
+
+    static constexpr VkQueryPipelineStatisticFlags STATISTICS_FLAGS =
+        VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+    static constexpr uint32_t STATISTICS_COUNT = 5;  // bits set above, results come in bit order
+
+    MGpuProfiler::Scope::Scope(MGpuProfiler* profiler, VkCommandBuffer commandBuffer, const char* name)
+        : profiler{ profiler }, commandBuffer{ commandBuffer }, record{ -1 } {
+        if (profiler != nullptr) {
+            record = profiler->beginScope(commandBuffer, name);
+        }
+    }
+
+    MGpuProfiler::Scope::~Scope() {
+        if (profiler != nullptr) {
+            profiler->endScope(commandBuffer, record);
+        }
+    }
+
+    MGpuProfiler::MGpuProfiler(MDevice& device) : mDevice{ device } {
+        frames.resize(MSwapChain::MAX_FRAMES_IN_FLIGHT);
+        createQueryPools();
+    }
+
+    MGpuProfiler::~MGpuProfiler() {
+        vkDestroyQueryPool(mDevice.device(), timestampPool, nullptr);
+        vkDestroyQueryPool(mDevice.device(), statisticsPool, nullptr);
+    }
+
+    void MGpuProfiler::createQueryPools() {
+        uint32_t validBits = mDevice.getFeatures().timestampValidBits;
+        if (validBits == 0) {
+            return;
+        }
+        timestampsSupported = true;
+        timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+        timestampPeriodNs = mDevice.properties.limits.timestampPeriod;
+
+        VkQueryPoolCreateInfo timestampInfo{};
+        timestampInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        timestampInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        timestampInfo.queryCount = MSwapChain::MAX_FRAMES_IN_FLIGHT * MAX_SCOPES * 2;
+        if (vkCreateQueryPool(mDevice.device(), &timestampInfo, nullptr, &timestampPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+
+        if (mDevice.getFeatures().pipelineStatisticsQuery) {
+            VkQueryPoolCreateInfo statisticsInfo{};
+            statisticsInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            statisticsInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+            statisticsInfo.queryCount = MSwapChain::MAX_FRAMES_IN_FLIGHT * MAX_SCOPES;
+            statisticsInfo.pipelineStatistics = STATISTICS_FLAGS;
+            if (vkCreateQueryPool(mDevice.device(), &statisticsInfo, nullptr, &statisticsPool) !=
+                VK_SUCCESS) {
+                throw std::runtime_error("failed to create pipeline statistics query pool!");
+            }
+        }
+    }
+
+    void MGpuProfiler::beginFrame(VkCommandBuffer commandBuffer, int frameIndex) {
+        if (!timestampsSupported) {
+            return;
+        }
+
+        resolve(frameIndex);
+
+        currentFrame = frameIndex;
+        frames[frameIndex].scopes.clear();
+        frames[frameIndex].pending = true;
+        openScopes = 0;
+        statisticsOpen = false;
+
+        vkCmdResetQueryPool(
+            commandBuffer, timestampPool, timestampQuery(frameIndex, 0, false), MAX_SCOPES * 2);
+        if (statisticsPool != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(
+                commandBuffer, statisticsPool, static_cast<uint32_t>(frameIndex) * MAX_SCOPES, MAX_SCOPES);
+        }
+    }
+
+    int32_t MGpuProfiler::beginScope(VkCommandBuffer commandBuffer, const char* name) {
+        if (!timestampsSupported || currentFrame < 0) {
+            return -1;
+        }
+        FrameQueries& frame = frames[currentFrame];
+        if (frame.scopes.size() >= MAX_SCOPES) {
+            return -1;
+        }
+
+        int32_t record = static_cast<int32_t>(frame.scopes.size());
+        ScopeRecord scope{ name, openScopes, -1 };
+
+        // statistics queries can't nest, so only the outermost scope gets one
+        if (statisticsPool != VK_NULL_HANDLE && !statisticsOpen) {
+            scope.statisticsQuery = currentFrame * static_cast<int32_t>(MAX_SCOPES) + record;
+            vkCmdBeginQuery(commandBuffer, statisticsPool, static_cast<uint32_t>(scope.statisticsQuery), 0);
+            statisticsOpen = true;
+        }
+
+        vkCmdWriteTimestamp(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            timestampPool,
+            timestampQuery(currentFrame, record, false));
+
+        frame.scopes.push_back(scope);
+        openScopes++;
+        return record;
+    }
+
+    void MGpuProfiler::endScope(VkCommandBuffer commandBuffer, int32_t record) {
+        if (record < 0) {
+            return;
+        }
+
+        const ScopeRecord& scope = frames[currentFrame].scopes[record];
+        vkCmdWriteTimestamp(
+            commandBuffer,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            timestampPool,
+            timestampQuery(currentFrame, record, true));
+        if (scope.statisticsQuery >= 0) {
+            vkCmdEndQuery(commandBuffer, statisticsPool, static_cast<uint32_t>(scope.statisticsQuery));
+            statisticsOpen = false;
+        }
+        openScopes--;
+    }
+
+    void MGpuProfiler::resolve(int frameIndex) {
+        FrameQueries& frame = frames[frameIndex];
+        if (!frame.pending || frame.scopes.empty()) {
+            return;
+        }
+        frame.pending = false;
+
+        std::vector<uint64_t> timestamps(frame.scopes.size() * 2);
+        if (vkGetQueryPoolResults(
+            mDevice.device(),
+            timestampPool,
+            timestampQuery(frameIndex, 0, false),
+            static_cast<uint32_t>(timestamps.size()),
+            timestamps.size() * sizeof(uint64_t),
+            timestamps.data(),
+            sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+            return;
+        }
+
+        for (size_t i = 0; i < frame.scopes.size(); i++) {
+            const ScopeRecord& scope = frame.scopes[i];
+
+            auto found = scopeLookup.find(scope.name);
+            if (found == scopeLookup.end()) {
+                found = scopeLookup.emplace(scope.name, scopeStats.size()).first;
+                scopeStats.push_back({});
+                scopeStats.back().name = scope.name;
+                histories.emplace_back();
+            }
+            ScopeStats& stats = scopeStats[found->second];
+            ScopeHistory& history = histories[found->second];
+
+            uint64_t ticks =
+                ((timestamps[i * 2 + 1] & timestampMask) - (timestamps[i * 2] & timestampMask)) & timestampMask;
+            double ms = ticks * timestampPeriodNs * 1e-6;
+            history.samples.push_back(ms);
+            history.sum += ms;
+            if (history.samples.size() > HISTORY_LENGTH) {
+                history.sum -= history.samples.front();
+                history.samples.pop_front();
+            }
+
+            stats.depth = scope.depth;
+            stats.lastMs = ms;
+            stats.averageMs = history.sum / history.samples.size();
+            stats.maxMs = *std::max_element(history.samples.begin(), history.samples.end());
+
+            if (scope.statisticsQuery >= 0) {
+                uint64_t counters[STATISTICS_COUNT];
+                if (vkGetQueryPoolResults(
+                    mDevice.device(),
+                    statisticsPool,
+                    static_cast<uint32_t>(scope.statisticsQuery),
+                    1,
+                    sizeof(counters),
+                    counters,
+                    sizeof(counters),
+                    VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+                    stats.hasStatistics = true;
+                    stats.statistics.inputAssemblyPrimitives = counters[0];
+                    stats.statistics.vertexShaderInvocations = counters[1];
+                    stats.statistics.clippingPrimitives = counters[2];
+                    stats.statistics.fragmentShaderInvocations = counters[3];
+                    stats.statistics.computeShaderInvocations = counters[4];
+                }
+            }
+        }
+    }
+
+    void MGpuProfiler::drawImGui() {
+        ImGui::Begin("GPU Profiler");
+        if (!timestampsSupported) {
+            ImGui::Text("timestamps are not supported on the graphics queue");
+            ImGui::End();
+            return;
+        }
+
+        ImGui::Text("average and max over the last %d frames", static_cast<int>(HISTORY_LENGTH));
+        ImGui::Columns(5, "gpu scopes");
+        ImGui::Text("scope");
+        ImGui::NextColumn();
+        ImGui::Text("avg ms");
+        ImGui::NextColumn();
+        ImGui::Text("max ms");
+        ImGui::NextColumn();
+        ImGui::Text("vertices");
+        ImGui::NextColumn();
+        ImGui::Text("fragments");
+        ImGui::NextColumn();
+        ImGui::Separator();
+        for (const auto& stats : scopeStats) {
+            ImGui::Text("%*s%s", static_cast<int>(stats.depth * 2), "", stats.name.c_str());
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", stats.averageMs);
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", stats.maxMs);
+            ImGui::NextColumn();
+            if (stats.hasStatistics) {
+                ImGui::Text("%llu", static_cast<unsigned long long>(stats.statistics.vertexShaderInvocations));
+            }
+            ImGui::NextColumn();
+            if (stats.hasStatistics) {
+                ImGui::Text("%llu", static_cast<unsigned long long>(stats.statistics.fragmentShaderInvocations));
+            }
+            ImGui::NextColumn();
+        }
+        ImGui::Columns(1);
+        ImGui::End();
+    }
+
+    bool MGpuProfiler::writeJson(const std::string& filepath) const {
+        std::ofstream out{ filepath, std::ios::trunc };
+        if (!out.is_open()) {
+            return false;
+        }
+
+        out << "{\n  \"historyFrames\": " << HISTORY_LENGTH << ",\n  \"scopes\": [";
+        for (size_t i = 0; i < scopeStats.size(); i++) {
+            const ScopeStats& stats = scopeStats[i];
+            out << (i == 0 ? "\n" : ",\n");
+            out << "    { \"name\": \"" << stats.name << "\", \"depth\": " << stats.depth
+                << ", \"lastMs\": " << stats.lastMs << ", \"averageMs\": " << stats.averageMs
+                << ", \"maxMs\": " << stats.maxMs;
+            if (stats.hasStatistics) {
+                const PipelineStatistics& s = stats.statistics;
+                out << ", \"statistics\": { \"inputAssemblyPrimitives\": " << s.inputAssemblyPrimitives
+                    << ", \"vertexShaderInvocations\": " << s.vertexShaderInvocations
+                    << ", \"clippingPrimitives\": " << s.clippingPrimitives
+                    << ", \"fragmentShaderInvocations\": " << s.fragmentShaderInvocations
+                    << ", \"computeShaderInvocations\": " << s.computeShaderInvocations << " }";
+            }
+            out << " }";
+        }
+        out << "\n  ]\n}\n";
+        return out.good();
+    }
+
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "m_device.hpp"
+
+// std
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace m {
+
+    // Times named scopes of a frame's command buffer with timestamp queries, and counts what
+    // they did with pipeline statistics queries where the device supports them. Every frame in
+    // flight has its own queries, which are read back when that frame slot comes around again,
+    // so results are MAX_FRAMES_IN_FLIGHT frames old but reading them never waits on the GPU.
+    class MGpuProfiler {
+    public:
+        static constexpr uint32_t MAX_SCOPES = 64;  // per frame, further scopes are ignored
+        static constexpr size_t HISTORY_LENGTH = 120;  // frames averaged in the stats
+
+        struct PipelineStatistics {
+            uint64_t inputAssemblyPrimitives = 0;
+            uint64_t vertexShaderInvocations = 0;
+            uint64_t clippingPrimitives = 0;
+            uint64_t fragmentShaderInvocations = 0;
+            uint64_t computeShaderInvocations = 0;
+        };
+
+        struct ScopeStats {
+            std::string name;
+            uint32_t depth = 0;
+            double lastMs = 0.0;
+            double averageMs = 0.0;
+            double maxMs = 0.0;
+            bool hasStatistics = false;  // only outermost scopes get pipeline statistics
+            PipelineStatistics statistics{};  // of the last resolved frame
+        };
+
+        // Opens a scope on construction and closes it on destruction. A null profiler makes it
+        // a no-op, so systems can open scopes whether or not profiling is on.
+        class Scope {
+        public:
+            Scope(MGpuProfiler* profiler, VkCommandBuffer commandBuffer, const char* name);
+            ~Scope();
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+        private:
+            MGpuProfiler* profiler;
+            VkCommandBuffer commandBuffer;
+            int32_t record;
+        };
+
+        explicit MGpuProfiler(MDevice& device);
+        ~MGpuProfiler();
+
+        MGpuProfiler(const MGpuProfiler&) = delete;
+        MGpuProfiler& operator=(const MGpuProfiler&) = delete;
+
+        bool isSupported() const { return timestampsSupported; }
+
+        // call once the frame's fence has been waited on and before any scope is opened, outside
+        // a render pass. collects the results this frame slot recorded last time
+        void beginFrame(VkCommandBuffer commandBuffer, int frameIndex);
+
+        // scopes in the order they were first seen
+        const std::vector<ScopeStats>& getScopeStats() const { return scopeStats; }
+
+        void drawImGui();
+        bool writeJson(const std::string& filepath) const;
+
+    private:
+        struct ScopeRecord {
+            const char* name;
+            uint32_t depth;
+            int32_t statisticsQuery;  // -1 without one
+        };
+
+        struct FrameQueries {
+            std::vector<ScopeRecord> scopes;
+            bool pending = false;
+        };
+
+        struct ScopeHistory {
+            std::deque<double> samples;
+            double sum = 0.0;
+        };
+
+        void createQueryPools();
+        void resolve(int frameIndex);
+        int32_t beginScope(VkCommandBuffer commandBuffer, const char* name);
+        void endScope(VkCommandBuffer commandBuffer, int32_t record);
+        uint32_t timestampQuery(int frameIndex, int32_t record, bool end) const {
+            return static_cast<uint32_t>(frameIndex) * MAX_SCOPES * 2 + static_cast<uint32_t>(record) * 2 +
+                (end ? 1 : 0);
+        }
+
+        MDevice& mDevice;
+        VkQueryPool timestampPool = VK_NULL_HANDLE;
+        VkQueryPool statisticsPool = VK_NULL_HANDLE;
+        bool timestampsSupported = false;
+        uint64_t timestampMask = ~0ull;
+        double timestampPeriodNs = 1.0;
+
+        std::vector<FrameQueries> frames;
+        int currentFrame = -1;
+        uint32_t openScopes = 0;
+        bool statisticsOpen = false;
+
+        std::vector<ScopeStats> scopeStats;
+        std::vector<ScopeHistory> histories;
+        std::unordered_map<std::string, size_t> scopeLookup;
+    };
+
+}
@@ -64,8 +64,7 @@ namespace m {
         init_info.QueueFamily = device.getGraphicsQueueFamily();
         init_info.Queue = device.graphicsQueue();
 
-        // pipeline cache is a potential future optimization, ignoring for now
-        init_info.PipelineCache = VK_NULL_HANDLE;
+        init_info.PipelineCache = device.pipelineCache();
         init_info.DescriptorPool = descriptorPool;
         // todo, I should probably get around to integrating a memory allocator library such as Vulkan
         // memory allocator (VMA) sooner than later. We don't want to have to update adding an allocator
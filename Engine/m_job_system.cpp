@@ -0,0 +1,302 @@
+#include "m_job_system.hpp"
+
+#include "m_trace.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <string>
+
+namespace m {
+
+    // which system and worker the calling thread belongs to, if any
+    static thread_local const MJobSystem* currentSystem = nullptr;
+    static thread_local uint32_t currentThreadIndex = 0;
+
+    MJobSystem::MJobSystem(unsigned int workerCount) {
+        workers.reserve(workerCount);
+        for (unsigned int i = 0; i < workerCount; i++) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        // every deque exists before the first worker starts stealing from them
+        for (unsigned int i = 0; i < workerCount; i++) {
+            workers[i]->thread = std::thread([this, i]() {
+                MTrace::setThreadName("Worker " + std::to_string(i));
+                workerLoop(i + 1);
+            });
+        }
+    }
+
+    MJobSystem::~MJobSystem() {
+        {
+            std::lock_guard<std::mutex> lock{ sleepMutex };
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker->thread.join();
+        }
+    }
+
+    MJobSystem& MJobSystem::shared() {
+        static MJobSystem system{};
+        return system;
+    }
+
+    unsigned int MJobSystem::defaultWorkerCount() {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    uint32_t MJobSystem::threadIndex() {
+        return currentThreadIndex;
+    }
+
+    void MJobSystem::schedule(std::function<void()> function, Counter* counter) {
+        if (counter != nullptr) {
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+        }
+        Job job{ std::move(function), counter };
+
+        if (workers.empty()) {
+            execute(job);
+            return;
+        }
+
+        if (currentSystem == this) {
+            Worker& worker = *workers[currentThreadIndex - 1];
+            std::lock_guard<std::mutex> lock{ worker.mutex };
+            worker.jobs.push_back(std::move(job));
+        }
+        else {
+            std::lock_guard<std::mutex> lock{ injectedMutex };
+            injected.push_back(std::move(job));
+        }
+        queuedCount.fetch_add(1, std::memory_order_release);
+
+        // taking the lock orders this against a worker that just found nothing and is about to sleep
+        { std::lock_guard<std::mutex> lock{ sleepMutex }; }
+        wake.notify_one();
+    }
+
+    void MJobSystem::wait(Counter& counter) {
+        while (!counter.isDone()) {
+            if (tryRunJob()) {
+                continue;
+            }
+            // the jobs left are running on other threads
+            std::unique_lock<std::mutex> lock{ counter.mutex };
+            counter.done.wait_for(lock, std::chrono::microseconds(100), [&]() { return counter.isDone(); });
+        }
+
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock{ counter.mutex };
+            std::swap(error, counter.error);
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    void MJobSystem::parallelFor(
+        size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& function) {
+        if (count == 0) {
+            return;
+        }
+        grainSize = std::max<size_t>(grainSize, 1);
+        size_t rangeCount = (count + grainSize - 1) / grainSize;
+        if (rangeCount == 1 || workers.empty()) {
+            function(0, count);
+            return;
+        }
+
+        Counter counter;
+        for (size_t range = 1; range < rangeCount; range++) {
+            size_t begin = range * grainSize;
+            size_t end = std::min(begin + grainSize, count);
+            schedule([&function, begin, end]() { function(begin, end); }, &counter);
+        }
+
+        // the first range runs here, the ranges above still have to finish before this returns
+        // because they point at function
+        std::exception_ptr error{};
+        try {
+            function(0, std::min(grainSize, count));
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        try {
+            wait(counter);
+        }
+        catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    bool MJobSystem::tryRunJob() {
+        Job job;
+        if (!popJob(job)) {
+            return false;
+        }
+        execute(job);
+        return true;
+    }
+
+    bool MJobSystem::popJob(Job& job) {
+        if (queuedCount.load(std::memory_order_acquire) == 0) {
+            return false;
+        }
+
+        bool found = false;
+        uint32_t self = currentSystem == this ? currentThreadIndex : 0;
+        if (self > 0) {
+            Worker& worker = *workers[self - 1];
+            std::lock_guard<std::mutex> lock{ worker.mutex };
+            if (!worker.jobs.empty()) {
+                job = std::move(worker.jobs.back());
+                worker.jobs.pop_back();
+                found = true;
+            }
+        }
+
+        if (!found) {
+            std::lock_guard<std::mutex> lock{ injectedMutex };
+            if (!injected.empty()) {
+                job = std::move(injected.front());
+                injected.pop_front();
+                found = true;
+            }
+        }
+
+        // steal the oldest job of the next worker over that has one
+        for (size_t i = 1; !found && i <= workers.size(); i++) {
+            Worker& victim = *workers[(self + i - 1) % workers.size()];
+            std::lock_guard<std::mutex> lock{ victim.mutex };
+            if (!victim.jobs.empty()) {
+                job = std::move(victim.jobs.front());
+                victim.jobs.pop_front();
+                found = true;
+            }
+        }
+
+        if (found) {
+            queuedCount.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return found;
+    }
+
+    void MJobSystem::execute(Job& job) {
+        Counter* counter = job.counter;
+        if (counter == nullptr) {
+            job.function();
+            return;
+        }
+
+        std::exception_ptr error{};
+        try {
+            job.function();
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+
+        // the waiter may destroy the counter as soon as pending reaches zero, so the decrement
+        // happens under the lock it takes before returning
+        std::lock_guard<std::mutex> lock{ counter->mutex };
+        if (error && !counter->error) {
+            counter->error = error;
+        }
+        if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            counter->done.notify_all();
+        }
+    }
+
+    void MJobSystem::workerLoop(uint32_t index) {
+        currentSystem = this;
+        currentThreadIndex = index;
+
+        while (true) {
+            if (tryRunJob()) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock{ sleepMutex };
+            wake.wait(lock, [this]() {
+                return stopping || queuedCount.load(std::memory_order_acquire) > 0;
+            });
+            if (stopping && queuedCount.load(std::memory_order_acquire) == 0) {
+                return;
+            }
+        }
+    }
+
+    MTaskGraph::TaskId MTaskGraph::add(
+        const char* name, std::function<void()> function, std::initializer_list<TaskId> dependencies) {
+        TaskId id = static_cast<TaskId>(tasks.size());
+        Task& task = tasks.emplace_back();
+        task.name = name;
+        task.function = std::move(function);
+        task.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        for (TaskId dependency : dependencies) {
+            assert(dependency < id && "Tasks can only depend on tasks added before them");
+            tasks[dependency].dependents.push_back(id);
+        }
+        return id;
+    }
+
+    void MTaskGraph::run(MJobSystem& jobSystem) {
+        if (tasks.empty()) {
+            return;
+        }
+
+        if (remainingCapacity < tasks.size()) {
+            remainingCapacity = tasks.size();
+            remainingDependencies = std::make_unique<std::atomic<uint32_t>[]>(remainingCapacity);
+        }
+        for (size_t i = 0; i < tasks.size(); i++) {
+            remainingDependencies[i].store(tasks[i].dependencyCount, std::memory_order_relaxed);
+        }
+
+        MJobSystem::Counter counter;
+        for (TaskId id = 0; id < tasks.size(); id++) {
+            if (tasks[id].dependencyCount == 0) {
+                launch(jobSystem, counter, id);
+            }
+        }
+        jobSystem.wait(counter);
+    }
+
+    void MTaskGraph::clear() {
+        tasks.clear();
+    }
+
+    void MTaskGraph::launch(MJobSystem& jobSystem, MJobSystem::Counter& counter, TaskId id) {
+        jobSystem.schedule(
+            [this, &jobSystem, &counter, id]() {
+                const Task& task = tasks[id];
+                {
+#ifndef MOCHA_NO_TRACE
+                    MTraceZone zone{ task.name };
+#endif
+                    task.function();
+                }
+                // dependents are scheduled before this job counts as finished, so the counter
+                // can't reach zero while any of them is still to come
+                for (TaskId dependent : task.dependents) {
+                    if (remainingDependencies[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        launch(jobSystem, counter, dependent);
+                    }
+                }
+            },
+            &counter);
+    }
+
+}
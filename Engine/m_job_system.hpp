@@ -0,0 +1,153 @@
+#pragma once
+
+// std
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace m {
+
+    // Work stealing scheduler. Every worker has its own deque: jobs scheduled from a worker go on
+    // the back of its deque and it runs them newest first, while idle workers steal the oldest
+    // jobs from the front of the others'. Jobs scheduled from outside go into a shared queue.
+    //
+    // There are no fibers. A thread waiting on a counter runs other jobs until the counter is
+    // done, so jobs can wait on jobs they scheduled without tying up a worker.
+    class MJobSystem {
+    public:
+        // counts the jobs scheduled against it that haven't finished yet
+        class Counter {
+        public:
+            Counter() = default;
+            Counter(const Counter&) = delete;
+            Counter& operator=(const Counter&) = delete;
+
+            bool isDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+        private:
+            friend class MJobSystem;
+
+            std::atomic<size_t> pending{ 0 };
+            std::exception_ptr error{};
+            std::mutex mutex;
+            std::condition_variable done;
+        };
+
+        // one worker per hardware thread, minus the thread that schedules the work
+        explicit MJobSystem(unsigned int workerCount = defaultWorkerCount());
+        ~MJobSystem();
+
+        MJobSystem(const MJobSystem&) = delete;
+        MJobSystem& operator=(const MJobSystem&) = delete;
+
+        // system shared by the engine, created on first use
+        static MJobSystem& shared();
+        static unsigned int defaultWorkerCount();
+
+        unsigned int workerCount() const { return static_cast<unsigned int>(workers.size()); }
+
+        // 1 + the worker's index on a worker of any job system, 0 on every other thread. lets
+        // callers keep per thread state in workerCount() + 1 slots
+        static uint32_t threadIndex();
+
+        // an exception thrown by the job is kept on the counter and rethrown by wait. jobs
+        // scheduled without a counter must not throw
+        void schedule(std::function<void()> job, Counter* counter = nullptr);
+
+        // runs jobs until every job scheduled against counter has finished, then rethrows the
+        // first exception one of them threw
+        void wait(Counter& counter);
+
+        template <typename F>
+        std::future<std::invoke_result_t<F>> submit(F&& function) {
+            using Result = std::invoke_result_t<F>;
+            auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(function));
+            std::future<Result> result = task->get_future();
+            schedule([task]() { (*task)(); });
+            return result;
+        }
+
+        // splits [0, count) into ranges of at most grainSize and calls function(begin, end) for
+        // each of them. the calling thread runs ranges too and returns once all of them have
+        // finished, rethrowing the first exception one of them threw
+        void parallelFor(
+            size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& function);
+
+    private:
+        struct Job {
+            std::function<void()> function;
+            Counter* counter = nullptr;
+        };
+
+        struct Worker {
+            std::thread thread;
+            std::deque<Job> jobs;
+            std::mutex mutex;
+        };
+
+        bool tryRunJob();
+        bool popJob(Job& job);
+        void execute(Job& job);
+        void workerLoop(uint32_t index);
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::deque<Job> injected;  // jobs scheduled from threads outside the system
+        std::mutex injectedMutex;
+
+        std::atomic<size_t> queuedCount{ 0 };
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        bool stopping = false;
+    };
+
+    // Graph of tasks with dependencies, rebuilt and run once per frame. A task is scheduled as
+    // soon as the last task it depends on finishes, so independent stages of the frame overlap.
+    class MTaskGraph {
+    public:
+        using TaskId = uint32_t;
+
+        MTaskGraph() = default;
+        MTaskGraph(const MTaskGraph&) = delete;
+        MTaskGraph& operator=(const MTaskGraph&) = delete;
+
+        // dependencies must have been added before, which keeps the graph acyclic. name shows up
+        // as the task's trace zone and must outlive the graph
+        TaskId add(
+            const char* name, std::function<void()> function, std::initializer_list<TaskId> dependencies = {});
+
+        // runs every task, the calling thread joining in, and returns once all have finished.
+        // if a task throws, the tasks depending on it are skipped and the exception is rethrown
+        void run(MJobSystem& jobSystem = MJobSystem::shared());
+
+        // drops the tasks but keeps their storage for the next frame
+        void clear();
+
+        size_t size() const { return tasks.size(); }
+
+    private:
+        struct Task {
+            const char* name;
+            std::function<void()> function;
+            std::vector<TaskId> dependents;
+            uint32_t dependencyCount = 0;
+        };
+
+        void launch(MJobSystem& jobSystem, MJobSystem::Counter& counter, TaskId id);
+
+        std::vector<Task> tasks;
+        std::unique_ptr<std::atomic<uint32_t>[]> remainingDependencies;
+        size_t remainingCapacity = 0;
+    };
+
+}
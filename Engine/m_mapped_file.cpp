@@ -0,0 +1,97 @@
+#include "m_mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace m {
+
+#ifdef _WIN32
+
+	std::unique_ptr<MMappedFile> MMappedFile::open(const std::string& filepath) {
+		HANDLE file = CreateFileA(
+			filepath.c_str(),
+			GENERIC_READ,
+			FILE_SHARE_READ,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+			nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			return nullptr;
+		}
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+			CloseHandle(file);
+			return nullptr;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr) {
+			CloseHandle(file);
+			return nullptr;
+		}
+
+		const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (view == nullptr) {
+			CloseHandle(mapping);
+			CloseHandle(file);
+			return nullptr;
+		}
+
+		std::unique_ptr<MMappedFile> mapped{ new MMappedFile() };
+		mapped->data_ = view;
+		mapped->size_ = static_cast<size_t>(fileSize.QuadPart);
+		mapped->fileHandle = file;
+		mapped->mappingHandle = mapping;
+		return mapped;
+	}
+
+	MMappedFile::~MMappedFile() {
+		UnmapViewOfFile(data_);
+		CloseHandle(mappingHandle);
+		CloseHandle(fileHandle);
+	}
+
+#else
+
+	std::unique_ptr<MMappedFile> MMappedFile::open(const std::string& filepath) {
+		int fd = ::open(filepath.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return nullptr;
+		}
+
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			close(fd);
+			return nullptr;
+		}
+
+		void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		// the mapping keeps its own reference to the file
+		close(fd);
+		if (view == MAP_FAILED) {
+			return nullptr;
+		}
+
+		std::unique_ptr<MMappedFile> mapped{ new MMappedFile() };
+		mapped->data_ = view;
+		mapped->size_ = static_cast<size_t>(info.st_size);
+		return mapped;
+	}
+
+	MMappedFile::~MMappedFile() {
+		munmap(const_cast<void*>(data_), size_);
+	}
+
+#endif
+
+}
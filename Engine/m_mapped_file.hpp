@@ -0,0 +1,35 @@
+#pragma once
+
+// std
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace m {
+
+	// read only memory mapping of a whole file
+	class MMappedFile {
+	public:
+		// returns nullptr if the file doesn't exist or can't be mapped
+		static std::unique_ptr<MMappedFile> open(const std::string& filepath);
+
+		~MMappedFile();
+
+		MMappedFile(const MMappedFile&) = delete;
+		MMappedFile& operator=(const MMappedFile&) = delete;
+
+		const void* data() const { return data_; }
+		size_t size() const { return size_; }
+
+	private:
+		MMappedFile() = default;
+
+		const void* data_ = nullptr;
+		size_t size_ = 0;
+
+#ifdef _WIN32
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+#endif
+	};
+}
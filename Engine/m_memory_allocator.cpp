@@ -0,0 +1,359 @@
+#include "m_memory_allocator.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <stdexcept>
+
+namespace m {
+
+    // size of the blocks allocations are carved from, heaps of at most SMALL_HEAP_LIMIT use an
+    // eighth of the heap instead. a request over half a block gets a vkAllocateMemory of its own
+    static constexpr VkDeviceSize LARGE_HEAP_BLOCK_SIZE = 256ull * 1024 * 1024;
+    static constexpr VkDeviceSize SMALL_HEAP_LIMIT = 1024ull * 1024 * 1024;
+
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    static VkDeviceSize alignDown(VkDeviceSize value, VkDeviceSize alignment) {
+        return value & ~(alignment - 1);
+    }
+
+    MMemoryAllocator::MMemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice)
+        : device{ device } {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+
+        memoryTypes.resize(memoryProperties.memoryTypeCount);
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            VkDeviceSize heapSize =
+                memoryProperties.memoryHeaps[memoryProperties.memoryTypes[i].heapIndex].size;
+            memoryTypes[i].blockSize =
+                heapSize <= SMALL_HEAP_LIMIT ? heapSize / 8 : LARGE_HEAP_BLOCK_SIZE;
+        }
+    }
+
+    MMemoryAllocator::~MMemoryAllocator() {
+        for (auto& type : memoryTypes) {
+            for (auto& block : type.blocks) {
+                destroyBlock(*block);
+            }
+        }
+        for (auto& block : dedicatedBlocks) {
+            destroyBlock(*block);
+        }
+    }
+
+    MMemoryBlock* MMemoryAllocator::createBlock(
+        uint32_t memoryTypeIndex, VkDeviceSize size, MAllocationKind kind) {
+        auto block = std::make_unique<MMemoryBlock>();
+        block->size = size;
+        block->memoryTypeIndex = memoryTypeIndex;
+        block->kind = kind;
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS) {
+            return nullptr;
+        }
+
+        // host visible blocks stay mapped for their whole lifetime, a VkDeviceMemory can only be
+        // mapped once so the resources living in it share this mapping
+        if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags &
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            if (vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS) {
+                vkFreeMemory(device, block->memory, nullptr);
+                throw std::runtime_error("failed to map memory block!");
+            }
+        }
+
+        if (kind != MAllocationKind::Staging) {
+            block->freeRanges[0] = size;
+        }
+
+        MMemoryBlock* result = block.get();
+        memoryTypes[memoryTypeIndex].blocks.push_back(std::move(block));
+        return result;
+    }
+
+    void MMemoryAllocator::destroyBlock(MMemoryBlock& block) {
+        if (block.mapped) {
+            vkUnmapMemory(device, block.memory);
+            block.mapped = nullptr;
+        }
+        vkFreeMemory(device, block.memory, nullptr);
+        block.memory = VK_NULL_HANDLE;
+    }
+
+    bool MMemoryAllocator::allocateFromBlock(
+        MMemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) {
+        if (block.kind == MAllocationKind::Staging) {
+            if (block.allocationCount == 0) {
+                block.head = 0;
+            }
+            VkDeviceSize alignedOffset = alignUp(block.head, alignment);
+            if (alignedOffset + size > block.size) {
+                return false;
+            }
+            offset = alignedOffset;
+            block.head = alignedOffset + size;
+            return true;
+        }
+
+        // best fit, the range leaving the least space behind wins
+        auto best = block.freeRanges.end();
+        VkDeviceSize bestWaste = ~0ull;
+        for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it) {
+            VkDeviceSize alignedOffset = alignUp(it->first, alignment);
+            VkDeviceSize rangeEnd = it->first + it->second;
+            if (alignedOffset + size > rangeEnd) continue;
+
+            VkDeviceSize waste = it->second - size;
+            if (waste < bestWaste) {
+                best = it;
+                bestWaste = waste;
+                if (waste == 0) break;
+            }
+        }
+
+        if (best == block.freeRanges.end()) {
+            return false;
+        }
+
+        VkDeviceSize rangeOffset = best->first;
+        VkDeviceSize rangeEnd = best->first + best->second;
+        offset = alignUp(rangeOffset, alignment);
+        block.freeRanges.erase(best);
+
+        // hand the alignment padding and the tail back to the free list
+        if (offset > rangeOffset) {
+            block.freeRanges[rangeOffset] = offset - rangeOffset;
+        }
+        if (offset + size < rangeEnd) {
+            block.freeRanges[offset + size] = rangeEnd - (offset + size);
+        }
+        return true;
+    }
+
+    void MMemoryAllocator::releaseToBlock(MMemoryBlock& block, VkDeviceSize offset, VkDeviceSize size) {
+        if (block.kind == MAllocationKind::Staging) {
+            return;
+        }
+
+        auto inserted = block.freeRanges.emplace(offset, size).first;
+
+        auto next = std::next(inserted);
+        if (next != block.freeRanges.end() && inserted->first + inserted->second == next->first) {
+            inserted->second += next->second;
+            block.freeRanges.erase(next);
+        }
+
+        if (inserted != block.freeRanges.begin()) {
+            auto prev = std::prev(inserted);
+            if (prev->first + prev->second == inserted->first) {
+                prev->second += inserted->second;
+                block.freeRanges.erase(inserted);
+            }
+        }
+    }
+
+    MAllocation MMemoryAllocator::allocate(
+        const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, MAllocationKind kind) {
+        std::lock_guard<std::mutex> lock{ mutex };
+
+        VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+        bool nonCoherent = (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+            !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        // non coherent memory is flushed in whole atoms, so keep neighbours out of each others atoms
+        VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+        VkDeviceSize size = requirements.size;
+        if (nonCoherent) {
+            alignment = std::max(alignment, nonCoherentAtomSize);
+            size = alignUp(size, nonCoherentAtomSize);
+        }
+
+        MemoryType& type = memoryTypes[memoryTypeIndex];
+        MAllocation allocation{};
+        allocation.memoryTypeIndex = memoryTypeIndex;
+        allocation.size = size;
+
+        if (size > type.blockSize / 2) {
+            auto block = std::make_unique<MMemoryBlock>();
+            block->size = size;
+            block->memoryTypeIndex = memoryTypeIndex;
+            block->kind = kind;
+            block->dedicated = true;
+
+            VkMemoryAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.allocationSize = size;
+            allocInfo.memoryTypeIndex = memoryTypeIndex;
+            if (vkAllocateMemory(device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate dedicated memory!");
+            }
+            if (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+                if (vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS) {
+                    vkFreeMemory(device, block->memory, nullptr);
+                    throw std::runtime_error("failed to map dedicated memory!");
+                }
+            }
+            block->allocationCount = 1;
+            block->usedBytes = size;
+
+            allocation.memory = block->memory;
+            allocation.mapped = block->mapped;
+            allocation.block = block.get();
+            dedicatedBlocks.push_back(std::move(block));
+            return allocation;
+        }
+
+        MMemoryBlock* target = nullptr;
+        VkDeviceSize offset = 0;
+
+        // newest blocks first, older ones are the most likely to be full
+        for (auto it = type.blocks.rbegin(); it != type.blocks.rend(); ++it) {
+            MMemoryBlock& block = **it;
+            if (block.kind != kind) continue;
+            if (allocateFromBlock(block, size, alignment, offset)) {
+                target = &block;
+                break;
+            }
+        }
+
+        if (target == nullptr) {
+            target = createBlock(memoryTypeIndex, type.blockSize, kind);
+            if (target == nullptr || !allocateFromBlock(*target, size, alignment, offset)) {
+                throw std::runtime_error("failed to allocate memory block!");
+            }
+        }
+
+        target->allocationCount++;
+        target->usedBytes += size;
+
+        allocation.memory = target->memory;
+        allocation.offset = offset;
+        allocation.block = target;
+        if (target->mapped) {
+            allocation.mapped = static_cast<char*>(target->mapped) + offset;
+        }
+        return allocation;
+    }
+
+    void MMemoryAllocator::free(MAllocation& allocation) {
+        if (allocation.block == nullptr) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock{ mutex };
+        MMemoryBlock* block = allocation.block;
+
+        if (block->dedicated) {
+            auto it = std::find_if(
+                dedicatedBlocks.begin(),
+                dedicatedBlocks.end(),
+                [block](const std::unique_ptr<MMemoryBlock>& b) { return b.get() == block; });
+            assert(it != dedicatedBlocks.end() && "Freeing allocation from unknown block");
+            destroyBlock(*block);
+            dedicatedBlocks.erase(it);
+            allocation = {};
+            return;
+        }
+
+        releaseToBlock(*block, allocation.offset, allocation.size);
+        block->allocationCount--;
+        block->usedBytes -= allocation.size;
+
+        // keep one empty block of each kind around so a free/allocate pattern doesn't thrash
+        if (isBlockEmpty(*block)) {
+            auto& blocks = memoryTypes[block->memoryTypeIndex].blocks;
+            bool hasOtherEmpty = std::any_of(
+                blocks.begin(),
+                blocks.end(),
+                [this, block](const std::unique_ptr<MMemoryBlock>& b) {
+                    return b.get() != block && b->kind == block->kind && isBlockEmpty(*b);
+                });
+            if (hasOtherEmpty) {
+                auto it = std::find_if(
+                    blocks.begin(),
+                    blocks.end(),
+                    [block](const std::unique_ptr<MMemoryBlock>& b) { return b.get() == block; });
+                destroyBlock(*block);
+                blocks.erase(it);
+            }
+        }
+
+        allocation = {};
+    }
+
+    VkMappedMemoryRange MMemoryAllocator::mappedRange(
+        const MAllocation& allocation, VkDeviceSize size, VkDeviceSize offset) const {
+        if (size == VK_WHOLE_SIZE) {
+            size = allocation.size - offset;
+        }
+
+        VkDeviceSize begin = alignDown(allocation.offset + offset, nonCoherentAtomSize);
+        VkDeviceSize end = alignUp(allocation.offset + offset + size, nonCoherentAtomSize);
+        end = std::min(end, allocation.block->size);
+
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = allocation.memory;
+        range.offset = begin;
+        range.size = end - begin;
+        return range;
+    }
+
+    std::vector<MMemoryAllocator::HeapStats> MMemoryAllocator::getHeapStats() {
+        std::lock_guard<std::mutex> lock{ mutex };
+
+        std::vector<HeapStats> stats(memoryProperties.memoryHeapCount);
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+            stats[i].heapSize = memoryProperties.memoryHeaps[i].size;
+        }
+
+        auto accumulate = [&](const MMemoryBlock& block) {
+            auto& heap = stats[memoryProperties.memoryTypes[block.memoryTypeIndex].heapIndex];
+            heap.blockBytes += block.size;
+            heap.usedBytes += block.usedBytes;
+            heap.blockCount += 1;
+            heap.allocationCount += block.allocationCount;
+        };
+
+        for (auto& type : memoryTypes) {
+            for (auto& block : type.blocks) {
+                accumulate(*block);
+            }
+        }
+        for (auto& block : dedicatedBlocks) {
+            accumulate(*block);
+        }
+        return stats;
+    }
+
+    void MMemoryAllocator::printStats(std::ostream& out) {
+        auto stats = getHeapStats();
+        constexpr double MB = 1024.0 * 1024.0;
+
+        out << "GPU memory heaps:" << std::endl;
+        for (size_t i = 0; i < stats.size(); i++) {
+            const auto& heap = stats[i];
+            bool deviceLocal =
+                memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+            out << "  heap " << i << (deviceLocal ? " (device local)" : " (host)") << std::fixed
+                << std::setprecision(2) << ": " << heap.usedBytes / MB << " MB used / "
+                << heap.blockBytes / MB << " MB reserved / " << heap.heapSize / MB << " MB total, "
+                << heap.allocationCount << " allocations in " << heap.blockCount << " blocks"
+                << std::endl;
+        }
+    }
+
+}
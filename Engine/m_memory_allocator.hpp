@@ -0,0 +1,102 @@
+#pragma once
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+// std
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace m {
+
+    // what a sub-allocation will be used for. buffers and optimal tiling images never share a
+    // block, so bufferImageGranularity never has to be considered between neighbours
+    enum class MAllocationKind {
+        Buffer,   // buffers and linear tiling images, long lived
+        Image,    // optimal tiling images, long lived
+        Staging,  // short lived upload sources, served from the linear pools
+    };
+
+    // one vkAllocateMemory that sub-allocations are carved out of
+    struct MMemoryBlock {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        void* mapped = nullptr;
+        uint32_t memoryTypeIndex = 0;
+        MAllocationKind kind = MAllocationKind::Buffer;
+        bool dedicated = false;  // holds exactly one resource, freed together with it
+
+        // general blocks: free ranges keyed by offset, neighbours are merged on free
+        std::map<VkDeviceSize, VkDeviceSize> freeRanges{};
+
+        // linear blocks: bump pointer that rewinds once every allocation has been returned
+        VkDeviceSize head = 0;
+
+        uint32_t allocationCount = 0;
+        VkDeviceSize usedBytes = 0;
+    };
+
+    struct MAllocation {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void* mapped = nullptr;  // host pointer to offset, only set for host visible memory
+        uint32_t memoryTypeIndex = 0;
+        MMemoryBlock* block = nullptr;
+    };
+
+    class MMemoryAllocator {
+    public:
+        struct HeapStats {
+            VkDeviceSize heapSize = 0;
+            VkDeviceSize blockBytes = 0;  // memory reserved from the driver
+            VkDeviceSize usedBytes = 0;   // memory handed out to resources
+            uint32_t blockCount = 0;      // vkAllocateMemory calls alive, dedicated ones included
+            uint32_t allocationCount = 0;
+        };
+
+        MMemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice);
+        ~MMemoryAllocator();
+
+        MMemoryAllocator(const MMemoryAllocator&) = delete;
+        MMemoryAllocator& operator=(const MMemoryAllocator&) = delete;
+
+        MAllocation allocate(
+            const VkMemoryRequirements& requirements,
+            uint32_t memoryTypeIndex,
+            MAllocationKind kind);
+        void free(MAllocation& allocation);
+
+        // range for vkFlush/InvalidateMappedMemoryRanges, widened to nonCoherentAtomSize
+        VkMappedMemoryRange mappedRange(
+            const MAllocation& allocation, VkDeviceSize size, VkDeviceSize offset) const;
+
+        std::vector<HeapStats> getHeapStats();
+        void printStats(std::ostream& out);
+
+    private:
+        struct MemoryType {
+            std::vector<std::unique_ptr<MMemoryBlock>> blocks{};
+            VkDeviceSize blockSize = 0;
+        };
+
+        MMemoryBlock* createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, MAllocationKind kind);
+        void destroyBlock(MMemoryBlock& block);
+        bool allocateFromBlock(
+            MMemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+        void releaseToBlock(MMemoryBlock& block, VkDeviceSize offset, VkDeviceSize size);
+        bool isBlockEmpty(const MMemoryBlock& block) const { return block.allocationCount == 0; }
+
+        VkDevice device;
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        VkDeviceSize nonCoherentAtomSize;
+
+        std::vector<MemoryType> memoryTypes;
+        std::vector<std::unique_ptr<MMemoryBlock>> dedicatedBlocks;
+        std::mutex mutex;
+    };
+
+}
@@ -0,0 +1,259 @@
+#include "m_mesh_cache.hpp"
+
+#include "m_mapped_file.hpp"
+#include "m_mesh_optimizer.hpp"
+
+// std
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace m {
+
+	static constexpr uint64_t DATA_ALIGNMENT = 16;
+
+	static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	bool MMeshCache::hashFile(const std::string& filepath, uint64_t& hash) {
+		auto file = MMappedFile::open(filepath);
+		if (file == nullptr) {
+			return false;
+		}
+
+		// 64 bit FNV-1a
+		hash = 0xcbf29ce484222325ull;
+		const auto* bytes = static_cast<const unsigned char*>(file->data());
+		for (size_t i = 0; i < file->size(); i++) {
+			hash ^= bytes[i];
+			hash *= 0x100000001b3ull;
+		}
+		return true;
+	}
+
+	bool MMeshCache::load(
+		const std::string& cachePath, const uint64_t* sourceHash, MModel::Builder& builder) {
+		std::shared_ptr<MMappedFile> file = MMappedFile::open(cachePath);
+		if (file == nullptr || file->size() < sizeof(Header)) {
+			return false;
+		}
+
+		const auto* header = static_cast<const Header*>(file->data());
+		if (header->magic != MAGIC || header->version != VERSION ||
+			header->vertexStride != sizeof(MModel::Vertex)) {
+			return false;
+		}
+		if (sourceHash != nullptr && header->sourceHash != *sourceHash) {
+			return false;
+		}
+
+		uint64_t vertexEnd = header->vertexOffset + uint64_t{ header->vertexCount } * sizeof(MModel::Vertex);
+		uint64_t indexEnd = header->indexOffset + uint64_t{ header->indexCount } * sizeof(uint32_t);
+		if (vertexEnd > file->size() || indexEnd > file->size()) {
+			return false;
+		}
+		if (header->lodCount == 0 || header->lodCount > MModel::MAX_LODS) {
+			return false;
+		}
+		for (uint32_t i = 0; i < header->lodCount; i++) {
+			const MModel::Lod& lod = header->lods[i];
+			if (uint64_t{ lod.firstIndex } + lod.indexCount > header->indexCount) {
+				return false;
+			}
+		}
+
+		const auto* base = static_cast<const char*>(file->data());
+		uint64_t submeshEnd = header->submeshOffset + uint64_t{ header->submeshCount } * sizeof(MModel::Submesh);
+		if (header->submeshCount > 0 && submeshEnd > file->size()) {
+			return false;
+		}
+		const auto* submeshes = reinterpret_cast<const MModel::Submesh*>(base + header->submeshOffset);
+		for (uint32_t i = 0; i < header->submeshCount; i++) {
+			const MModel::Submesh& submesh = submeshes[i];
+			if (uint64_t{ submesh.firstVertex } + submesh.vertexCount > header->vertexCount ||
+				submesh.vertexCount > MModel::MAX_SUBMESH_VERTICES) {
+				return false;
+			}
+			for (uint32_t j = 0; j < header->lodCount; j++) {
+				const MModel::Lod& lod = submesh.lods[j];
+				if (uint64_t{ lod.firstIndex } + lod.indexCount > header->indexCount) {
+					return false;
+				}
+			}
+		}
+
+		// meshlets are optional, but when there are any every LOD has a range of them
+		uint64_t meshletEnd = header->meshletOffset + uint64_t{ header->meshletCount } * sizeof(MModel::Meshlet);
+		if (header->meshletCount > 0 && meshletEnd > file->size()) {
+			return false;
+		}
+		const auto* meshlets = reinterpret_cast<const MModel::Meshlet*>(base + header->meshletOffset);
+		for (uint32_t i = 0; i < header->meshletCount; i++) {
+			if (uint64_t{ meshlets[i].firstIndex } + meshlets[i].indexCount > header->indexCount) {
+				return false;
+			}
+		}
+		for (uint32_t i = 0; header->meshletCount > 0 && i < header->lodCount; i++) {
+			const MModel::MeshletRange& range = header->meshletLods[i];
+			if (uint64_t{ range.firstMeshlet } + range.meshletCount > header->meshletCount) {
+				return false;
+			}
+		}
+
+		builder.vertices.clear();
+		builder.indices.clear();
+		builder.mappedVertices = reinterpret_cast<const MModel::Vertex*>(base + header->vertexOffset);
+		builder.mappedVertexCount = header->vertexCount;
+		builder.mappedIndices = reinterpret_cast<const uint32_t*>(base + header->indexOffset);
+		builder.mappedIndexCount = header->indexCount;
+		builder.lods.assign(header->lods, header->lods + header->lodCount);
+		builder.submeshes.assign(submeshes, submeshes + header->submeshCount);
+		builder.meshlets.assign(meshlets, meshlets + header->meshletCount);
+		builder.meshletLods.clear();
+		if (header->meshletCount > 0) {
+			builder.meshletLods.assign(header->meshletLods, header->meshletLods + header->lodCount);
+		}
+		builder.mapping = std::move(file);
+
+		builder.bounds.min = { header->boundsMin[0], header->boundsMin[1], header->boundsMin[2] };
+		builder.bounds.max = { header->boundsMax[0], header->boundsMax[1], header->boundsMax[2] };
+		builder.bounds.center = (builder.bounds.min + builder.bounds.max) * .5f;
+		builder.bounds.radius = header->boundsRadius;
+		return true;
+	}
+
+	bool MMeshCache::write(
+		const std::string& cachePath, uint64_t sourceHash, const MModel::Builder& builder) {
+		Header header{};
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.sourceHash = sourceHash;
+		header.vertexStride = sizeof(MModel::Vertex);
+		header.vertexCount = builder.vertexCount();
+		header.indexCount = builder.indexCount();
+
+		if (builder.lods.empty()) {
+			header.lodCount = 1;
+			header.lods[0] = { 0, header.indexCount, 0.f };
+		}
+		else {
+			header.lodCount = static_cast<uint32_t>(std::min<size_t>(builder.lods.size(), MModel::MAX_LODS));
+			std::copy(builder.lods.begin(), builder.lods.begin() + header.lodCount, header.lods);
+		}
+
+		MModel::Bounds bounds = builder.bounds.isValid() ? builder.bounds : builder.computeBounds();
+		header.boundsRadius = bounds.radius;
+		for (int i = 0; i < 3; i++) {
+			header.boundsMin[i] = bounds.min[i];
+			header.boundsMax[i] = bounds.max[i];
+		}
+
+		header.submeshCount = static_cast<uint32_t>(builder.submeshes.size());
+		if (builder.meshletLods.size() == header.lodCount) {
+			header.meshletCount = static_cast<uint32_t>(builder.meshlets.size());
+			std::copy(builder.meshletLods.begin(), builder.meshletLods.end(), header.meshletLods);
+		}
+
+		uint64_t vertexBytes = uint64_t{ header.vertexCount } * sizeof(MModel::Vertex);
+		uint64_t indexBytes = uint64_t{ header.indexCount } * sizeof(uint32_t);
+		header.vertexOffset = alignUp(sizeof(Header), DATA_ALIGNMENT);
+		header.indexOffset = alignUp(header.vertexOffset + vertexBytes, DATA_ALIGNMENT);
+		header.submeshOffset = alignUp(header.indexOffset + indexBytes, DATA_ALIGNMENT);
+		uint64_t submeshBytes = builder.submeshes.size() * sizeof(MModel::Submesh);
+		uint64_t meshletBytes = uint64_t{ header.meshletCount } * sizeof(MModel::Meshlet);
+		header.meshletOffset = alignUp(header.submeshOffset + submeshBytes, DATA_ALIGNMENT);
+
+		// write to the side and swap it in, so a reader never maps a half written file
+		std::string tempPath = cachePath + ".tmp";
+		{
+			std::ofstream out{ tempPath, std::ios::binary | std::ios::trunc };
+			if (!out.is_open()) {
+				return false;
+			}
+
+			const char zeros[DATA_ALIGNMENT] = {};
+			out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+			out.write(zeros, header.vertexOffset - sizeof(Header));
+			out.write(reinterpret_cast<const char*>(builder.vertexData()), vertexBytes);
+			out.write(zeros, header.indexOffset - (header.vertexOffset + vertexBytes));
+			out.write(reinterpret_cast<const char*>(builder.indexData()), indexBytes);
+			out.write(zeros, header.submeshOffset - (header.indexOffset + indexBytes));
+			out.write(reinterpret_cast<const char*>(builder.submeshes.data()), submeshBytes);
+			out.write(zeros, header.meshletOffset - (header.submeshOffset + submeshBytes));
+			out.write(reinterpret_cast<const char*>(builder.meshlets.data()), meshletBytes);
+			if (!out.good()) {
+				return false;
+			}
+		}
+
+		std::error_code error;
+		std::filesystem::rename(tempPath, cachePath, error);
+		if (error) {
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+		return true;
+	}
+
+	int MMeshCache::cookDirectory(const std::string& directory) {
+		int cooked = 0;
+		int upToDate = 0;
+		int failed = 0;
+
+		std::error_code error;
+		for (const auto& entry : std::filesystem::recursive_directory_iterator(directory, error)) {
+			if (!entry.is_regular_file()) continue;
+
+			std::string extension = entry.path().extension().string();
+			std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+			if (extension != ".obj") continue;
+
+			std::string sourcePath = entry.path().string();
+			std::string cachePath = cachePathFor(sourcePath);
+			try {
+				uint64_t sourceHash;
+				if (!hashFile(sourcePath, sourceHash)) {
+					throw std::runtime_error("failed to read source");
+				}
+
+				MModel::Builder builder{};
+				if (load(cachePath, &sourceHash, builder)) {
+					upToDate++;
+					continue;
+				}
+
+				builder.loadObj(sourcePath);
+				MMeshOptimizer::Report report = MMeshOptimizer::optimize(builder);
+				builder.buildMeshlets();
+				if (!write(cachePath, sourceHash, builder)) {
+					throw std::runtime_error("failed to write " + cachePath);
+				}
+				std::cout << "cooked " << sourcePath << " (" << builder.vertexCount() << " vertices, "
+					<< builder.indexCount() << " indices, " << builder.lods.size() << " LODs, "
+					<< std::max<size_t>(builder.submeshes.size(), 1) << " submeshes, " << builder.meshlets.size()
+					<< " meshlets)" << std::endl;
+				std::cout << "  ACMR " << report.before.acmr << " -> " << report.after.acmr << ", ATVR "
+					<< report.before.atvr << " -> " << report.after.atvr << std::endl;
+				cooked++;
+			}
+			catch (const std::exception& e) {
+				std::cerr << "failed to cook " << sourcePath << ": " << e.what() << std::endl;
+				failed++;
+			}
+		}
+
+		if (error) {
+			std::cerr << "failed to read directory " << directory << ": " << error.message() << std::endl;
+			failed++;
+		}
+
+		std::cout << cooked << " cooked, " << upToDate << " up to date, " << failed << " failed"
+			<< std::endl;
+		return failed;
+	}
+
+}
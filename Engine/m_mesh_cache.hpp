@@ -0,0 +1,55 @@
+#pragma once
+
+#include "m_model.hpp"
+
+// std
+#include <cstdint>
+#include <string>
+
+namespace m {
+
+	// Binary mesh files holding the deduplicated vertex and index arrays of an imported model,
+	// with the LODs, submeshes and meshlets generated on import.
+	// They are written next to the source (model.obj -> model.obj.mmesh) and are memory mapped
+	// on load, so the arrays are uploaded straight out of the page cache.
+	class MMeshCache {
+	public:
+		static constexpr uint32_t MAGIC = 0x48534d4d;  // "MMSH"
+		static constexpr uint32_t VERSION = 6;  // bumped whenever the import makes different meshes
+
+		struct Header {
+			uint32_t magic;
+			uint32_t version;
+			uint64_t sourceHash;  // FNV-1a of the file the mesh was cooked from
+			uint32_t vertexStride;  // sizeof(MModel::Vertex) when cooked
+			uint32_t vertexCount;
+			uint32_t indexCount;
+			float boundsRadius;  // sphere around the center of the box
+			float boundsMin[3];
+			float boundsMax[3];
+			uint64_t vertexOffset;  // byte offsets from the start of the file
+			uint64_t indexOffset;
+			uint32_t lodCount;
+			MModel::Lod lods[MModel::MAX_LODS];  // ranges of the index array
+			uint32_t submeshCount;  // 0 for a mesh in one piece
+			uint64_t submeshOffset;  // MModel::Submesh table after the indices
+			uint32_t meshletCount;
+			uint64_t meshletOffset;  // MModel::Meshlet table after the submeshes
+			MModel::MeshletRange meshletLods[MModel::MAX_LODS];  // lodCount of them, or none
+		};
+
+		static std::string cachePathFor(const std::string& sourcePath) { return sourcePath + ".mmesh"; }
+
+		static bool hashFile(const std::string& filepath, uint64_t& hash);
+
+		// points the builder into the mapped cache. pass a null sourceHash to accept the cache
+		// without checking it against its source, e.g. when only cooked meshes are shipped
+		static bool load(
+			const std::string& cachePath, const uint64_t* sourceHash, MModel::Builder& builder);
+		static bool write(
+			const std::string& cachePath, uint64_t sourceHash, const MModel::Builder& builder);
+
+		// cooks every .obj below directory ahead of time, returns the number of failures
+		static int cookDirectory(const std::string& directory);
+	};
+}
@@ -0,0 +1,315 @@
+#include "m_mesh_optimizer.hpp"
+
+#include "m_trace.hpp"
+
+// std
+#include <algorithm>
+#include <limits>
+
+namespace m {
+
+    MMeshOptimizer::Report MMeshOptimizer::optimize(MModel::Builder& builder) {
+        Report report{};
+        std::vector<MModel::Submesh> pieces = builder.getSubmeshes();
+        size_t levelCount = std::max<size_t>(builder.lods.size(), 1);
+
+        // LOD 0 of every piece, the caches of a split mesh are weighted by its triangles
+        auto analyze = [&]() {
+            CacheStats stats{};
+            float triangles = 0.f;
+            float transformed = 0.f;
+            float used = 0.f;
+            for (const MModel::Submesh& piece : pieces) {
+                const MModel::Lod& base = piece.lods[0];
+                CacheStats pieceStats = analyzeVertexCache(
+                    builder.indexData() + base.firstIndex, base.indexCount, piece.vertexCount);
+                float pieceTransformed = pieceStats.acmr * (base.indexCount / 3);
+                triangles += base.indexCount / 3;
+                transformed += pieceTransformed;
+                used += pieceStats.atvr > 0.f ? pieceTransformed / pieceStats.atvr : 0.f;
+            }
+            stats.acmr = triangles > 0.f ? transformed / triangles : 0.f;
+            stats.atvr = used > 0.f ? transformed / used : 0.f;
+            return stats;
+        };
+
+        report.before = analyze();
+        if (builder.mapping) {
+            report.after = report.before;
+            return report;
+        }
+        M_TRACE_ZONE("MMeshOptimizer::optimize");
+        // cut from the order about to change
+        builder.meshlets.clear();
+        builder.meshletLods.clear();
+
+        std::vector<uint32_t> clusters;
+        std::vector<uint32_t> pieceIndices;
+        uint32_t keptCount = 0;
+        for (MModel::Submesh& piece : pieces) {
+            MModel::Vertex* vertices = builder.vertices.data() + piece.firstVertex;
+
+            // the LODs are drawn on their own, so each gets an order of its own
+            for (size_t level = 0; level < levelCount; level++) {
+                const MModel::Lod& lod = piece.lods[level];
+                uint32_t* indices = builder.indices.data() + lod.firstIndex;
+                optimizeVertexCache(indices, lod.indexCount, piece.vertexCount, clusters);
+                optimizeOverdraw(indices, lod.indexCount, vertices, clusters);
+            }
+
+            // one numbering for all the piece's LODs, which share its vertices
+            pieceIndices.clear();
+            for (size_t level = 0; level < levelCount; level++) {
+                auto begin = builder.indices.begin() + piece.lods[level].firstIndex;
+                pieceIndices.insert(pieceIndices.end(), begin, begin + piece.lods[level].indexCount);
+            }
+            uint32_t usedCount = optimizeVertexFetch(
+                vertices, piece.vertexCount, pieceIndices.data(), static_cast<uint32_t>(pieceIndices.size()));
+            auto renumbered = pieceIndices.begin();
+            for (size_t level = 0; level < levelCount; level++) {
+                const MModel::Lod& lod = piece.lods[level];
+                std::copy(renumbered, renumbered + lod.indexCount, builder.indices.begin() + lod.firstIndex);
+                renumbered += lod.indexCount;
+            }
+
+            // the pieces move down over the vertices dropped before them
+            std::copy(vertices, vertices + usedCount, builder.vertices.begin() + keptCount);
+            piece.firstVertex = keptCount;
+            piece.vertexCount = usedCount;
+            keptCount += usedCount;
+        }
+        builder.vertices.resize(keptCount);
+        if (!builder.submeshes.empty()) {
+            builder.submeshes = pieces;
+        }
+
+        report.after = analyze();
+        return report;
+    }
+
+    MMeshOptimizer::CacheStats MMeshOptimizer::analyzeVertexCache(
+        const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize) {
+        CacheStats stats{};
+        if (indexCount < 3) {
+            return stats;
+        }
+
+        // a vertex is in the FIFO while fewer than cacheSize others went in after it
+        std::vector<uint32_t> timestamps(vertexCount, 0);
+        uint32_t time = cacheSize + 1;
+        uint32_t transformed = 0;
+        uint32_t used = 0;
+        for (uint32_t i = 0; i < indexCount; i++) {
+            uint32_t vertex = indices[i];
+            if (timestamps[vertex] == 0) {
+                used++;
+            }
+            if (time - timestamps[vertex] > cacheSize) {
+                timestamps[vertex] = time++;
+                transformed++;
+            }
+        }
+
+        stats.acmr = static_cast<float>(transformed) / (indexCount / 3);
+        stats.atvr = static_cast<float>(transformed) / used;
+        return stats;
+    }
+
+    void MMeshOptimizer::optimizeVertexCache(
+        uint32_t* indices,
+        uint32_t indexCount,
+        uint32_t vertexCount,
+        std::vector<uint32_t>& clusters,
+        uint32_t cacheSize) {
+        clusters.clear();
+        uint32_t triangleCount = indexCount / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+
+        // the triangles around every vertex, packed into one array
+        std::vector<uint32_t> liveTriangles(vertexCount, 0);
+        for (uint32_t i = 0; i < triangleCount * 3; i++) {
+            liveTriangles[indices[i]]++;
+        }
+        std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+        for (uint32_t vertex = 0; vertex < vertexCount; vertex++) {
+            adjacencyOffsets[vertex + 1] = adjacencyOffsets[vertex] + liveTriangles[vertex];
+        }
+        std::vector<uint32_t> adjacency(triangleCount * 3);
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                adjacency[fill[indices[triangle * 3 + corner]]++] = triangle;
+            }
+        }
+
+        std::vector<uint32_t> timestamps(vertexCount, 0);
+        uint32_t time = cacheSize + 1;
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> deadEnd;
+        deadEnd.reserve(triangleCount * 3);
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> output;
+        output.reserve(triangleCount * 3);
+
+        const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+        uint32_t cursor = 0;
+        uint32_t fanning = indices[0];
+        while (fanning != NONE) {
+            if (time - timestamps[fanning] > cacheSize) {
+                clusters.push_back(static_cast<uint32_t>(output.size() / 3));
+            }
+
+            // emit every triangle left around the fanning vertex
+            candidates.clear();
+            for (uint32_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++) {
+                uint32_t triangle = adjacency[a];
+                if (emitted[triangle]) continue;
+                emitted[triangle] = true;
+
+                for (uint32_t corner = 0; corner < 3; corner++) {
+                    uint32_t vertex = indices[triangle * 3 + corner];
+                    output.push_back(vertex);
+                    deadEnd.push_back(vertex);
+                    candidates.push_back(vertex);
+                    liveTriangles[vertex]--;
+                    if (time - timestamps[vertex] > cacheSize) {
+                        timestamps[vertex] = time++;
+                    }
+                }
+            }
+
+            // the oldest candidate that will still be in the cache once its own triangles are out
+            uint32_t next = NONE;
+            int64_t bestPriority = -1;
+            for (uint32_t vertex : candidates) {
+                if (liveTriangles[vertex] == 0) continue;
+                int64_t priority = 0;
+                uint32_t age = time - timestamps[vertex];
+                if (age + 2 * liveTriangles[vertex] <= cacheSize) {
+                    priority = age;
+                }
+                if (priority > bestPriority) {
+                    bestPriority = priority;
+                    next = vertex;
+                }
+            }
+
+            // nothing left around here, back to recently used vertices and then in input order
+            while (next == NONE && !deadEnd.empty()) {
+                uint32_t vertex = deadEnd.back();
+                deadEnd.pop_back();
+                if (liveTriangles[vertex] > 0) {
+                    next = vertex;
+                }
+            }
+            while (next == NONE && cursor < vertexCount) {
+                if (liveTriangles[cursor] > 0) {
+                    next = cursor;
+                }
+                cursor++;
+            }
+            fanning = next;
+        }
+
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    void MMeshOptimizer::optimizeOverdraw(
+        uint32_t* indices,
+        uint32_t indexCount,
+        const MModel::Vertex* vertices,
+        const std::vector<uint32_t>& clusters) {
+        uint32_t triangleCount = indexCount / 3;
+        if (clusters.size() < 2) {
+            return;
+        }
+
+        struct Cluster {
+            uint32_t begin;
+            uint32_t end;
+            glm::vec3 centroid{ 0.f };
+            glm::vec3 normal{ 0.f };
+            float sortKey = 0.f;
+        };
+
+        // area weighted, so slivers don't pull the centroids and normals around
+        std::vector<Cluster> sorted;
+        sorted.reserve(clusters.size());
+        glm::vec3 meshCentroid{ 0.f };
+        float meshArea = 0.f;
+        for (size_t c = 0; c < clusters.size(); c++) {
+            Cluster cluster{};
+            cluster.begin = clusters[c];
+            cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+            float area = 0.f;
+            glm::vec3 unweighted{ 0.f };
+            for (uint32_t triangle = cluster.begin; triangle < cluster.end; triangle++) {
+                const glm::vec3& a = vertices[indices[triangle * 3]].position;
+                const glm::vec3& b = vertices[indices[triangle * 3 + 1]].position;
+                const glm::vec3& c = vertices[indices[triangle * 3 + 2]].position;
+                glm::vec3 normal = glm::cross(b - a, c - a);
+                float triangleArea = glm::length(normal);
+                glm::vec3 centroid = (a + b + c) / 3.f;
+
+                cluster.normal += normal;
+                cluster.centroid += centroid * triangleArea;
+                unweighted += centroid;
+                area += triangleArea;
+            }
+            meshCentroid += cluster.centroid;
+            meshArea += area;
+            cluster.centroid = area > 0.f
+                ? cluster.centroid / area
+                : unweighted / static_cast<float>(cluster.end - cluster.begin);
+            sorted.push_back(cluster);
+        }
+        if (meshArea == 0.f) {
+            return;
+        }
+        meshCentroid /= meshArea;
+
+        // clusters far out along their own normal are on the outside of the mesh, and drawn first
+        // they hide most of what is behind them from any direction they are seen from
+        for (Cluster& cluster : sorted) {
+            float length = glm::length(cluster.normal);
+            if (length > 0.f) {
+                cluster.sortKey = glm::dot(cluster.centroid - meshCentroid, cluster.normal / length);
+            }
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) {
+            return a.sortKey > b.sortKey;
+        });
+
+        std::vector<uint32_t> source(indices, indices + triangleCount * 3);
+        uint32_t* out = indices;
+        for (const Cluster& cluster : sorted) {
+            out = std::copy(source.begin() + cluster.begin * 3, source.begin() + cluster.end * 3, out);
+        }
+    }
+
+    uint32_t MMeshOptimizer::optimizeVertexFetch(
+        MModel::Vertex* vertices, uint32_t vertexCount, uint32_t* indices, uint32_t indexCount) {
+        const uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+        std::vector<uint32_t> remap(vertexCount, UNUSED);
+        uint32_t usedCount = 0;
+        for (uint32_t i = 0; i < indexCount; i++) {
+            uint32_t& slot = remap[indices[i]];
+            if (slot == UNUSED) {
+                slot = usedCount++;
+            }
+            indices[i] = slot;
+        }
+
+        std::vector<MModel::Vertex> source(vertices, vertices + vertexCount);
+        uint32_t unusedSlot = usedCount;
+        for (uint32_t vertex = 0; vertex < vertexCount; vertex++) {
+            uint32_t slot = remap[vertex] != UNUSED ? remap[vertex] : unusedSlot++;
+            vertices[slot] = source[vertex];
+        }
+        return usedCount;
+    }
+
+}
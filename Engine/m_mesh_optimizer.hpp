@@ -0,0 +1,66 @@
+#pragma once
+
+#include "m_model.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace m {
+
+    // Reorders the indices and vertices of an imported mesh for the GPU, after Sander, Nehab and
+    // Barczak's "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw". Triangles are
+    // put in an order that reuses the post-transform vertex cache (Tipsify), the runs of triangles
+    // between the jumps that order makes are sorted so the ones facing out of the mesh come first
+    // and hide what is behind them, and the vertices are then renumbered in the order the indices
+    // first use them so fetching them walks forward through memory.
+    class MMeshOptimizer {
+    public:
+        // entries in the cache Tipsify plans for and the statistics simulate. small enough that
+        // an order made for it still does well on larger caches
+        static constexpr uint32_t CACHE_SIZE = 16;
+
+        // of a FIFO vertex cache running over an index order
+        struct CacheStats {
+            float acmr = 0.f;  // vertices transformed per triangle, 0.5 at best on a large grid
+            float atvr = 0.f;  // vertices transformed per vertex used, 1 at best
+        };
+
+        // LOD 0 of the mesh before and after optimize
+        struct Report {
+            CacheStats before{};
+            CacheStats after{};
+        };
+
+        // optimizes every LOD of every submesh on its own, then lays out the vertices of each
+        // submesh for all its LODs. vertices no LOD uses are dropped. a mapped builder was cooked
+        // optimized and is left alone
+        static Report optimize(MModel::Builder& builder);
+
+        static CacheStats analyzeVertexCache(
+            const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+
+        // Tipsify. clusters gets the first triangle of every run after a jump to vertices that
+        // aren't in the cache, starting with 0
+        static void optimizeVertexCache(
+            uint32_t* indices,
+            uint32_t indexCount,
+            uint32_t vertexCount,
+            std::vector<uint32_t>& clusters,
+            uint32_t cacheSize = CACHE_SIZE);
+
+        // sorts the clusters from optimizeVertexCache by how far they face out of the mesh. the
+        // triangles within a cluster keep their order, so the cache does about as well as before
+        static void optimizeOverdraw(
+            uint32_t* indices,
+            uint32_t indexCount,
+            const MModel::Vertex* vertices,
+            const std::vector<uint32_t>& clusters);
+
+        // renumbers the vertices in order of first use, returns how many are used. vertices are
+        // rewritten in place and the unused ones are left past the returned count
+        static uint32_t optimizeVertexFetch(
+            MModel::Vertex* vertices, uint32_t vertexCount, uint32_t* indices, uint32_t indexCount);
+    };
+
+}
@@ -0,0 +1,123 @@
+#include "m_mesh_pool.hpp"
+
+#include "m_upload_manager.hpp"
+
+// std
+#include <cassert>
+#include <stdexcept>
+
+namespace m {
+
+    MMeshPool::MMeshPool(MDevice& device, uint32_t maxVertices, uint32_t maxIndices, uint32_t maxMeshlets)
+        : mDevice{ device }, maxVertices{ maxVertices }, maxIndices{ maxIndices }, maxMeshlets{ maxMeshlets } {
+        vertexBuffer = std::make_unique<MBuffer>(
+            device,
+            sizeof(MModel::GpuVertex),
+            maxVertices,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        indexBuffer = std::make_unique<MBuffer>(
+            device,
+            sizeof(uint32_t),
+            maxIndices,
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        meshletBuffer = std::make_unique<MBuffer>(
+            device,
+            sizeof(MModel::Meshlet),
+            maxMeshlets,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        // small and written once per mesh, so it stays host visible
+        meshInfoBuffer = std::make_unique<MBuffer>(
+            device,
+            sizeof(MeshInfo),
+            MAX_MESHES,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        meshInfoBuffer->map();
+    }
+
+    MMeshPool::~MMeshPool() {}
+
+    MMeshPool::Allocation MMeshPool::addMesh(
+        const MModel::GpuVertex* vertices,
+        uint32_t vertexCount,
+        const uint32_t* indices,
+        uint32_t indexCount,
+        const glm::vec4& boundingSphere,
+        const std::vector<MModel::Lod>& lods,
+        const std::vector<MModel::Meshlet>& meshlets,
+        const std::vector<MModel::MeshletRange>& meshletLods) {
+        assert(!lods.empty() && lods.size() <= MModel::MAX_LODS && "Bad LOD count");
+        assert((meshletLods.empty() || meshletLods.size() == lods.size()) && "Bad meshlet LOD count");
+        uint32_t meshletCount = static_cast<uint32_t>(meshlets.size());
+        Allocation allocation{};
+        uint32_t firstMeshlet = 0;
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            if (meshCount >= MAX_MESHES || vertexCount > maxVertices - vertexHead ||
+                indexCount > maxIndices - indexHead || meshletCount > maxMeshlets - meshletHead) {
+                throw std::runtime_error("mesh pool is full!");
+            }
+
+            allocation.meshId = meshCount++;
+            allocation.firstIndex = indexHead;
+            allocation.vertexOffset = static_cast<int32_t>(vertexHead);
+            firstMeshlet = meshletHead;
+            vertexHead += vertexCount;
+            indexHead += indexCount;
+            meshletHead += meshletCount;
+        }
+
+        // new entries are past anything a frame in flight reads, so no need to wait on the GPU
+        MeshInfo info{};
+        info.vertexOffset = allocation.vertexOffset;
+        info.lodCount = static_cast<uint32_t>(lods.size());
+        info.boundingSphere = boundingSphere;
+        for (size_t i = 0; i < lods.size(); i++) {
+            info.lods[i] = { lods[i].indexCount, allocation.firstIndex + lods[i].firstIndex, 0, 0 };
+            if (!meshletLods.empty()) {
+                info.lods[i].firstMeshlet = firstMeshlet + meshletLods[i].firstMeshlet;
+                info.lods[i].meshletCount = meshletLods[i].meshletCount;
+            }
+        }
+        meshInfoBuffer->writeToIndex(&info, allocation.meshId);
+        meshInfoBuffer->flushIndex(allocation.meshId);
+
+        auto& uploadManager = mDevice.getUploadManager();
+        if (meshletCount > 0) {
+            std::vector<MModel::Meshlet> pooledMeshlets = meshlets;
+            for (MModel::Meshlet& meshlet : pooledMeshlets) {
+                meshlet.firstIndex += allocation.firstIndex;
+            }
+            uploadManager.uploadBuffer(
+                meshletBuffer->getBuffer(),
+                pooledMeshlets.data(),
+                sizeof(MModel::Meshlet) * static_cast<VkDeviceSize>(meshletCount),
+                sizeof(MModel::Meshlet) * static_cast<VkDeviceSize>(firstMeshlet));
+        }
+        uploadManager.uploadBuffer(
+            vertexBuffer->getBuffer(),
+            vertices,
+            sizeof(MModel::GpuVertex) * static_cast<VkDeviceSize>(vertexCount),
+            sizeof(MModel::GpuVertex) * static_cast<VkDeviceSize>(allocation.vertexOffset));
+        allocation.uploadToken = uploadManager.uploadBuffer(
+            indexBuffer->getBuffer(),
+            indices,
+            sizeof(uint32_t) * static_cast<VkDeviceSize>(indexCount),
+            sizeof(uint32_t) * static_cast<VkDeviceSize>(allocation.firstIndex));
+        return allocation;
+    }
+
+    void MMeshPool::bind(VkCommandBuffer commandBuffer) {
+        VkBuffer buffers[] = { vertexBuffer->getBuffer() };
+        VkDeviceSize offsets[] = { 0 };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+    }
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "m_buffer.hpp"
+#include "m_device.hpp"
+#include "m_model.hpp"
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace m {
+
+    // Shared vertex and index buffers that many models are packed into, so a whole scene can be
+    // drawn from one pair of bindings. Every mesh also gets an entry in a storage buffer the cull
+    // shader reads its draw arguments and bounds from, and its meshlets go into another one for
+    // the meshlet cull shader. Space is handed out linearly and only comes back when the pool is
+    // destroyed.
+    class MMeshPool {
+    public:
+        static constexpr uint32_t MAX_MESHES = 4096;
+
+        // matches MeshInfo in cull.comp
+        struct MeshInfo {
+            struct LodRange {
+                uint32_t indexCount;
+                uint32_t firstIndex;  // into the pool's index buffer
+                uint32_t firstMeshlet;  // into the pool's meshlet buffer
+                uint32_t meshletCount;  // 0 when the mesh has none
+            };
+
+            int32_t vertexOffset;
+            uint32_t lodCount;
+            uint32_t padding[2];
+            glm::vec4 boundingSphere;  // center in the stored positions' space, radius in w
+            LodRange lods[MModel::MAX_LODS];
+        };
+
+        struct Allocation {
+            uint32_t meshId;
+            uint32_t firstIndex;
+            int32_t vertexOffset;
+            uint64_t uploadToken;
+        };
+
+        MMeshPool(MDevice& device, uint32_t maxVertices, uint32_t maxIndices, uint32_t maxMeshlets);
+        ~MMeshPool();
+
+        MMeshPool(const MMeshPool&) = delete;
+        MMeshPool& operator=(const MMeshPool&) = delete;
+
+        // copies the mesh into the shared buffers through the upload manager, throws when full.
+        // the LOD and meshlet ranges are relative to indices, and the spheres are around the
+        // vertices' positions as they are stored. meshletLods is empty or has a range per LOD
+        Allocation addMesh(
+            const MModel::GpuVertex* vertices,
+            uint32_t vertexCount,
+            const uint32_t* indices,
+            uint32_t indexCount,
+            const glm::vec4& boundingSphere,
+            const std::vector<MModel::Lod>& lods,
+            const std::vector<MModel::Meshlet>& meshlets,
+            const std::vector<MModel::MeshletRange>& meshletLods);
+
+        void bind(VkCommandBuffer commandBuffer);
+
+        VkBuffer getVertexBuffer() const { return vertexBuffer->getBuffer(); }
+        VkBuffer getIndexBuffer() const { return indexBuffer->getBuffer(); }
+        VkDescriptorBufferInfo meshInfoDescriptor() { return meshInfoBuffer->descriptorInfo(); }
+        VkDescriptorBufferInfo meshletDescriptor() { return meshletBuffer->descriptorInfo(); }
+        uint32_t getMeshCount() const { return meshCount; }
+
+    private:
+        MDevice& mDevice;
+
+        std::unique_ptr<MBuffer> vertexBuffer;
+        std::unique_ptr<MBuffer> indexBuffer;
+        std::unique_ptr<MBuffer> meshInfoBuffer;
+        std::unique_ptr<MBuffer> meshletBuffer;
+
+        uint32_t maxVertices;
+        uint32_t maxIndices;
+        uint32_t maxMeshlets;
+        uint32_t vertexHead = 0;
+        uint32_t indexHead = 0;
+        uint32_t meshletHead = 0;
+        uint32_t meshCount = 0;
+        std::mutex mutex;
+    };
+
+}
@@ -0,0 +1,348 @@
+#include "m_mesh_simplifier.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <tuple>
+
+namespace m {
+
+    MMeshSimplifier::Quadric MMeshSimplifier::Quadric::fromPlane(
+        double a, double b, double c, double d, double weight) {
+        Quadric quadric{};
+        quadric.m = {
+            a * a, a * b, a * c, a * d,
+                   b * b, b * c, b * d,
+                          c * c, c * d,
+                                 d * d };
+        for (double& value : quadric.m) {
+            value *= weight;
+        }
+        return quadric;
+    }
+
+    MMeshSimplifier::Quadric& MMeshSimplifier::Quadric::operator+=(const Quadric& other) {
+        for (size_t i = 0; i < m.size(); i++) {
+            m[i] += other.m[i];
+        }
+        return *this;
+    }
+
+    double MMeshSimplifier::Quadric::evaluate(const glm::vec3& point) const {
+        double x = point.x;
+        double y = point.y;
+        double z = point.z;
+        double error =
+            m[0] * x * x + 2.0 * m[1] * x * y + 2.0 * m[2] * x * z + 2.0 * m[3] * x +
+            m[4] * y * y + 2.0 * m[5] * y * z + 2.0 * m[6] * y +
+            m[7] * z * z + 2.0 * m[8] * z +
+            m[9];
+        // rounding can take it just below zero
+        return std::max(error, 0.0);
+    }
+
+    MMeshSimplifier::MMeshSimplifier(
+        const MModel::Vertex* vertices,
+        uint32_t vertexCount,
+        const uint32_t* indices,
+        uint32_t indexCount,
+        bool lockBorders) {
+        weldPositions(vertices, vertexCount);
+
+        // triangles that are already degenerate over the welded positions have nothing to give
+        triangles.reserve(indexCount / 3);
+        for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+            uint32_t a = positionOf[indices[i]];
+            uint32_t b = positionOf[indices[i + 1]];
+            uint32_t c = positionOf[indices[i + 2]];
+            if (a == b || b == c || c == a) continue;
+            triangles.push_back({ indices[i], indices[i + 1], indices[i + 2] });
+        }
+        triangleAlive.assign(triangles.size(), true);
+        liveTriangleCount = static_cast<uint32_t>(triangles.size());
+
+        trianglesAt.resize(positions.size());
+        for (uint32_t triangle = 0; triangle < triangles.size(); triangle++) {
+            for (int corner = 0; corner < 3; corner++) {
+                trianglesAt[cornerPosition(triangle, corner)].push_back(triangle);
+            }
+        }
+
+        quadrics.resize(positions.size());
+        versions.assign(positions.size(), 0);
+        removed.assign(positions.size(), false);
+        locked.assign(positions.size(), false);
+        addQuadrics(lockBorders);
+
+        for (uint32_t triangle = 0; triangle < triangles.size(); triangle++) {
+            for (int corner = 0; corner < 3; corner++) {
+                pushCollapse(cornerPosition(triangle, corner), cornerPosition(triangle, (corner + 1) % 3));
+            }
+        }
+    }
+
+    void MMeshSimplifier::weldPositions(const MModel::Vertex* vertices, uint32_t vertexCount) {
+        std::vector<uint32_t> order(vertexCount);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [vertices](uint32_t a, uint32_t b) {
+            const glm::vec3& p = vertices[a].position;
+            const glm::vec3& q = vertices[b].position;
+            return std::tie(p.x, p.y, p.z) < std::tie(q.x, q.y, q.z);
+        });
+
+        positionOf.resize(vertexCount);
+        for (uint32_t vertex : order) {
+            const glm::vec3& position = vertices[vertex].position;
+            if (positions.empty() || positions.back() != position) {
+                positions.push_back(position);
+                verticesAt.emplace_back();
+            }
+            positionOf[vertex] = static_cast<uint32_t>(positions.size() - 1);
+            verticesAt.back().push_back(vertex);
+        }
+    }
+
+    void MMeshSimplifier::addQuadrics(bool lockBorders) {
+        // an edge only one triangle uses is on an open border
+        std::vector<uint64_t> edges;
+        edges.reserve(triangles.size() * 3);
+        auto edgeKey = [](uint32_t a, uint32_t b) {
+            return uint64_t{ std::min(a, b) } << 32 | std::max(a, b);
+        };
+        for (uint32_t triangle = 0; triangle < triangles.size(); triangle++) {
+            for (int corner = 0; corner < 3; corner++) {
+                edges.push_back(edgeKey(cornerPosition(triangle, corner), cornerPosition(triangle, (corner + 1) % 3)));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+
+        for (uint32_t triangle = 0; triangle < triangles.size(); triangle++) {
+            uint32_t corners[3] = {
+                cornerPosition(triangle, 0), cornerPosition(triangle, 1), cornerPosition(triangle, 2) };
+            glm::vec3 normal = glm::cross(
+                positions[corners[1]] - positions[corners[0]], positions[corners[2]] - positions[corners[0]]);
+            float length = glm::length(normal);
+            if (length == 0.f) continue;
+            normal /= length;
+
+            Quadric plane = Quadric::fromPlane(
+                normal.x, normal.y, normal.z, -glm::dot(normal, positions[corners[0]]), 1.0);
+            for (uint32_t corner : corners) {
+                quadrics[corner] += plane;
+            }
+
+            for (int corner = 0; corner < 3; corner++) {
+                uint32_t a = corners[corner];
+                uint32_t b = corners[(corner + 1) % 3];
+                auto range = std::equal_range(edges.begin(), edges.end(), edgeKey(a, b));
+                if (range.second - range.first != 1) continue;
+                if (lockBorders) {
+                    locked[a] = true;
+                    locked[b] = true;
+                }
+
+                glm::vec3 borderNormal = glm::cross(positions[b] - positions[a], normal);
+                float borderLength = glm::length(borderNormal);
+                if (borderLength == 0.f) continue;
+                borderNormal /= borderLength;
+                Quadric border = Quadric::fromPlane(
+                    borderNormal.x,
+                    borderNormal.y,
+                    borderNormal.z,
+                    -glm::dot(borderNormal, positions[a]),
+                    BORDER_WEIGHT);
+                quadrics[a] += border;
+                quadrics[b] += border;
+            }
+        }
+    }
+
+    void MMeshSimplifier::pushCollapse(uint32_t a, uint32_t b) {
+        // a locked position can take in its neighbours but never move itself
+        if (locked[a] && locked[b]) {
+            return;
+        }
+        Quadric merged = quadrics[a];
+        merged += quadrics[b];
+        double aOntoB = locked[a] ? std::numeric_limits<double>::max() : merged.evaluate(positions[b]);
+        double bOntoA = locked[b] ? std::numeric_limits<double>::max() : merged.evaluate(positions[a]);
+        if (aOntoB <= bOntoA) {
+            queue.push({ aOntoB, a, b, versions[a], versions[b] });
+        }
+        else {
+            queue.push({ bOntoA, b, a, versions[b], versions[a] });
+        }
+    }
+
+    std::vector<uint32_t> MMeshSimplifier::simplify(uint32_t targetIndexCount, float maxError) {
+        double maxAllowedCost = static_cast<double>(maxError) * maxError;
+        while (liveTriangleCount * 3 > targetIndexCount && !queue.empty()) {
+            Collapse next = queue.top();
+            if (removed[next.from] || removed[next.to] || versions[next.from] != next.fromVersion ||
+                versions[next.to] != next.toVersion) {
+                queue.pop();
+                continue;
+            }
+            // everything left in the queue costs at least as much
+            if (next.cost > maxAllowedCost) {
+                break;
+            }
+            queue.pop();
+
+            if (!isCollapseValid(next.from, next.to)) continue;
+            maxCost = std::max(maxCost, next.cost);
+            collapse(next.from, next.to);
+        }
+
+        std::vector<uint32_t> result;
+        result.reserve(liveTriangleCount * 3);
+        for (uint32_t triangle = 0; triangle < triangles.size(); triangle++) {
+            if (!triangleAlive[triangle]) continue;
+            result.insert(result.end(), triangles[triangle].begin(), triangles[triangle].end());
+        }
+        return result;
+    }
+
+    float MMeshSimplifier::getError() const {
+        return static_cast<float>(std::sqrt(maxCost));
+    }
+
+    bool MMeshSimplifier::isCollapseValid(uint32_t from, uint32_t to) const {
+        // the positions joined to both ends may only be the corners of the triangles on the
+        // edge, otherwise the collapse pinches the surface together
+        std::vector<uint32_t> fromNeighbours;
+        std::vector<uint32_t> toNeighbours;
+        uint32_t sharedTriangles = 0;
+        for (uint32_t triangle : trianglesAt[from]) {
+            if (!triangleAlive[triangle]) continue;
+            for (int corner = 0; corner < 3; corner++) {
+                uint32_t position = cornerPosition(triangle, corner);
+                if (position == to) sharedTriangles++;
+                if (position != from && position != to) fromNeighbours.push_back(position);
+            }
+        }
+        for (uint32_t triangle : trianglesAt[to]) {
+            if (!triangleAlive[triangle]) continue;
+            for (int corner = 0; corner < 3; corner++) {
+                uint32_t position = cornerPosition(triangle, corner);
+                if (position != from && position != to) toNeighbours.push_back(position);
+            }
+        }
+        std::sort(fromNeighbours.begin(), fromNeighbours.end());
+        fromNeighbours.erase(std::unique(fromNeighbours.begin(), fromNeighbours.end()), fromNeighbours.end());
+        std::sort(toNeighbours.begin(), toNeighbours.end());
+        toNeighbours.erase(std::unique(toNeighbours.begin(), toNeighbours.end()), toNeighbours.end());
+
+        uint32_t commonNeighbours = 0;
+        auto a = fromNeighbours.begin();
+        auto b = toNeighbours.begin();
+        while (a != fromNeighbours.end() && b != toNeighbours.end()) {
+            if (*a < *b) {
+                ++a;
+            }
+            else if (*b < *a) {
+                ++b;
+            }
+            else {
+                commonNeighbours++;
+                ++a;
+                ++b;
+            }
+        }
+        if (commonNeighbours > sharedTriangles) {
+            return false;
+        }
+
+        // no triangle that stays may turn over
+        for (uint32_t triangle : trianglesAt[from]) {
+            if (!triangleAlive[triangle]) continue;
+            glm::vec3 before[3];
+            glm::vec3 after[3];
+            bool onEdge = false;
+            for (int corner = 0; corner < 3; corner++) {
+                uint32_t position = cornerPosition(triangle, corner);
+                onEdge = onEdge || position == to;
+                before[corner] = positions[position];
+                after[corner] = positions[position == from ? to : position];
+            }
+            if (onEdge) continue;
+
+            glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(normalBefore, normalAfter) <= 0.f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void MMeshSimplifier::collapse(uint32_t from, uint32_t to) {
+        // a corner moving off from takes a vertex at to that shares a triangle with it, so it
+        // stays on its own side of a normal or uv seam
+        std::vector<std::pair<uint32_t, uint32_t>> replacements;
+        for (uint32_t vertex : verticesAt[from]) {
+            uint32_t replacement = verticesAt[to][0];
+            for (uint32_t triangle : trianglesAt[from]) {
+                if (!triangleAlive[triangle]) continue;
+                const auto& corners = triangles[triangle];
+                if (std::find(corners.begin(), corners.end(), vertex) == corners.end()) continue;
+                auto partner = std::find_if(corners.begin(), corners.end(), [&](uint32_t corner) {
+                    return positionOf[corner] == to;
+                });
+                if (partner != corners.end()) {
+                    replacement = *partner;
+                    break;
+                }
+            }
+            replacements.push_back({ vertex, replacement });
+        }
+
+        for (uint32_t triangle : trianglesAt[from]) {
+            if (!triangleAlive[triangle]) continue;
+            auto& corners = triangles[triangle];
+            bool onEdge = false;
+            for (uint32_t corner : corners) {
+                onEdge = onEdge || positionOf[corner] == to;
+            }
+            if (onEdge) {
+                triangleAlive[triangle] = false;
+                liveTriangleCount--;
+                continue;
+            }
+
+            for (uint32_t& corner : corners) {
+                if (positionOf[corner] != from) continue;
+                for (const auto& replacement : replacements) {
+                    if (replacement.first == corner) {
+                        corner = replacement.second;
+                        break;
+                    }
+                }
+            }
+            trianglesAt[to].push_back(triangle);
+        }
+
+        removed[from] = true;
+        trianglesAt[from].clear();
+        quadrics[to] += quadrics[from];
+        versions[to]++;
+
+        auto& around = trianglesAt[to];
+        around.erase(
+            std::remove_if(around.begin(), around.end(), [this](uint32_t triangle) { return !triangleAlive[triangle]; }),
+            around.end());
+
+        // the edges around to are stale now, the rest of the queue isn't affected
+        for (uint32_t triangle : around) {
+            for (int corner = 0; corner < 3; corner++) {
+                uint32_t position = cornerPosition(triangle, corner);
+                if (position != to) {
+                    pushCollapse(to, position);
+                }
+            }
+        }
+    }
+
+}
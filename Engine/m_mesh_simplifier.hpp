@@ -0,0 +1,95 @@
+#pragma once
+
+#include "m_model.hpp"
+
+// std
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace m {
+
+    // Quadric error edge collapse after Garland and Heckbert. Vertices at the same position are
+    // welded, so the mesh is simplified as one surface across normal and uv seams, and every
+    // collapse moves one position onto a neighbouring one instead of a new point. Indices keep
+    // pointing into the original vertex array, which the LODs of a model share.
+    //
+    // A corner that loses its position moves to a vertex at the new position it shares a
+    // triangle with, which keeps its side of a seam, or to any vertex there when it has none.
+    // Open borders are held in place by planes through them at right angles to their triangle,
+    // or locked outright when the mesh is one piece of a larger one.
+    class MMeshSimplifier {
+    public:
+        // how much more it costs to move a vertex off an open border than across the surface
+        static constexpr double BORDER_WEIGHT = 10.0;
+
+        // the arrays are copied, they can go away once this returns. with lockBorders no position
+        // on an open border moves, so pieces of a mesh simplified on their own still meet
+        MMeshSimplifier(
+            const MModel::Vertex* vertices,
+            uint32_t vertexCount,
+            const uint32_t* indices,
+            uint32_t indexCount,
+            bool lockBorders = false);
+
+        // collapses edges, cheapest first, until at most targetIndexCount indices are left or
+        // the next collapse would cost more than maxError. a later call carries on from there,
+        // so calls with falling targets build a chain of LODs
+        std::vector<uint32_t> simplify(uint32_t targetIndexCount, float maxError);
+
+        // roughly how far from the original surface the collapses so far may have moved it
+        float getError() const;
+        uint32_t getIndexCount() const { return liveTriangleCount * 3; }
+
+    private:
+        // symmetric 4x4 matrix, upper triangle row by row
+        struct Quadric {
+            std::array<double, 10> m{};
+
+            static Quadric fromPlane(double a, double b, double c, double d, double weight);
+            Quadric& operator+=(const Quadric& other);
+            double evaluate(const glm::vec3& point) const;
+        };
+
+        struct Collapse {
+            double cost;
+            uint32_t from;
+            uint32_t to;
+            uint32_t fromVersion;
+            uint32_t toVersion;
+
+            bool operator>(const Collapse& other) const { return cost > other.cost; }
+        };
+
+        void weldPositions(const MModel::Vertex* vertices, uint32_t vertexCount);
+        void addQuadrics(bool lockBorders);
+        void pushCollapse(uint32_t a, uint32_t b);
+        bool isCollapseValid(uint32_t from, uint32_t to) const;
+        void collapse(uint32_t from, uint32_t to);
+        uint32_t cornerPosition(uint32_t triangle, int corner) const {
+            return positionOf[triangles[triangle][corner]];
+        }
+
+        // per vertex
+        std::vector<uint32_t> positionOf;
+
+        // per welded position
+        std::vector<glm::vec3> positions;
+        std::vector<std::vector<uint32_t>> verticesAt;
+        std::vector<Quadric> quadrics;
+        std::vector<uint32_t> versions;  // bumped when the position takes in a collapse
+        std::vector<bool> removed;
+        std::vector<bool> locked;
+        std::vector<std::vector<uint32_t>> trianglesAt;
+
+        std::vector<std::array<uint32_t, 3>> triangles;  // vertex indices
+        std::vector<bool> triangleAlive;
+        uint32_t liveTriangleCount = 0;
+
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+        double maxCost = 0.0;
+    };
+
+}
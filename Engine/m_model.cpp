@@ -1,16 +1,28 @@
 #include "m_model.hpp"
 
+#include "m_mesh_cache.hpp"
+#include "m_mesh_optimizer.hpp"
+#include "m_mesh_pool.hpp"
+#include "m_mesh_simplifier.hpp"
+#include "m_job_system.hpp"
+#include "m_trace.hpp"
+#include "m_upload_manager.hpp"
 #include "m_utils.hpp"
 
 // libs
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 #define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtc/packing.hpp>
 #include <glm/gtx/hash.hpp>
 
 // std
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstring>
+#include <iostream>
+#include <limits>
 #include <unordered_map>
 
 namespace std {
@@ -26,37 +38,124 @@ namespace std {
 
 namespace m {
 
-    MModel::MModel(MDevice& device, const MModel::Builder& builder) : mDevice{ device } {
-        createVertexBuffers(builder.vertices);
-        createIndexBuffers(builder.indices);
+    MModel::MModel(MDevice& device, const MModel::Builder& builder, MMeshPool* meshPool)
+        : mDevice{ device } {
+        M_TRACE_ZONE("MModel::MModel");
+        bounds = builder.bounds.isValid() ? builder.bounds : builder.computeBounds();
+        lods = builder.lods;
+        if (lods.empty()) {
+            lods.push_back({ 0, builder.indexCount(), 0.f });
+        }
+        submeshes = builder.getSubmeshes();
+
+#if MOCHA_VERTEX_FORMAT == 1
+        // a cube rather than the box, so the bounding sphere stays a sphere in the stored positions
+        glm::vec3 halfExtent = (bounds.max - bounds.min) * .5f;
+        float scale = glm::max(halfExtent.x, glm::max(halfExtent.y, halfExtent.z));
+        positionDecode = glm::mat4{ scale > 0.f ? scale : 1.f };
+        positionDecode[3] = glm::vec4(bounds.center, 1.f);
+
+        std::vector<CompactVertex> packed(builder.vertexCount());
+        const Vertex* source = builder.vertexData();
+        for (size_t i = 0; i < packed.size(); i++) {
+            packed[i] = CompactVertex::pack(source[i], positionDecode);
+        }
+        const GpuVertex* vertices = packed.data();
+#else
+        const GpuVertex* vertices = builder.vertexData();
+#endif
+
+        // the pool only takes indexed meshes, anything else keeps its own buffers
+        if (meshPool != nullptr && builder.indexCount() > 0) {
+            vertexCount = builder.vertexCount();
+            indexCount = builder.indexCount();
+            hasIndexBuffer = true;
+
+            // the pool's indices are 32 bit and count from the start of the mesh, so the pieces'
+            // are moved up to their first vertex
+            const uint32_t* indices = builder.indexData();
+            std::vector<uint32_t> rebased;
+            if (submeshes.size() > 1) {
+                rebased.assign(indices, indices + indexCount);
+                for (const Submesh& submesh : submeshes) {
+                    for (const Lod& range : submesh.lods) {
+                        for (uint32_t i = range.firstIndex; i < range.firstIndex + range.indexCount; i++) {
+                            rebased[i] += submesh.firstVertex;
+                        }
+                    }
+                }
+                indices = rebased.data();
+            }
+
+            // the pool culls against spheres in the positions as stored, the cones keep their
+            // directions under a uniform scale
+            float decodeScale = positionDecode[0][0];
+            auto storedSphere = [&](const glm::vec3& center, float radius) {
+                return glm::vec4{ (center - glm::vec3(positionDecode[3])) / decodeScale, radius / decodeScale };
+            };
+            glm::vec4 boundingSphere = storedSphere(bounds.center, bounds.radius);
+            std::vector<Meshlet> meshlets;
+            if (builder.meshletLods.size() == lods.size()) {
+                meshletLods = builder.meshletLods;
+                meshlets = builder.meshlets;
+                for (Meshlet& meshlet : meshlets) {
+                    meshlet.boundingSphere =
+                        storedSphere(glm::vec3(meshlet.boundingSphere), meshlet.boundingSphere.w);
+                }
+            }
+            auto allocation = meshPool->addMesh(
+                vertices, vertexCount, indices, indexCount, boundingSphere, lods, meshlets, meshletLods);
+            this->meshPool = meshPool;
+            meshId = allocation.meshId;
+            firstIndex = allocation.firstIndex;
+            vertexOffset = allocation.vertexOffset;
+            uploadToken = allocation.uploadToken;
+            return;
+        }
+
+        createVertexBuffers(vertices, builder.vertexCount());
+        createIndexBuffers(builder.indexData(), builder.indexCount());
     }
 
-    MModel::~MModel() {}
+    MModel::~MModel() {
+        // the transfer queue may still be writing into our buffers
+        if (!ready) {
+            mDevice.getUploadManager().wait(uploadToken);
+        }
+    }
 
     std::unique_ptr<MModel> MModel::createModelFromFile(
-        MDevice& device, const std::string& filepath) {
+        MDevice& device, const std::string& filepath, MMeshPool* meshPool) {
         Builder builder{};
         builder.loadModel(filepath);
-        return std::make_unique<MModel>(device, builder);
+        return std::make_unique<MModel>(device, builder, meshPool);
+    }
+
+    std::vector<std::unique_ptr<MModel>> MModel::createModelsFromFiles(
+        MDevice& device, const std::vector<std::string>& filepaths, MMeshPool* meshPool) {
+        M_TRACE_ZONE("MModel::createModelsFromFiles");
+        // parsing runs on the job system, the buffers are created back here in the order given
+        std::vector<Builder> builders(filepaths.size());
+        MJobSystem::shared().parallelFor(filepaths.size(), 1, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; i++) {
+                builders[i].loadModel(filepaths[i]);
+            }
+        });
+
+        std::vector<std::unique_ptr<MModel>> models;
+        models.reserve(builders.size());
+        for (const auto& builder : builders) {
+            models.push_back(std::make_unique<MModel>(device, builder, meshPool));
+        }
+        return models;
     }
 
-    void MModel::createVertexBuffers(const std::vector<Vertex>& vertices) {
-        vertexCount = static_cast<uint32_t>(vertices.size());
+    void MModel::createVertexBuffers(const GpuVertex* vertices, uint32_t count) {
+        vertexCount = count;
         assert(vertexCount >= 3 && "Vertex count must be at least 3");
         VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
         uint32_t vertexSize = sizeof(vertices[0]);
 
-        MBuffer stagingBuffer{
-            mDevice,
-            vertexSize,
-            vertexCount,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        };
-
-        stagingBuffer.map();
-        stagingBuffer.writeToBuffer((void*)vertices.data());
-
         vertexBuffer = std::make_unique<MBuffer>(
             mDevice,
             vertexSize,
@@ -64,30 +163,31 @@ namespace m {
             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-        mDevice.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer->getBuffer(), bufferSize);
+        uploadToken = mDevice.getUploadManager().uploadBuffer(
+            vertexBuffer->getBuffer(), vertices, bufferSize);
     }
 
-    void MModel::createIndexBuffers(const std::vector<uint32_t>& indices) {
-        indexCount = static_cast<uint32_t>(indices.size());
+    void MModel::createIndexBuffers(const uint32_t* indices, uint32_t count) {
+        indexCount = count;
         hasIndexBuffer = indexCount > 0;
 
         if (!hasIndexBuffer) {
             return;
         }
 
-        VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
-        uint32_t indexSize = sizeof(indices[0]);
-
-        MBuffer stagingBuffer{
-            mDevice,
-            indexSize,
-            indexCount,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        };
-
-        stagingBuffer.map();
-        stagingBuffer.writeToBuffer((void*)indices.data());
+        // the indices of every piece count from its first vertex, so only the pieces' sizes matter
+        bool narrow = std::all_of(submeshes.begin(), submeshes.end(), [](const Submesh& submesh) {
+            return submesh.vertexCount <= MAX_SUBMESH_VERTICES;
+        });
+        std::vector<uint16_t> narrowIndices;
+        const void* data = indices;
+        uint32_t indexSize = sizeof(uint32_t);
+        if (narrow) {
+            narrowIndices.assign(indices, indices + indexCount);
+            data = narrowIndices.data();
+            indexSize = sizeof(uint16_t);
+            indexType = VK_INDEX_TYPE_UINT16;
+        }
 
         indexBuffer = std::make_unique<MBuffer>(
             mDevice,
@@ -96,25 +196,58 @@ namespace m {
             VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-        mDevice.copyBuffer(stagingBuffer.getBuffer(), indexBuffer->getBuffer(), bufferSize);
+        uploadToken = mDevice.getUploadManager().uploadBuffer(
+            indexBuffer->getBuffer(), data, static_cast<VkDeviceSize>(indexSize) * indexCount);
     }
 
-    void MModel::draw(VkCommandBuffer commandBuffer) {
-        if (hasIndexBuffer) {
-            vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+    bool MModel::isReady() {
+        if (!ready) {
+            ready = mDevice.getUploadManager().isComplete(uploadToken);
+        }
+        return ready;
+    }
+
+    void MModel::draw(VkCommandBuffer commandBuffer, uint32_t instanceCount, uint32_t firstInstance, uint32_t lod) {
+        if (hasIndexBuffer && (meshPool != nullptr || submeshes.size() == 1)) {
+            // the pool's copy of the indices counts from the start of the mesh
+            assert(lod < lods.size() && "LOD out of range");
+            vkCmdDrawIndexed(
+                commandBuffer,
+                lods[lod].indexCount,
+                instanceCount,
+                firstIndex + lods[lod].firstIndex,
+                vertexOffset,
+                firstInstance);
+        }
+        else if (hasIndexBuffer) {
+            assert(lod < lods.size() && "LOD out of range");
+            for (const Submesh& submesh : submeshes) {
+                vkCmdDrawIndexed(
+                    commandBuffer,
+                    submesh.lods[lod].indexCount,
+                    instanceCount,
+                    firstIndex + submesh.lods[lod].firstIndex,
+                    vertexOffset + static_cast<int32_t>(submesh.firstVertex),
+                    firstInstance);
+            }
         }
         else {
-            vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+            vkCmdDraw(commandBuffer, vertexCount, instanceCount, 0, firstInstance);
         }
     }
 
     void MModel::bind(VkCommandBuffer commandBuffer) {
+        if (meshPool != nullptr) {
+            meshPool->bind(commandBuffer);
+            return;
+        }
+
         VkBuffer buffers[] = { vertexBuffer->getBuffer() };
         VkDeviceSize offsets[] = { 0 };
         vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
 
         if (hasIndexBuffer) {
-            vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+            vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, indexType);
         }
     }
 
@@ -137,60 +270,530 @@ namespace m {
         return attributeDescriptions;
     }
 
+    static_assert(sizeof(MModel::CompactVertex) == 20, "CompactVertex must match its attribute offsets");
+
+    // folds the lower hemisphere over the upper one, so a unit vector fits in two components
+    static glm::vec2 encodeOctahedral(const glm::vec3& normal) {
+        float sum = glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+        if (sum == 0.f) {
+            return glm::vec2{ 0.f };
+        }
+        glm::vec2 encoded = glm::vec2(normal) / sum;
+        if (normal.z < 0.f) {
+            glm::vec2 sign{ encoded.x >= 0.f ? 1.f : -1.f, encoded.y >= 0.f ? 1.f : -1.f };
+            encoded = (1.f - glm::abs(glm::vec2(encoded.y, encoded.x))) * sign;
+        }
+        return encoded;
+    }
+
+    MModel::CompactVertex MModel::CompactVertex::pack(const Vertex& vertex, const glm::mat4& positionDecode) {
+        glm::vec3 position = (vertex.position - glm::vec3(positionDecode[3])) / positionDecode[0][0];
+
+        CompactVertex packed{};
+        packed.position[0] = glm::packSnorm2x16(glm::vec2(position.x, position.y));
+        packed.position[1] = glm::packSnorm2x16(glm::vec2(position.z, 0.f));
+        packed.normal = glm::packSnorm2x16(encodeOctahedral(vertex.normal));
+        packed.color = glm::packUnorm4x8(glm::vec4(vertex.color, 1.f));
+        packed.uv = glm::packHalf2x16(vertex.uv);
+        return packed;
+    }
+
+    std::vector<VkVertexInputBindingDescription> MModel::CompactVertex::getBindingDescriptions() {
+        std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
+        bindingDescriptions[0].binding = 0;
+        bindingDescriptions[0].stride = sizeof(CompactVertex);
+        bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        return bindingDescriptions;
+    }
+
+    std::vector<VkVertexInputAttributeDescription> MModel::CompactVertex::getAttributeDescriptions() {
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+
+        // the same locations as Vertex, the shaders read the w of the position as nothing
+        attributeDescriptions.push_back({ 0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(CompactVertex, position) });
+        attributeDescriptions.push_back({ 1, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(CompactVertex, color) });
+        attributeDescriptions.push_back({ 2, 0, VK_FORMAT_R16G16_SNORM, offsetof(CompactVertex, normal) });
+        attributeDescriptions.push_back({ 3, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(CompactVertex, uv) });
+
+        return attributeDescriptions;
+    }
+
+    MModel::Bounds MModel::Builder::computeBounds() const {
+        Bounds result{};
+        const Vertex* data = vertexData();
+        uint32_t count = vertexCount();
+        if (count == 0) {
+            result.radius = 0.f;
+            return result;
+        }
+
+        result.min = glm::vec3{ std::numeric_limits<float>::max() };
+        result.max = glm::vec3{ std::numeric_limits<float>::lowest() };
+        for (uint32_t i = 0; i < count; i++) {
+            result.min = glm::min(result.min, data[i].position);
+            result.max = glm::max(result.max, data[i].position);
+        }
+
+        // centered on the box rather than a minimal sphere, but tighter than the box's corners
+        result.center = (result.min + result.max) * .5f;
+        float radiusSquared = 0.f;
+        for (uint32_t i = 0; i < count; i++) {
+            glm::vec3 offset = data[i].position - result.center;
+            radiusSquared = glm::max(radiusSquared, glm::dot(offset, offset));
+        }
+        result.radius = glm::sqrt(radiusSquared);
+        return result;
+    }
+
+    std::vector<MModel::Submesh> MModel::Builder::getSubmeshes() const {
+        if (!submeshes.empty()) {
+            return submeshes;
+        }
+
+        Submesh whole{};
+        whole.vertexCount = vertexCount();
+        if (lods.empty()) {
+            whole.lods[0] = { 0, indexCount(), 0.f };
+        }
+        std::copy(lods.begin(), lods.end(), whole.lods);
+        return { whole };
+    }
+
+    void MModel::Builder::splitSubmeshes() {
+        if (mapping || !submeshes.empty() || vertices.size() <= MAX_SUBMESH_VERTICES) {
+            return;
+        }
+        M_TRACE_ZONE("MModel::Builder::splitSubmeshes");
+        meshlets.clear();
+        meshletLods.clear();
+
+        // only LOD 0 is split, generateLods makes the rest per piece
+        if (!lods.empty()) {
+            indices.resize(lods[0].indexCount);
+            lods.clear();
+        }
+
+        // triangles are taken in order until the next one would bring in one vertex too many.
+        // a vertex used on both sides of a cut is copied into both pieces
+        const uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+        std::vector<uint32_t> local(vertices.size(), UNUSED);
+        std::vector<uint32_t> taken;
+        std::vector<Vertex> splitVertices;
+        splitVertices.reserve(vertices.size());
+        std::vector<uint32_t> splitIndices;
+        splitIndices.reserve(indices.size());
+
+        Submesh piece{};
+        auto closePiece = [&]() {
+            piece.lods[0].indexCount = static_cast<uint32_t>(splitIndices.size()) - piece.lods[0].firstIndex;
+            submeshes.push_back(piece);
+            for (uint32_t vertex : taken) {
+                local[vertex] = UNUSED;
+            }
+            taken.clear();
+            piece = Submesh{};
+            piece.firstVertex = static_cast<uint32_t>(splitVertices.size());
+            piece.lods[0].firstIndex = static_cast<uint32_t>(splitIndices.size());
+        };
+
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            const uint32_t corners[3] = { indices[i], indices[i + 1], indices[i + 2] };
+            uint32_t newVertices = 0;
+            for (int c = 0; c < 3; c++) {
+                bool repeated = (c > 0 && corners[c] == corners[0]) || (c > 1 && corners[c] == corners[1]);
+                if (local[corners[c]] == UNUSED && !repeated) newVertices++;
+            }
+            if (piece.vertexCount + newVertices > MAX_SUBMESH_VERTICES) {
+                closePiece();
+            }
+
+            for (uint32_t vertex : corners) {
+                if (local[vertex] == UNUSED) {
+                    local[vertex] = piece.vertexCount++;
+                    splitVertices.push_back(vertices[vertex]);
+                    taken.push_back(vertex);
+                }
+                splitIndices.push_back(local[vertex]);
+            }
+        }
+        closePiece();
+
+        vertices = std::move(splitVertices);
+        indices = std::move(splitIndices);
+    }
+
+    void MModel::Builder::generateLods() {
+        if (mapping) {
+            return;
+        }
+        M_TRACE_ZONE("MModel::Builder::generateLods");
+        meshlets.clear();
+        meshletLods.clear();
+
+        // called again, the chain is built anew from LOD 0, which comes first either way
+        std::vector<Submesh> pieces = getSubmeshes();
+        if (!lods.empty()) {
+            indices.resize(lods[0].indexCount);
+        }
+        lods.assign(1, { 0, static_cast<uint32_t>(indices.size()), 0.f });
+
+        Bounds meshBounds = bounds.isValid() ? bounds : computeBounds();
+        float maxError = meshBounds.radius * LOD_MAX_ERROR;
+        // a cut is an open border to the pieces on either side, which would pull apart if they
+        // simplified it differently
+        bool lockBorders = pieces.size() > 1;
+
+        // the coarser levels of every piece, simplified side by side
+        std::vector<std::vector<std::vector<uint32_t>>> chains(pieces.size());
+        std::vector<std::vector<float>> errors(pieces.size());
+        MJobSystem::shared().parallelFor(pieces.size(), 1, [&](size_t first, size_t last) {
+            for (size_t p = first; p < last; p++) {
+                const Submesh& piece = pieces[p];
+                const Lod& base = piece.lods[0];
+                if (base.indexCount / 3 < 2 * LOD_MIN_TRIANGLES) continue;
+
+                MMeshSimplifier simplifier{
+                    vertices.data() + piece.firstVertex,
+                    piece.vertexCount,
+                    indices.data() + base.firstIndex,
+                    base.indexCount,
+                    lockBorders };
+
+                // every step carries on from the last one, so the LODs only get coarser
+                uint32_t previousCount = base.indexCount;
+                while (chains[p].size() + 1 < MAX_LODS) {
+                    uint32_t targetCount = static_cast<uint32_t>(previousCount / 3 * LOD_REDUCTION) * 3;
+                    if (targetCount / 3 < LOD_MIN_TRIANGLES) {
+                        break;
+                    }
+
+                    std::vector<uint32_t> lodIndices = simplifier.simplify(targetCount, maxError);
+                    // held back by the error bound or by collapses that would fold the surface over
+                    if (lodIndices.size() > previousCount * LOD_MIN_REDUCTION) {
+                        break;
+                    }
+                    previousCount = static_cast<uint32_t>(lodIndices.size());
+                    chains[p].push_back(std::move(lodIndices));
+                    errors[p].push_back(simplifier.getError());
+                }
+            }
+        });
+
+        size_t levelCount = 1;
+        for (const auto& chain : chains) {
+            levelCount = std::max(levelCount, chain.size() + 1);
+        }
+
+        // level by level, a piece whose chain ran out repeats its coarsest
+        for (size_t level = 1; level < levelCount; level++) {
+            Lod lod{ static_cast<uint32_t>(indices.size()), 0, 0.f };
+            for (size_t p = 0; p < pieces.size(); p++) {
+                size_t coarsest = std::min(level, chains[p].size());
+                std::vector<uint32_t> pieceIndices;
+                float error = 0.f;
+                if (coarsest == 0) {
+                    const Lod& base = pieces[p].lods[0];
+                    pieceIndices.assign(
+                        indices.begin() + base.firstIndex, indices.begin() + base.firstIndex + base.indexCount);
+                }
+                else {
+                    pieceIndices = chains[p][coarsest - 1];
+                    error = errors[p][coarsest - 1];
+                }
+
+                pieces[p].lods[level] = {
+                    static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(pieceIndices.size()), error };
+                indices.insert(indices.end(), pieceIndices.begin(), pieceIndices.end());
+                lod.indexCount += static_cast<uint32_t>(pieceIndices.size());
+                lod.error = std::max(lod.error, error);
+            }
+            lods.push_back(lod);
+        }
+
+        if (!submeshes.empty()) {
+            submeshes = pieces;
+        }
+    }
+
+    void MModel::Builder::buildMeshlets() {
+        if (mapping) {
+            return;
+        }
+        M_TRACE_ZONE("MModel::Builder::buildMeshlets");
+        meshlets.clear();
+        meshletLods.clear();
+
+        std::vector<Submesh> pieces = getSubmeshes();
+        size_t levelCount = std::max<size_t>(lods.size(), 1);
+
+        // the sphere is around the box of the corners, the cone around the triangles' normals
+        auto finishMeshlet = [&](Meshlet& meshlet, const Vertex* pieceVertices) {
+            glm::vec3 boxMin{ std::numeric_limits<float>::max() };
+            glm::vec3 boxMax{ -std::numeric_limits<float>::max() };
+            glm::vec3 normalSum{ 0.f };
+            std::vector<glm::vec3> normals;
+            normals.reserve(meshlet.indexCount / 3);
+            for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+                const glm::vec3& a = pieceVertices[indices[i]].position;
+                const glm::vec3& b = pieceVertices[indices[i + 1]].position;
+                const glm::vec3& c = pieceVertices[indices[i + 2]].position;
+                boxMin = glm::min(boxMin, glm::min(a, glm::min(b, c)));
+                boxMax = glm::max(boxMax, glm::max(a, glm::max(b, c)));
+
+                glm::vec3 normal = glm::cross(b - a, c - a);
+                float length = glm::length(normal);
+                if (length == 0.f) continue;
+                normals.push_back(normal / length);
+                normalSum += normals.back();
+            }
+
+            glm::vec3 center = (boxMin + boxMax) * .5f;
+            float radius = 0.f;
+            for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i++) {
+                radius = std::max(radius, glm::length(pieceVertices[indices[i]].position - center));
+            }
+            meshlet.boundingSphere = glm::vec4(center, radius);
+
+            // the cutoff is the sine of the angle from the axis to the normal furthest from it, the
+            // triangles can only all face away when that is under 90 degrees
+            meshlet.cone = glm::vec4(0.f, 0.f, 0.f, 1.f);
+            float sumLength = glm::length(normalSum);
+            if (normals.empty() || sumLength == 0.f) return;
+            glm::vec3 axis = normalSum / sumLength;
+            float minDot = 1.f;
+            for (const glm::vec3& normal : normals) {
+                minDot = std::min(minDot, glm::dot(axis, normal));
+            }
+            if (minDot > 0.f) {
+                meshlet.cone = glm::vec4(axis, std::sqrt(1.f - minDot * minDot));
+            }
+        };
+
+        // every LOD is cut in the order the optimizer left its triangles in, which already keeps
+        // neighbours together for the vertex cache. the stamp of a vertex is the last meshlet
+        // that used it
+        const uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+        std::vector<uint32_t> stamps(vertices.size(), UNUSED);
+        for (size_t level = 0; level < levelCount; level++) {
+            MeshletRange range{ static_cast<uint32_t>(meshlets.size()), 0 };
+            for (const Submesh& piece : pieces) {
+                const Lod& lod = piece.lods[level];
+                const Vertex* pieceVertices = vertices.data() + piece.firstVertex;
+                uint32_t* pieceStamps = stamps.data() + piece.firstVertex;
+
+                Meshlet meshlet{};
+                meshlet.firstIndex = lod.firstIndex;
+                uint32_t meshletId = static_cast<uint32_t>(meshlets.size());
+                uint32_t meshletVertices = 0;
+                for (uint32_t i = lod.firstIndex; i + 2 < lod.firstIndex + lod.indexCount; i += 3) {
+                    const uint32_t corners[3] = { indices[i], indices[i + 1], indices[i + 2] };
+                    uint32_t newVertices = 0;
+                    for (int c = 0; c < 3; c++) {
+                        bool repeated = (c > 0 && corners[c] == corners[0]) || (c > 1 && corners[c] == corners[1]);
+                        if (pieceStamps[corners[c]] != meshletId && !repeated) newVertices++;
+                    }
+                    if (meshletVertices + newVertices > MAX_MESHLET_VERTICES ||
+                        meshlet.indexCount == MAX_MESHLET_TRIANGLES * 3) {
+                        finishMeshlet(meshlet, pieceVertices);
+                        meshlets.push_back(meshlet);
+                        meshlet = Meshlet{};
+                        meshlet.firstIndex = i;
+                        meshletId++;
+                        meshletVertices = 0;
+                    }
+
+                    for (uint32_t vertex : corners) {
+                        if (pieceStamps[vertex] != meshletId) {
+                            pieceStamps[vertex] = meshletId;
+                            meshletVertices++;
+                        }
+                    }
+                    meshlet.indexCount += 3;
+                }
+                if (meshlet.indexCount > 0) {
+                    finishMeshlet(meshlet, pieceVertices);
+                    meshlets.push_back(meshlet);
+                }
+            }
+            range.meshletCount = static_cast<uint32_t>(meshlets.size()) - range.firstMeshlet;
+            meshletLods.push_back(range);
+        }
+    }
+
     void MModel::Builder::loadModel(const std::string& filepath) {
+        M_TRACE_ZONE("MModel::Builder::loadModel");
+        std::string cachePath = MMeshCache::cachePathFor(filepath);
+
+        uint64_t sourceHash;
+        if (!MMeshCache::hashFile(filepath, sourceHash)) {
+            // no source to check against, a cooked mesh on its own is fine
+            if (MMeshCache::load(cachePath, nullptr, *this)) {
+                return;
+            }
+            throw std::runtime_error("failed to open model: " + filepath);
+        }
+
+        if (MMeshCache::load(cachePath, &sourceHash, *this)) {
+            return;
+        }
+
+        loadObj(filepath);
+        MMeshOptimizer::Report report = MMeshOptimizer::optimize(*this);
+        std::cout << "optimized " << filepath << ": ACMR " << report.before.acmr << " -> " << report.after.acmr
+            << ", ATVR " << report.before.atvr << " -> " << report.after.atvr << std::endl;
+        buildMeshlets();
+        MMeshCache::write(cachePath, sourceHash, *this);
+    }
+
+    static MModel::Vertex readVertex(const tinyobj::attrib_t& attrib, const tinyobj::index_t& index) {
+        MModel::Vertex vertex{};
+
+        if (index.vertex_index >= 0) {
+            vertex.position = {
+                attrib.vertices[3 * index.vertex_index + 0],
+                attrib.vertices[3 * index.vertex_index + 1],
+                attrib.vertices[3 * index.vertex_index + 2],
+            };
+
+            vertex.color = {
+                attrib.colors[3 * index.vertex_index + 0],
+                attrib.colors[3 * index.vertex_index + 1],
+                attrib.colors[3 * index.vertex_index + 2],
+            };
+        }
+
+        if (index.normal_index >= 0) {
+            vertex.normal = {
+                attrib.normals[3 * index.normal_index + 0],
+                attrib.normals[3 * index.normal_index + 1],
+                attrib.normals[3 * index.normal_index + 2],
+            };
+        }
+
+        if (index.texcoord_index >= 0) {
+            vertex.uv = {
+                attrib.texcoords[2 * index.texcoord_index + 0],
+                attrib.texcoords[2 * index.texcoord_index + 1],
+            };
+        }
+
+        return vertex;
+    }
+
+    // a run of face indices from one shape, deduplicated on its own before the merge
+    struct ObjChunk {
+        const std::vector<tinyobj::index_t>* sourceIndices;
+        size_t begin;
+        size_t end;
+
+        std::vector<MModel::Vertex> vertices{};  // in order of first use within the chunk
+        std::vector<size_t> hashes{};
+        std::vector<uint32_t> indices{};  // into vertices above
+        std::vector<uint32_t> remap{};  // chunk vertex -> model vertex
+        size_t indexOffset = 0;
+    };
+
+    // lets the merge reuse the hashes computed on the workers
+    struct HashedVertex {
+        const MModel::Vertex* vertex;
+        size_t hash;
+
+        bool operator==(const HashedVertex& other) const { return *vertex == *other.vertex; }
+    };
+
+    struct HashedVertexHasher {
+        size_t operator()(const HashedVertex& key) const { return key.hash; }
+    };
+
+    void MModel::Builder::loadObj(const std::string& filepath) {
         tinyobj::attrib_t attrib;
         std::vector<tinyobj::shape_t> shapes;
         std::vector<tinyobj::material_t> materials;
         std::string warn, err;
 
-        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str())) {
-            throw std::runtime_error(warn + err);
+        M_TRACE_ZONE("MModel::Builder::loadObj");
+        {
+            M_TRACE_ZONE("tinyobj::LoadObj");
+            if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str())) {
+                throw std::runtime_error(warn + err);
+            }
         }
 
         vertices.clear();
         indices.clear();
-
-        std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+        lods.clear();
+        submeshes.clear();
+        meshlets.clear();
+        meshletLods.clear();
+        mapping.reset();
+
+        // shapes are independent, and big ones are cut up further so a single mesh still spreads
+        // over the workers
+        std::vector<ObjChunk> chunks;
         for (const auto& shape : shapes) {
-            for (const auto& index : shape.mesh.indices) {
-                Vertex vertex{};
-
-                if (index.vertex_index >= 0) {
-                    vertex.position = {
-                        attrib.vertices[3 * index.vertex_index + 0],
-                        attrib.vertices[3 * index.vertex_index + 1],
-                        attrib.vertices[3 * index.vertex_index + 2],
-                    };
-
-                    vertex.color = {
-                        attrib.colors[3 * index.vertex_index + 0],
-                        attrib.colors[3 * index.vertex_index + 1],
-                        attrib.colors[3 * index.vertex_index + 2],
-                    };
-                }
+            const auto& shapeIndices = shape.mesh.indices;
+            for (size_t begin = 0; begin < shapeIndices.size(); begin += OBJ_CHUNK_SIZE) {
+                ObjChunk chunk{};
+                chunk.sourceIndices = &shapeIndices;
+                chunk.begin = begin;
+                chunk.end = std::min(begin + OBJ_CHUNK_SIZE, shapeIndices.size());
+                chunks.push_back(std::move(chunk));
+            }
+        }
 
-                if (index.normal_index >= 0) {
-                    vertex.normal = {
-                        attrib.normals[3 * index.normal_index + 0],
-                        attrib.normals[3 * index.normal_index + 1],
-                        attrib.normals[3 * index.normal_index + 2],
-                    };
+        MJobSystem& jobSystem = MJobSystem::shared();
+        jobSystem.parallelFor(chunks.size(), 1, [&](size_t first, size_t last) {
+            M_TRACE_ZONE("loadObj dedup chunks");
+            for (size_t c = first; c < last; c++) {
+                ObjChunk& chunk = chunks[c];
+                std::unordered_map<MModel::Vertex, uint32_t> uniqueVertices{};
+                chunk.indices.reserve(chunk.end - chunk.begin);
+
+                for (size_t i = chunk.begin; i < chunk.end; i++) {
+                    Vertex vertex = readVertex(attrib, (*chunk.sourceIndices)[i]);
+                    auto found = uniqueVertices.find(vertex);
+                    if (found == uniqueVertices.end()) {
+                        found = uniqueVertices.emplace(vertex, static_cast<uint32_t>(chunk.vertices.size())).first;
+                        chunk.vertices.push_back(vertex);
+                        chunk.hashes.push_back(uniqueVertices.hash_function()(vertex));
+                    }
+                    chunk.indices.push_back(found->second);
                 }
-
-                if (index.texcoord_index >= 0) {
-                    vertex.uv = {
-                        attrib.texcoords[2 * index.texcoord_index + 0],
-                        attrib.texcoords[2 * index.texcoord_index + 1],
-                    };
+            }
+        });
+
+        // walking the chunks in file order and their vertices in order of first use hands out
+        // the same indices as deduplicating the whole file in one pass
+        M_TRACE_ZONE("loadObj merge chunks");
+        std::unordered_map<HashedVertex, uint32_t, HashedVertexHasher> uniqueVertices{};
+        size_t indexTotal = 0;
+        for (auto& chunk : chunks) {
+            chunk.remap.resize(chunk.vertices.size());
+            for (size_t v = 0; v < chunk.vertices.size(); v++) {
+                HashedVertex key{ &chunk.vertices[v], chunk.hashes[v] };
+                auto inserted = uniqueVertices.emplace(key, static_cast<uint32_t>(vertices.size()));
+                if (inserted.second) {
+                    vertices.push_back(chunk.vertices[v]);
                 }
+                chunk.remap[v] = inserted.first->second;
+            }
+            chunk.indexOffset = indexTotal;
+            indexTotal += chunk.indices.size();
+        }
 
-                if (uniqueVertices.count(vertex) == 0) {
-                    uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                    vertices.push_back(vertex);
+        indices.resize(indexTotal);
+        jobSystem.parallelFor(chunks.size(), 1, [&](size_t first, size_t last) {
+            for (size_t c = first; c < last; c++) {
+                const ObjChunk& chunk = chunks[c];
+                for (size_t i = 0; i < chunk.indices.size(); i++) {
+                    indices[chunk.indexOffset + i] = chunk.remap[chunk.indices[i]];
                 }
-                indices.push_back(uniqueVertices[vertex]);
             }
-        }
+        });
+
+        bounds = computeBounds();
+        splitSubmeshes();
+        generateLods();
     }
 
 }
\ No newline at end of file
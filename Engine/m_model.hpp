@@ -2,6 +2,7 @@
 
 #include "m_buffer.hpp"
 #include "m_device.hpp"
+#include "m_mapped_file.hpp"
 
 // libs
 #define GLM_FORCE_RADIANS
@@ -9,10 +10,20 @@
 #include <glm/glm.hpp>
 
 // std
+#include <cstdint>
 #include <memory>
 #include <vector>
 
+// the layout of the vertex buffers, picked at compile time. 0 uploads MModel::Vertex as it is, 1
+// packs it into MModel::CompactVertex. the vertex shaders are built once per format, see
+// compile.bat, and the pipelines load the ones matching it
+#ifndef MOCHA_VERTEX_FORMAT
+#define MOCHA_VERTEX_FORMAT 0
+#endif
+
 namespace m {
+	class MMeshPool;
+
 	class MModel
 	{
 	public:
@@ -31,28 +42,191 @@ namespace m {
 			}
 		};
 
+		// 20 bytes to Vertex's 44. the position is snorm16 across the cube around the mesh's
+		// bounds, which the matrix from positionMatrix maps back, the normal is octahedral snorm16,
+		// the color unorm8 and the uv half floats
+		struct CompactVertex {
+			uint32_t position[2];  // xy, then z and an unused w
+			uint32_t normal;
+			uint32_t color;  // alpha unused
+			uint32_t uv;
+
+			// positionDecode is the model's, see getPositionDecode
+			static CompactVertex pack(const Vertex& vertex, const glm::mat4& positionDecode);
+
+			static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
+			static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+		};
+
+#if MOCHA_VERTEX_FORMAT == 1
+		using GpuVertex = CompactVertex;
+		static constexpr const char* VERTEX_SHADER_SUFFIX = "_compact.vert.spv";
+#else
+		using GpuVertex = Vertex;
+		static constexpr const char* VERTEX_SHADER_SUFFIX = ".vert.spv";
+#endif
+
+		// local space bounding box and the sphere around its center that holds every vertex
+		struct Bounds {
+			glm::vec3 min{ 0.f };
+			glm::vec3 max{ 0.f };
+			glm::vec3 center{ 0.f };
+			float radius = -1.f;  // negative until computed
+
+			bool isValid() const { return radius >= 0.f; }
+		};
+
+		// a run of the index buffer drawing the whole mesh at one level of detail. LOD 0 is the
+		// mesh as imported and each one after it is coarser, error is how far its surface may be
+		// from LOD 0's in model units
+		struct Lod {
+			uint32_t firstIndex = 0;
+			uint32_t indexCount = 0;
+			float error = 0.f;
+		};
+
+		static constexpr uint32_t MAX_LODS = 8;
+		// each LOD aims for this fraction of the triangles of the one before it
+		static constexpr float LOD_REDUCTION = .5f;
+		// the chain stops at a LOD that keeps more than this fraction, at one with fewer than
+		// LOD_MIN_TRIANGLES triangles, or once the error would pass LOD_MAX_ERROR of the
+		// bounding radius
+		static constexpr float LOD_MIN_REDUCTION = .8f;
+		static constexpr uint32_t LOD_MIN_TRIANGLES = 64;
+		static constexpr float LOD_MAX_ERROR = .25f;
+
+		// a piece of a mesh with few enough vertices for 16 bit indices, which count from
+		// firstVertex. a piece has a range within each of the mesh's LODs
+		struct Submesh {
+			uint32_t firstVertex = 0;
+			uint32_t vertexCount = 0;
+			Lod lods[MAX_LODS]{};
+		};
+
+		static constexpr uint32_t MAX_SUBMESH_VERTICES = 65536;
+
+		// a run of a LOD's triangles small enough for the GPU to cull on its own. the sphere holds
+		// the triangles, and they all face away from a camera at eye when
+		// dot(center - eye, axis) >= cutoff * length(center - eye) + radius
+		struct Meshlet {
+			glm::vec4 boundingSphere;  // center, radius in w
+			glm::vec4 cone;  // axis, cutoff in w. 1 when the normals spread too far for the test
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			uint32_t padding[2];
+		};
+
+		// the meshlets of a LOD, which follow each other
+		struct MeshletRange {
+			uint32_t firstMeshlet = 0;
+			uint32_t meshletCount = 0;
+		};
+
+		static constexpr uint32_t MAX_MESHLET_VERTICES = 64;
+		static constexpr uint32_t MAX_MESHLET_TRIANGLES = 124;
+
 		struct Builder {
 			std::vector<Vertex> vertices{};
 			std::vector<uint32_t> indices{};
+			Bounds bounds{};
+			// ranges of indices, empty when they are all LOD 0
+			std::vector<Lod> lods{};
+			// empty when the mesh is a single piece, otherwise the LODs are laid out level by level
+			// with the pieces in order within each
+			std::vector<Submesh> submeshes{};
+			// empty until buildMeshlets, then meshletLods has a range for every LOD
+			std::vector<Meshlet> meshlets{};
+			std::vector<MeshletRange> meshletLods{};
+
+			// set when the mesh came out of a cache file, the arrays are then read straight from
+			// the mapping and the vectors above stay empty
+			std::shared_ptr<MMappedFile> mapping{};
+			const Vertex* mappedVertices = nullptr;
+			const uint32_t* mappedIndices = nullptr;
+			uint32_t mappedVertexCount = 0;
+			uint32_t mappedIndexCount = 0;
+
+			const Vertex* vertexData() const { return mapping ? mappedVertices : vertices.data(); }
+			const uint32_t* indexData() const { return mapping ? mappedIndices : indices.data(); }
+			uint32_t vertexCount() const {
+				return mapping ? mappedVertexCount : static_cast<uint32_t>(vertices.size());
+			}
+			uint32_t indexCount() const {
+				return mapping ? mappedIndexCount : static_cast<uint32_t>(indices.size());
+			}
 
+			// uses the mesh cache next to filepath when it is current, otherwise imports and
+			// optimizes the OBJ and writes the cache for next time
 			void loadModel(const std::string& filepath);
+			void loadObj(const std::string& filepath);
+
+			// the loaders fill in bounds, builders filled by hand can leave it to the MModel
+			Bounds computeBounds() const;
+			// cuts a mesh with more than MAX_SUBMESH_VERTICES vertices into submeshes, copying the
+			// vertices on the cuts. call it before generateLods, which keeps the cuts in place
+			void splitSubmeshes();
+			// simplifies every piece into a chain of coarser LODs appended after the indices.
+			// loadObj calls both, a mapped mesh was cooked with them and is left alone
+			void generateLods();
+			// cuts every LOD of every submesh into meshlets in the order of its indices, so it
+			// comes after MMeshOptimizer::optimize. loadModel calls it and the mesh cache keeps them
+			void buildMeshlets();
+			// submeshes, or a single piece covering the whole mesh when there are none
+			std::vector<Submesh> getSubmeshes() const;
 		};
 
-		MModel(MDevice& device, const MModel::Builder& builder);
+		// face indices per parallel work item when importing an OBJ
+		static constexpr size_t OBJ_CHUNK_SIZE = 64 * 1024;
+
+		// with a mesh pool the geometry is packed into its shared buffers instead of buffers of
+		// the model's own, which GPU driven rendering needs
+		MModel(MDevice& device, const MModel::Builder& builder, MMeshPool* meshPool = nullptr);
 		~MModel();
 
 		MModel(const MModel&) = delete;
 		MModel& operator=(const MModel&) = delete;
 
 		static std::unique_ptr<MModel> createModelFromFile(
-			MDevice& device, const std::string& filepath);
+			MDevice& device, const std::string& filepath, MMeshPool* meshPool = nullptr);
+		// loads the files side by side on the job system, models come back in the order given
+		static std::vector<std::unique_ptr<MModel>> createModelsFromFiles(
+			MDevice& device, const std::vector<std::string>& filepaths, MMeshPool* meshPool = nullptr);
+
+		// false until the upload of the vertex and index data has landed on the GPU
+		bool isReady();
+
+		const Bounds& getBounds() const { return bounds; }
+		// from the positions in the vertex buffer to model space, a uniform scale and a
+		// translation. the identity unless the vertex format quantizes positions
+		const glm::mat4& getPositionDecode() const { return positionDecode; }
+		// what the vertex shaders take as their model matrix
+		glm::mat4 positionMatrix(const glm::mat4& modelMatrix) const {
+#if MOCHA_VERTEX_FORMAT == 1
+			return modelMatrix * positionDecode;
+#else
+			return modelMatrix;
+#endif
+		}
+		uint32_t getLodCount() const { return static_cast<uint32_t>(lods.size()); }
+		uint32_t getSubmeshCount() const { return static_cast<uint32_t>(submeshes.size()); }
+		VkIndexType getIndexType() const { return indexType; }
+		const Lod& getLod(uint32_t lod) const { return lods[lod]; }
+		uint32_t getMeshletCount(uint32_t lod) const {
+			return lod < meshletLods.size() ? meshletLods[lod].meshletCount : 0;
+		}
+
+		bool isPooled() const { return meshPool != nullptr; }
+		// index of the mesh in its pool, only meaningful when pooled
+		uint32_t getMeshId() const { return meshId; }
 
 		void bind(VkCommandBuffer commandBuffer);
-		void draw(VkCommandBuffer commandBuffer);
+		void draw(
+			VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0, uint32_t lod = 0);
 
 	private:
-		void createVertexBuffers(const std::vector<Vertex>& vertices);
-		void createIndexBuffers(const std::vector<uint32_t>& indices);
+		void createVertexBuffers(const GpuVertex* vertices, uint32_t count);
+		// 16 bit when every submesh allows it and the model has buffers of its own
+		void createIndexBuffers(const uint32_t* indices, uint32_t count);
 
 		MDevice& mDevice;
 
@@ -62,5 +236,20 @@ namespace m {
 		bool hasIndexBuffer = false;
 		std::unique_ptr<MBuffer> indexBuffer;
 		uint32_t indexCount;
+		VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+
+		uint64_t uploadToken = 0;
+		bool ready = false;
+
+		Bounds bounds{};
+		std::vector<Lod> lods;
+		std::vector<Submesh> submeshes;
+		std::vector<MeshletRange> meshletLods;
+		glm::mat4 positionDecode{ 1.f };
+
+		MMeshPool* meshPool = nullptr;
+		uint32_t meshId = 0;
+		uint32_t firstIndex = 0;
+		int32_t vertexOffset = 0;
 	};
 }
\ No newline at end of file
@@ -18,10 +18,18 @@ namespace m {
         createGraphicsPipeline(vertFilepath, fragFilepath, configInfo);
     }
 
+    MPipeline::MPipeline(
+        MDevice& device, const std::string& compFilepath, VkPipelineLayout pipelineLayout)
+        : mDevice{ device }, bindPoint{ VK_PIPELINE_BIND_POINT_COMPUTE } {
+        createComputePipeline(compFilepath, pipelineLayout);
+    }
+
     MPipeline::~MPipeline() {
+        // null handles are ignored, a pipeline only has the modules of its own stages
         vkDestroyShaderModule(mDevice.device(), vertShaderModule, nullptr);
         vkDestroyShaderModule(mDevice.device(), fragShaderModule, nullptr);
-        vkDestroyPipeline(mDevice.device(), graphicsPipeline, nullptr);
+        vkDestroyShaderModule(mDevice.device(), compShaderModule, nullptr);
+        vkDestroyPipeline(mDevice.device(), pipeline, nullptr);
     }
 
     std::vector<char> MPipeline::readFile(const std::string& filepath) {
@@ -106,15 +114,48 @@ namespace m {
 
         if (vkCreateGraphicsPipelines(
             mDevice.device(),
-            VK_NULL_HANDLE,
+            mDevice.pipelineCache(),
             1,
             &pipelineInfo,
             nullptr,
-            &graphicsPipeline) != VK_SUCCESS) {
+            &pipeline) != VK_SUCCESS) {
             throw std::runtime_error("Failed to create graphics pipeline");
         }
     }
 
+    void MPipeline::createComputePipeline(
+        const std::string& compFilepath, VkPipelineLayout pipelineLayout) {
+        assert(
+            pipelineLayout != VK_NULL_HANDLE &&
+            "Cannot create compute pipeline: no pipelineLayout provided");
+
+        auto compCode = readFile(compFilepath);
+        createShaderModule(compCode, &compShaderModule);
+
+        VkPipelineShaderStageCreateInfo shaderStage{};
+        shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        shaderStage.module = compShaderModule;
+        shaderStage.pName = "main";
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage = shaderStage;
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.basePipelineIndex = -1;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+        if (vkCreateComputePipelines(
+            mDevice.device(),
+            mDevice.pipelineCache(),
+            1,
+            &pipelineInfo,
+            nullptr,
+            &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create compute pipeline");
+        }
+    }
+
     void MPipeline::createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule) {
         VkShaderModuleCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -127,7 +168,7 @@ namespace m {
     }
 
     void MPipeline::bind(VkCommandBuffer commandBuffer) {
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+        vkCmdBindPipeline(commandBuffer, bindPoint, pipeline);
     }
 
     void MPipeline::defaultPipelineConfigInfo(PipelineConfigInfo& configInfo) {
@@ -200,8 +241,8 @@ namespace m {
         static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
         configInfo.dynamicStateInfo.flags = 0;
 
-        configInfo.bindingDescriptions = MModel::Vertex::getBindingDescriptions();
-        configInfo.attributeDescriptions = MModel::Vertex::getAttributeDescriptions();
+        configInfo.bindingDescriptions = MModel::GpuVertex::getBindingDescriptions();
+        configInfo.attributeDescriptions = MModel::GpuVertex::getAttributeDescriptions();
     }
 
     void MPipeline::enableAlphaBlending(PipelineConfigInfo& configInfo) {
@@ -29,6 +29,8 @@ namespace m {
 	class MPipeline {
 	public:
 		MPipeline(MDevice &device, const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo& configInfo);
+		// compute pipeline
+		MPipeline(MDevice& device, const std::string& compFilepath, VkPipelineLayout pipelineLayout);
 		~MPipeline();
 
 		MPipeline(const MPipeline&) = delete;
@@ -47,11 +49,15 @@ namespace m {
 			const std::string& fragFilepath,
 			const PipelineConfigInfo& configInfo);
 
+		void createComputePipeline(const std::string& compFilepath, VkPipelineLayout pipelineLayout);
+
 		void createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule);
 
 		MDevice& mDevice;
-		VkPipeline graphicsPipeline;
-		VkShaderModule vertShaderModule;
-		VkShaderModule fragShaderModule;
+		VkPipeline pipeline;
+		VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		VkShaderModule vertShaderModule = VK_NULL_HANDLE;
+		VkShaderModule fragShaderModule = VK_NULL_HANDLE;
+		VkShaderModule compShaderModule = VK_NULL_HANDLE;
 	};
 }
\ No newline at end of file
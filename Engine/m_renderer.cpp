@@ -1,5 +1,9 @@
 #include "m_renderer.hpp"
 
+#include "m_job_system.hpp"
+#include "m_trace.hpp"
+#include "m_upload_manager.hpp"
+
 // std
 #include <array>
 #include <cassert>
@@ -11,9 +15,18 @@ namespace m {
         : mWindow{ window }, mDevice{ device } {
         recreateSwapChain();
         createCommandBuffers();
+        createSecondaryPools();
+    }
+
+    MRenderer::~MRenderer() {
+        destroySecondaryPools();
+        freeCommandBuffers();
     }
 
-    MRenderer::~MRenderer() { freeCommandBuffers(); }
+    void MRenderer::finishFrames() {
+        vkDeviceWaitIdle(mDevice.device());
+        mSwapChain->drainReadbacks();
+    }
 
     void MRenderer::recreateSwapChain() {
         auto extent = mWindow.getExtent();
@@ -60,8 +73,81 @@ namespace m {
         commandBuffers.clear();
     }
 
+    void MRenderer::createSecondaryPools() {
+        recordingSlotCount = MJobSystem::shared().workerCount() + 1;
+        secondaryPools.resize(MSwapChain::MAX_FRAMES_IN_FLIGHT * recordingSlotCount);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = mDevice.getGraphicsQueueFamily();
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        for (auto& pool : secondaryPools) {
+            if (vkCreateCommandPool(mDevice.device(), &poolInfo, nullptr, &pool.commandPool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create secondary command pool!");
+            }
+        }
+    }
+
+    void MRenderer::destroySecondaryPools() {
+        // destroying a pool frees its command buffers
+        for (auto& pool : secondaryPools) {
+            vkDestroyCommandPool(mDevice.device(), pool.commandPool, nullptr);
+        }
+        secondaryPools.clear();
+    }
+
+    VkCommandBuffer MRenderer::beginSecondaryCommandBuffer(uint32_t slot) {
+        assert(isFrameStarted && "Can't begin a secondary command buffer if frame is not in progress");
+        assert(slot < recordingSlotCount && "Recording slot out of range");
+
+        SecondaryPool& pool = secondaryPools[currentFrameIndex * recordingSlotCount + slot];
+        if (pool.usedCount == pool.commandBuffers.size()) {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandPool = pool.commandPool;
+            allocInfo.commandBufferCount = 1;
+
+            VkCommandBuffer commandBuffer;
+            if (vkAllocateCommandBuffers(mDevice.device(), &allocInfo, &commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate secondary command buffer!");
+            }
+            pool.commandBuffers.push_back(commandBuffer);
+        }
+        VkCommandBuffer commandBuffer = pool.commandBuffers[pool.usedCount++];
+
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = mSwapChain->getRenderPass();
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = mSwapChain->getFrameBuffer(currentImageIndex);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags =
+            VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording secondary command buffer!");
+        }
+
+        // dynamic state isn't inherited from the primary buffer
+        setViewportAndScissor(commandBuffer);
+        return commandBuffer;
+    }
+
+    void MRenderer::endSecondaryCommandBuffer(VkCommandBuffer commandBuffer) {
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record secondary command buffer!");
+        }
+    }
+
     VkCommandBuffer MRenderer::beginFrame() {
         assert(!isFrameStarted && "Can't call beginFrame while already in progress");
+        M_TRACE_ZONE("MRenderer::beginFrame");
+
+        // models created since the last frame get their uploads kicked off here
+        mDevice.getUploadManager().flush();
 
         auto result = mSwapChain->acquireNextImage(&currentImageIndex);
         if (result == VK_ERROR_OUT_OF_DATE_KHR) {
@@ -75,6 +161,15 @@ namespace m {
 
         isFrameStarted = true;
 
+        // the frame's fence was waited on in acquireNextImage, so its secondary buffers are done
+        for (uint32_t slot = 0; slot < recordingSlotCount; slot++) {
+            SecondaryPool& pool = secondaryPools[currentFrameIndex * recordingSlotCount + slot];
+            if (pool.usedCount > 0) {
+                vkResetCommandPool(mDevice.device(), pool.commandPool, 0);
+                pool.usedCount = 0;
+            }
+        }
+
         auto commandBuffer = getCurrentCommandBuffer();
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -87,7 +182,11 @@ namespace m {
 
     void MRenderer::endFrame() {
         assert(isFrameStarted && "Can't call endFrame while frame is not in progress");
+        M_TRACE_ZONE("MRenderer::endFrame");
         auto commandBuffer = getCurrentCommandBuffer();
+        if (mSwapChain->isHeadless()) {
+            mSwapChain->recordReadback(commandBuffer, currentImageIndex);
+        }
         if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
             throw std::runtime_error("failed to record command buffer!");
         }
@@ -106,7 +205,7 @@ namespace m {
         currentFrameIndex = (currentFrameIndex + 1) % MSwapChain::MAX_FRAMES_IN_FLIGHT;
     }
 
-    void MRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
+    void MRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents) {
         assert(isFrameStarted && "Can't call beginSwapChainRenderPass if frame is not in progress");
         assert(
             commandBuffer == getCurrentCommandBuffer() &&
@@ -126,8 +225,13 @@ namespace m {
         renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
         renderPassInfo.pClearValues = clearValues.data();
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+        if (contents == VK_SUBPASS_CONTENTS_INLINE) {
+            setViewportAndScissor(commandBuffer);
+        }
+    }
 
+    void MRenderer::setViewportAndScissor(VkCommandBuffer commandBuffer) {
         VkViewport viewport{};
         viewport.x = 0.0f;
         viewport.y = 0.0f;
@@ -20,8 +20,17 @@ namespace m {
 
         VkRenderPass getSwapChainRenderPass() const { return mSwapChain->getRenderPass(); }
         float getAspectRatio() const { return mSwapChain->extentAspectRatio(); }
+        VkExtent2D getSwapChainExtent() const { return mSwapChain->getSwapChainExtent(); }
         uint32_t getImageCount() const { return mSwapChain->imageCount(); }
         bool isFrameInProgress() const { return isFrameStarted; }
+        bool isHeadless() const { return mSwapChain->isHeadless(); }
+
+        // headless only, see MSwapChain::setReadbackCallback
+        void setReadbackCallback(MSwapChain::ReadbackCallback callback) {
+            mSwapChain->setReadbackCallback(std::move(callback));
+        }
+        // waits for the device to go idle and hands out any frames still being read back
+        void finishFrames();
 
         VkCommandBuffer getCurrentCommandBuffer() const {
             assert(isFrameStarted && "Cannot get command buffer when frame not in progress");
@@ -35,19 +44,46 @@ namespace m {
 
         VkCommandBuffer beginFrame();
         void endFrame();
-        void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
+        // with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS everything drawn in the pass has to
+        // come from beginSecondaryCommandBuffer
+        void beginSwapChainRenderPass(
+            VkCommandBuffer commandBuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
         void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
 
+        // Every recording slot has its own command pool per frame in flight, so slots can record
+        // on different threads at once. There is a slot per MJobSystem::threadIndex() of the
+        // shared job system: slot 0 for the thread that records the primary buffer and one per
+        // worker. A slot must only be used by one thread at a time.
+        uint32_t getRecordingSlotCount() const { return recordingSlotCount; }
+
+        // begins a secondary command buffer that continues the swap chain render pass, with the
+        // viewport and scissor already set. it's only valid for the current frame, end it with
+        // endSecondaryCommandBuffer and run it with vkCmdExecuteCommands on the primary buffer
+        VkCommandBuffer beginSecondaryCommandBuffer(uint32_t slot);
+        void endSecondaryCommandBuffer(VkCommandBuffer commandBuffer);
+
     private:
+        struct SecondaryPool {
+            VkCommandPool commandPool = VK_NULL_HANDLE;
+            std::vector<VkCommandBuffer> commandBuffers;  // kept across frames, reset with the pool
+            uint32_t usedCount = 0;
+        };
+
         void createCommandBuffers();
         void freeCommandBuffers();
+        void createSecondaryPools();
+        void destroySecondaryPools();
         void recreateSwapChain();
+        void setViewportAndScissor(VkCommandBuffer commandBuffer);
 
         MWindow& mWindow;
         MDevice& mDevice;
         std::unique_ptr<MSwapChain> mSwapChain;
         std::vector<VkCommandBuffer> commandBuffers;
 
+        uint32_t recordingSlotCount = 0;
+        std::vector<SecondaryPool> secondaryPools;  // frame index * recordingSlotCount + slot
+
         uint32_t currentImageIndex;
         int currentFrameIndex = 0;
         bool isFrameStarted = false;
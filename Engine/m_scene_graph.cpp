@@ -0,0 +1,183 @@
+#include "m_scene_graph.hpp"
+
+#include "m_job_system.hpp"
+#include "m_trace.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+
+namespace m {
+
+    MSceneGraph::MSceneGraph(MRegistry& registry) : registry{ registry } {}
+
+    void MSceneGraph::setParent(MEntity child, MEntity parent) {
+        assert(registry.has<TransformComponent>(child) && "Scene graph entities need a transform");
+        assert((parent.isNull() || registry.has<TransformComponent>(parent)) &&
+            "Scene graph entities need a transform");
+        if (getParent(child) == parent) {
+            return;
+        }
+#ifndef NDEBUG
+        for (MEntity ancestor = parent; !ancestor.isNull(); ancestor = getParent(ancestor)) {
+            assert(ancestor != child && "Parenting an entity to its own descendant");
+        }
+#endif
+
+        MEntity oldParent = getParent(child);
+        link(child).parent = parent;
+        if (!oldParent.isNull()) {
+            links[oldParent.index].childCount--;
+            unlinkIfUnused(oldParent);
+        }
+        if (!parent.isNull()) {
+            link(parent).childCount++;
+        }
+        unlinkIfUnused(child);
+
+        // the cached matrix may be a world matrix under the old parent
+        registry.get<TransformComponent>(child).invalidate();
+        structureChanged = true;
+    }
+
+    MEntity MSceneGraph::getParent(MEntity entity) const {
+        if (entity.index >= links.size() || links[entity.index].entity != entity) {
+            return MEntity{};
+        }
+        return links[entity.index].parent;
+    }
+
+    void MSceneGraph::remove(MEntity entity) {
+        if (entity.index >= links.size() || links[entity.index].entity != entity) {
+            return;
+        }
+        for (Link& other : links) {
+            if (!other.entity.isNull() && other.parent == entity) {
+                setParent(other.entity, MEntity{});
+            }
+        }
+        setParent(entity, MEntity{});
+    }
+
+    MSceneGraph::Link& MSceneGraph::link(MEntity entity) {
+        if (entity.index >= links.size()) {
+            links.resize(entity.index + 1);
+        }
+        Link& result = links[entity.index];
+        if (result.entity != entity) {
+            result = Link{};
+            result.entity = entity;
+        }
+        return result;
+    }
+
+    void MSceneGraph::unlinkIfUnused(MEntity entity) {
+        Link& unused = links[entity.index];
+        if (unused.parent.isNull() && unused.childCount == 0) {
+            unused = Link{};
+        }
+    }
+
+    void MSceneGraph::rebuild() {
+        M_TRACE_ZONE("MSceneGraph::rebuild");
+        constexpr uint32_t UNKNOWN_DEPTH = UINT32_MAX;
+
+        // depth of every linked entity, walking up until an ancestor with a known depth
+        std::vector<uint32_t> depths(links.size(), UNKNOWN_DEPTH);
+        std::vector<uint32_t> path;
+        uint32_t maxDepth = 0;
+        for (uint32_t index = 0; index < links.size(); index++) {
+            if (links[index].entity.isNull() || depths[index] != UNKNOWN_DEPTH) continue;
+
+            path.clear();
+            uint32_t current = index;
+            while (depths[current] == UNKNOWN_DEPTH && !links[current].parent.isNull()) {
+                path.push_back(current);
+                current = links[current].parent.index;
+            }
+            if (depths[current] == UNKNOWN_DEPTH) {
+                depths[current] = 0;
+            }
+            uint32_t depth = depths[current];
+            for (auto it = path.rbegin(); it != path.rend(); ++it) {
+                depths[*it] = ++depth;
+            }
+            maxDepth = std::max(maxDepth, depth);
+        }
+
+        // counting sort by depth
+        levelOffsets.assign(maxDepth + 2, 0);
+        for (uint32_t index = 0; index < links.size(); index++) {
+            if (!links[index].entity.isNull()) {
+                levelOffsets[depths[index] + 1]++;
+            }
+        }
+        for (size_t level = 1; level < levelOffsets.size(); level++) {
+            levelOffsets[level] += levelOffsets[level - 1];
+        }
+
+        std::vector<size_t> next(levelOffsets.begin(), levelOffsets.end() - 1);
+        std::vector<uint32_t> nodeIndices(links.size(), NO_PARENT);
+        nodes.resize(levelOffsets.back());
+        for (uint32_t index = 0; index < links.size(); index++) {
+            if (links[index].entity.isNull()) continue;
+            size_t slot = next[depths[index]]++;
+            nodeIndices[index] = static_cast<uint32_t>(slot);
+            nodes[slot].entity = links[index].entity;
+        }
+        for (Node& node : nodes) {
+            const Link& nodeLink = links[node.entity.index];
+            node.parent = nodeLink.parent.isNull() ? NO_PARENT : nodeIndices[nodeLink.parent.index];
+
+            // the transform's cached matrix may be the world one, so the local one is recomputed
+            registry.get<TransformComponent>(node.entity).invalidate();
+            node.version = registry.get<TransformComponent>(node.entity).version - 1;
+        }
+        structureChanged = false;
+    }
+
+    void MSceneGraph::update() {
+        M_TRACE_ZONE("MSceneGraph::update");
+        if (structureChanged) {
+            rebuild();
+        }
+
+        MComponentPool<TransformComponent>& transforms = registry.pool<TransformComponent>();
+        for (size_t level = 0; level + 1 < levelOffsets.size(); level++) {
+            size_t begin = levelOffsets[level];
+            MJobSystem::shared().parallelFor(
+                levelOffsets[level + 1] - begin, GRAIN_SIZE, [&](size_t first, size_t last) {
+                for (size_t i = begin + first; i < begin + last; i++) {
+                    propagate(nodes[i], transforms);
+                }
+            });
+        }
+    }
+
+    void MSceneGraph::propagate(Node& node, MComponentPool<TransformComponent>& transforms) {
+        TransformComponent& transform = transforms.get(node.entity.index);
+
+        // the transform's matrices were recomputed from its own translation, rotation and scale
+        // after any change, so they are the local ones
+        bool localChanged = transform.version != node.version;
+        if (localChanged) {
+            node.localMatrix = transform.mat4();
+            node.localNormal = transform.normalMatrix();
+            node.version = transform.version;
+        }
+
+        if (node.parent == NO_PARENT) {
+            node.changed = localChanged;
+            return;
+        }
+        const Node& parentNode = nodes[node.parent];
+        node.changed = localChanged || parentNode.changed;
+        if (node.changed) {
+            const TransformComponent& parent = transforms.get(parentNode.entity.index);
+            transform.worldMatrix = parent.worldMatrix * node.localMatrix;
+            transform.normal = parent.normal * node.localNormal;
+            transform.dirty = false;
+        }
+    }
+
+}
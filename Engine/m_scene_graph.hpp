@@ -0,0 +1,75 @@
+#pragma once
+
+#include "m_ecs.hpp"
+#include "m_game_object.hpp"
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace m {
+
+    // Parent and child links between entities' transforms. The linked entities are kept in a flat
+    // array sorted by depth, so one pass front to back sees every parent before its children.
+    // Nodes on the same level don't depend on each other, so each level is split across the job
+    // system. A node is only recomputed when its own transform or one of its ancestors changed.
+    //
+    // update runs after TransformSystem::update, which leaves the local matrices in the
+    // transforms, and replaces them with the world ones. An entity has to be removed from the
+    // graph before it is destroyed.
+    class MSceneGraph {
+    public:
+        static constexpr size_t GRAIN_SIZE = 512;  // nodes per job within a level
+
+        explicit MSceneGraph(MRegistry& registry);
+
+        MSceneGraph(const MSceneGraph&) = delete;
+        MSceneGraph& operator=(const MSceneGraph&) = delete;
+
+        // child's transform becomes relative to parent, a null parent detaches it
+        void setParent(MEntity child, MEntity parent);
+        MEntity getParent(MEntity entity) const;
+
+        // detaches entity from its parent and its children from it, they become roots
+        void remove(MEntity entity);
+
+        void update();
+
+        // entities in the graph as of the last update, roots included
+        size_t size() const { return nodes.size(); }
+
+    private:
+        static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+        struct Link {
+            MEntity entity{};  // null when the entity isn't in the graph
+            MEntity parent{};
+            uint32_t childCount = 0;
+        };
+
+        struct Node {
+            MEntity entity;
+            uint32_t parent;  // index into nodes, parents come first
+            uint32_t version;  // transform version the local matrices were taken at
+            bool changed;  // world matrix recomputed this update
+            glm::mat4 localMatrix;
+            glm::mat3 localNormal;
+        };
+
+        Link& link(MEntity entity);
+        void unlinkIfUnused(MEntity entity);
+        void rebuild();
+        void propagate(Node& node, MComponentPool<TransformComponent>& transforms);
+
+        MRegistry& registry;
+        std::vector<Link> links;  // by entity index
+        bool structureChanged = false;
+
+        std::vector<Node> nodes;
+        std::vector<size_t> levelOffsets;  // nodes of depth d are [levelOffsets[d], levelOffsets[d + 1])
+    };
+}
@@ -1,30 +1,43 @@
 #include "m_swap_chain.hpp"
 
+#include "m_trace.hpp"
+
 // std
 #include <array>
+#include <cassert>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <limits>
+#include <mutex>
 #include <set>
 #include <stdexcept>
 
 namespace m {
 
     MSwapChain::MSwapChain(MDevice& deviceRef, VkExtent2D extent)
-        : device{ deviceRef }, windowExtent{ extent } {
+        : device{ deviceRef }, windowExtent{ extent }, headless{ deviceRef.isHeadless() } {
         init();
     }
 
     MSwapChain::MSwapChain(
         MDevice& deviceRef, VkExtent2D extent, std::shared_ptr<MSwapChain> previous)
-        : device{ deviceRef }, windowExtent{ extent }, oldSwapChain{ previous } {
+        : device{ deviceRef },
+        windowExtent{ extent },
+        oldSwapChain{ previous },
+        headless{ deviceRef.isHeadless() } {
         init();
         oldSwapChain = nullptr;
     }
 
     void MSwapChain::init() {
-        createSwapChain();
+        if (headless) {
+            createOffscreenImages();
+            createReadbackBuffers();
+        }
+        else {
+            createSwapChain();
+        }
         createImageViews();
         createRenderPass();
         createDepthResources();
@@ -43,10 +56,16 @@ namespace m {
             swapChain = nullptr;
         }
 
+        // offscreen images are ours, swap chain images belong to the swap chain
+        for (int i = 0; i < offscreenImageMemorys.size(); i++) {
+            vkDestroyImage(device.device(), swapChainImages[i], nullptr);
+            device.freeMemory(offscreenImageMemorys[i]);
+        }
+
         for (int i = 0; i < depthImages.size(); i++) {
             vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
             vkDestroyImage(device.device(), depthImages[i], nullptr);
-            vkFreeMemory(device.device(), depthImageMemorys[i], nullptr);
+            device.freeMemory(depthImageMemorys[i]);
         }
 
         for (auto framebuffer : swapChainFramebuffers) {
@@ -64,13 +83,26 @@ namespace m {
     }
 
     VkResult MSwapChain::acquireNextImage(uint32_t* imageIndex) {
-        vkWaitForFences(
-            device.device(),
-            1,
-            &inFlightFences[currentFrame],
-            VK_TRUE,
-            std::numeric_limits<uint64_t>::max());
+        M_TRACE_ZONE("MSwapChain::acquireNextImage");
+        {
+            // time spent here is the CPU waiting on the GPU
+            M_TRACE_ZONE("wait for frame fence");
+            vkWaitForFences(
+                device.device(),
+                1,
+                &inFlightFences[currentFrame],
+                VK_TRUE,
+                std::numeric_limits<uint64_t>::max());
+        }
+
+        if (headless) {
+            // one image per frame in flight, so the fence above already guards it
+            deliverReadback(currentFrame);
+            *imageIndex = static_cast<uint32_t>(currentFrame);
+            return VK_SUCCESS;
+        }
 
+        M_TRACE_ZONE("vkAcquireNextImageKHR");
         VkResult result = vkAcquireNextImageKHR(
             device.device(),
             swapChain,
@@ -83,6 +115,7 @@ namespace m {
     }
 
     VkResult MSwapChain::submitCommandBuffers(const VkCommandBuffer* buffers, uint32_t* imageIndex) {
+        M_TRACE_ZONE("MSwapChain::submitCommandBuffers");
         if (imagesInFlight[*imageIndex] != VK_NULL_HANDLE) {
             vkWaitForFences(device.device(), 1, &imagesInFlight[*imageIndex], VK_TRUE, UINT64_MAX);
         }
@@ -90,6 +123,22 @@ namespace m {
 
         VkSubmitInfo submitInfo = {};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submittedFrames++;
+
+        if (headless) {
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = buffers;
+
+            std::lock_guard<std::mutex> lock{ device.getQueueMutex() };
+            vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
+            if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) !=
+                VK_SUCCESS) {
+                throw std::runtime_error("Failed to submit draw command buffer!");
+            }
+
+            currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+            return VK_SUCCESS;
+        }
 
         VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
         VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
@@ -104,6 +153,7 @@ namespace m {
         submitInfo.signalSemaphoreCount = 1;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
+        std::lock_guard<std::mutex> lock{ device.getQueueMutex() };
         vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
         if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) !=
             VK_SUCCESS) {
@@ -122,7 +172,11 @@ namespace m {
 
         presentInfo.pImageIndices = imageIndex;
 
-        auto result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
+        VkResult result;
+        {
+            M_TRACE_ZONE("vkQueuePresentKHR");
+            result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
+        }
 
         currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 
@@ -191,6 +245,148 @@ namespace m {
         swapChainExtent = extent;
     }
 
+    void MSwapChain::createOffscreenImages() {
+        // same format the window path prefers, so pipelines built for either are compatible
+        swapChainImageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+        swapChainExtent = windowExtent;
+
+        swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+        offscreenImageMemorys.resize(MAX_FRAMES_IN_FLIGHT);
+        for (size_t i = 0; i < swapChainImages.size(); i++) {
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent.width = swapChainExtent.width;
+            imageInfo.extent.height = swapChainExtent.height;
+            imageInfo.extent.depth = 1;
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.format = swapChainImageFormat;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.flags = 0;
+
+            device.createImageWithInfo(
+                imageInfo,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                swapChainImages[i],
+                offscreenImageMemorys[i]);
+        }
+    }
+
+    void MSwapChain::createReadbackBuffers() {
+        readbackBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        readbackPending.resize(MAX_FRAMES_IN_FLIGHT, false);
+        readbackFrameNumbers.resize(MAX_FRAMES_IN_FLIGHT, 0);
+        for (auto& buffer : readbackBuffers) {
+            buffer = std::make_unique<MBuffer>(
+                device,
+                4,
+                swapChainExtent.width * swapChainExtent.height,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            buffer->map();
+        }
+    }
+
+    void MSwapChain::recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+        assert(headless && "Only a headless swap chain can read frames back");
+        if (!readbackCallback) return;
+
+        // the render pass already left the image in TRANSFER_SRC_OPTIMAL
+        VkImageMemoryBarrier toTransfer{};
+        toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        toTransfer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        toTransfer.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.image = swapChainImages[imageIndex];
+        toTransfer.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            0,
+            nullptr,
+            0,
+            nullptr,
+            1,
+            &toTransfer);
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { swapChainExtent.width, swapChainExtent.height, 1 };
+        vkCmdCopyImageToBuffer(
+            commandBuffer,
+            swapChainImages[imageIndex],
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            readbackBuffers[currentFrame]->getBuffer(),
+            1,
+            &region);
+
+        VkMemoryBarrier toHost{};
+        toHost.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            0,
+            1,
+            &toHost,
+            0,
+            nullptr,
+            0,
+            nullptr);
+
+        readbackPending[currentFrame] = true;
+        readbackFrameNumbers[currentFrame] = submittedFrames;
+    }
+
+    void MSwapChain::deliverReadback(size_t frame) {
+        if (!headless || !readbackPending[frame]) return;
+        readbackPending[frame] = false;
+        if (!readbackCallback) return;
+
+        MBuffer& buffer = *readbackBuffers[frame];
+        buffer.invalidate();
+
+        FrameImage image{};
+        image.frameNumber = readbackFrameNumbers[frame];
+        image.width = swapChainExtent.width;
+        image.height = swapChainExtent.height;
+        image.format = swapChainImageFormat;
+        image.pixels = static_cast<const uint8_t*>(buffer.getMappedMemory());
+        readbackCallback(image);
+    }
+
+    void MSwapChain::drainReadbacks() {
+        if (!headless) return;
+
+        // oldest first, currentFrame is the next one to be reused
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            size_t frame = (currentFrame + i) % MAX_FRAMES_IN_FLIGHT;
+            vkWaitForFences(
+                device.device(),
+                1,
+                &inFlightFences[frame],
+                VK_TRUE,
+                std::numeric_limits<uint64_t>::max());
+            deliverReadback(frame);
+        }
+    }
+
     void MSwapChain::createImageViews() {
         swapChainImageViews.resize(swapChainImages.size());
         for (size_t i = 0; i < swapChainImages.size(); i++) {
@@ -235,7 +431,8 @@ namespace m {
         colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        colorAttachment.finalLayout =
+            headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
         VkAttachmentReference colorAttachmentRef = {};
         colorAttachmentRef.attachment = 0;
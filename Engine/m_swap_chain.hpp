@@ -1,21 +1,37 @@
 #pragma once
 
+#include "m_buffer.hpp"
 #include "m_device.hpp"
 
 // vulkan headers
 #include <vulkan/vulkan.h>
 
 // std lib headers
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
 
 namespace m {
 
+    // On a headless device the swap chain renders into offscreen images of its own instead of
+    // presentable ones. The render pass is the same apart from the final layout, and finished
+    // frames can be copied back to the host.
     class MSwapChain {
     public:
         static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
 
+        // a frame copied back from a headless swap chain. pixels are tightly packed, 4 bytes
+        // each in the image format, and only valid during the callback
+        struct FrameImage {
+            uint64_t frameNumber;
+            uint32_t width;
+            uint32_t height;
+            VkFormat format;
+            const uint8_t* pixels;
+        };
+        using ReadbackCallback = std::function<void(const FrameImage&)>;
+
         MSwapChain(MDevice& deviceRef, VkExtent2D windowExtent);
         MSwapChain(
             MDevice& deviceRef, VkExtent2D windowExtent, std::shared_ptr<MSwapChain> previous);
@@ -47,9 +63,22 @@ namespace m {
                 swapChain.swapChainImageFormat == swapChainImageFormat;
         }
 
+        bool isHeadless() const { return headless; }
+
+        // frames are copied back only while a callback is set. the callback runs on the render
+        // thread once the frame's fence has signaled, MAX_FRAMES_IN_FLIGHT frames later
+        void setReadbackCallback(ReadbackCallback callback) { readbackCallback = std::move(callback); }
+        // records the copy of the rendered image after the render pass, headless only
+        void recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+        // waits for the frames still in flight and hands out their readbacks
+        void drainReadbacks();
+
     private:
         void init();
         void createSwapChain();
+        void createOffscreenImages();
+        void createReadbackBuffers();
+        void deliverReadback(size_t frame);
         void createImageViews();
         void createDepthResources();
         void createRenderPass();
@@ -71,7 +100,7 @@ namespace m {
         VkRenderPass renderPass;
 
         std::vector<VkImage> depthImages;
-        std::vector<VkDeviceMemory> depthImageMemorys;
+        std::vector<MAllocation> depthImageMemorys;
         std::vector<VkImageView> depthImageViews;
         std::vector<VkImage> swapChainImages;
         std::vector<VkImageView> swapChainImageViews;
@@ -79,7 +108,7 @@ namespace m {
         MDevice& device;
         VkExtent2D windowExtent;
 
-        VkSwapchainKHR swapChain;
+        VkSwapchainKHR swapChain = VK_NULL_HANDLE;
         std::shared_ptr<MSwapChain> oldSwapChain;
 
         std::vector<VkSemaphore> imageAvailableSemaphores;
@@ -87,6 +116,14 @@ namespace m {
         std::vector<VkFence> inFlightFences;
         std::vector<VkFence> imagesInFlight;
         size_t currentFrame = 0;
+
+        bool headless;
+        std::vector<MAllocation> offscreenImageMemorys;
+        std::vector<std::unique_ptr<MBuffer>> readbackBuffers;
+        std::vector<bool> readbackPending;
+        std::vector<uint64_t> readbackFrameNumbers;
+        uint64_t submittedFrames = 0;
+        ReadbackCallback readbackCallback;
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,148 @@
+#include "m_texture.hpp"
+
+#include "m_buffer.hpp"
+
+// std
+#include <stdexcept>
+
+namespace m {
+
+    MTexture::MTexture(MDevice& device, uint32_t width, uint32_t height, const void* rgbaPixels)
+        : MTexture(device, VK_FORMAT_R8G8B8A8_SRGB, width, height, 1) {
+        uploadPixels(rgbaPixels);
+    }
+
+    MTexture::MTexture(MDevice& device, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels)
+        : mDevice{ device }, format{ format }, width{ width }, height{ height }, mipLevels{ mipLevels } {
+        createImage();
+        createImageView();
+    }
+
+    MTexture::~MTexture() {
+        vkDestroyImageView(mDevice.device(), imageView, nullptr);
+        vkDestroyImage(mDevice.device(), image, nullptr);
+        mDevice.freeMemory(imageMemory);
+    }
+
+    std::unique_ptr<MTexture> MTexture::createSolidColor(MDevice& device, uint32_t rgba) {
+        return std::make_unique<MTexture>(device, 1, 1, &rgba);
+    }
+
+    VkDescriptorImageInfo MTexture::descriptorInfo(VkSampler sampler) const {
+        return VkDescriptorImageInfo{ sampler, imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    }
+
+    void MTexture::createImage() {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = width;
+        imageInfo.extent.height = height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = mipLevels;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        // streamed mips are written from the transfer queue and sampled on the graphics queue
+        uint32_t families[] = { mDevice.getGraphicsQueueFamily(), mDevice.getTransferQueueFamily() };
+        if (families[0] != families[1]) {
+            imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            imageInfo.queueFamilyIndexCount = 2;
+            imageInfo.pQueueFamilyIndices = families;
+        }
+
+        mDevice.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageMemory);
+    }
+
+    void MTexture::uploadPixels(const void* rgbaPixels) {
+        VkDeviceSize imageSize = static_cast<VkDeviceSize>(width) * height * 4;
+        MBuffer stagingBuffer{
+            mDevice,
+            imageSize,
+            1,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            1,
+            MAllocationKind::Staging };
+        stagingBuffer.map();
+        stagingBuffer.writeToBuffer(const_cast<void*>(rgbaPixels), imageSize);
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.layerCount = 1;
+
+        VkCommandBuffer commandBuffer = mDevice.beginSingleTimeCommands();
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            0,
+            nullptr,
+            0,
+            nullptr,
+            1,
+            &barrier);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = { width, height, 1 };
+        vkCmdCopyBufferToImage(
+            commandBuffer,
+            stagingBuffer.getBuffer(),
+            image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1,
+            &region);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0,
+            0,
+            nullptr,
+            0,
+            nullptr,
+            1,
+            &barrier);
+        mDevice.endSingleTimeCommands(commandBuffer);
+    }
+
+    void MTexture::createImageView() {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = mipLevels;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(mDevice.device(), &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture image view!");
+        }
+    }
+
+}
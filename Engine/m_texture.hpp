@@ -0,0 +1,53 @@
+#pragma once
+
+#include "m_device.hpp"
+
+// std
+#include <cstdint>
+#include <memory>
+
+namespace m {
+
+    // A sampled 2D image in device local memory, left in SHADER_READ_ONLY_OPTIMAL once its
+    // pixels are uploaded. Samplers belong to whoever binds it, see MBindlessTable.
+    class MTexture {
+    public:
+        // rgba8 srgb pixels, tightly packed rows
+        MTexture(MDevice& device, uint32_t width, uint32_t height, const void* rgbaPixels);
+        // an empty image for MUploadManager::uploadImage to fill, it can't be sampled before
+        MTexture(MDevice& device, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels);
+        ~MTexture();
+
+        MTexture(const MTexture&) = delete;
+        MTexture& operator=(const MTexture&) = delete;
+
+        // a 1x1 texture, rgba packed as 0xAABBGGRR
+        static std::unique_ptr<MTexture> createSolidColor(MDevice& device, uint32_t rgba);
+
+        VkImage getImage() const { return image; }
+        VkImageView getImageView() const { return imageView; }
+        uint32_t getWidth() const { return width; }
+        uint32_t getHeight() const { return height; }
+        VkFormat getFormat() const { return format; }
+        uint32_t getMipLevels() const { return mipLevels; }
+        VkDeviceSize getMemorySize() const { return imageMemory.size; }
+
+        VkDescriptorImageInfo descriptorInfo(VkSampler sampler) const;
+
+    private:
+        void createImage();
+        void uploadPixels(const void* rgbaPixels);
+        void createImageView();
+
+        MDevice& mDevice;
+        VkFormat format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipLevels;
+
+        VkImage image = VK_NULL_HANDLE;
+        MAllocation imageMemory{};
+        VkImageView imageView = VK_NULL_HANDLE;
+    };
+
+}
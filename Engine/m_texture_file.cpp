@@ -0,0 +1,297 @@
+#include "m_texture_file.hpp"
+
+// std
+#include <algorithm>
+#include <cstring>
+
+namespace m {
+
+    static constexpr uint8_t KTX2_IDENTIFIER[12] = {
+        0xab, 0x4b, 0x54, 0x58, 0x20, 0x32, 0x30, 0xbb, 0x0d, 0x0a, 0x1a, 0x0a };
+
+    struct Ktx2Header {
+        uint8_t identifier[12];
+        uint32_t vkFormat;
+        uint32_t typeSize;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t layerCount;
+        uint32_t faceCount;
+        uint32_t levelCount;
+        uint32_t supercompressionScheme;
+        uint32_t dfdByteOffset;
+        uint32_t dfdByteLength;
+        uint32_t kvdByteOffset;
+        uint32_t kvdByteLength;
+        uint64_t sgdByteOffset;
+        uint64_t sgdByteLength;
+    };
+
+    struct Ktx2Level {
+        uint64_t byteOffset;
+        uint64_t byteLength;
+        uint64_t uncompressedByteLength;
+    };
+
+    static constexpr uint32_t DDS_MAGIC = 0x20534444;  // "DDS "
+    static constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+    static constexpr uint32_t DDSD_DEPTH = 0x800000;
+    static constexpr uint32_t DDPF_FOURCC = 0x4;
+    static constexpr uint32_t DDPF_RGB = 0x40;
+    static constexpr uint32_t DDSCAPS2_CUBEMAP = 0x200;
+    static constexpr uint32_t DDSCAPS2_VOLUME = 0x200000;
+    static constexpr uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+    static constexpr uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+    struct DdsPixelFormat {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t fourCC;
+        uint32_t rgbBitCount;
+        uint32_t rBitMask;
+        uint32_t gBitMask;
+        uint32_t bBitMask;
+        uint32_t aBitMask;
+    };
+
+    struct DdsHeader {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t height;
+        uint32_t width;
+        uint32_t pitchOrLinearSize;
+        uint32_t depth;
+        uint32_t mipMapCount;
+        uint32_t reserved1[11];
+        DdsPixelFormat pixelFormat;
+        uint32_t caps;
+        uint32_t caps2;
+        uint32_t caps3;
+        uint32_t caps4;
+        uint32_t reserved2;
+    };
+
+    struct DdsHeaderDx10 {
+        uint32_t dxgiFormat;
+        uint32_t resourceDimension;
+        uint32_t miscFlag;
+        uint32_t arraySize;
+        uint32_t miscFlags2;
+    };
+
+    static constexpr uint32_t fourCC(char a, char b, char c, char d) {
+        return static_cast<uint32_t>(a) | static_cast<uint32_t>(b) << 8 |
+            static_cast<uint32_t>(c) << 16 | static_cast<uint32_t>(d) << 24;
+    }
+
+    // bytes per 4x4 block of a compressed format, per texel of rgba8, 0 for anything else
+    static uint32_t formatBlockBytes(VkFormat format) {
+        switch (format) {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+        case VK_FORMAT_BC4_SNORM_BLOCK:
+            return 8;
+        case VK_FORMAT_BC2_UNORM_BLOCK:
+        case VK_FORMAT_BC2_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC5_SNORM_BLOCK:
+        case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+        case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return 16;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
+    static VkFormat formatFromDxgi(uint32_t dxgiFormat) {
+        switch (dxgiFormat) {
+        case 28: return VK_FORMAT_R8G8B8A8_UNORM;
+        case 29: return VK_FORMAT_R8G8B8A8_SRGB;
+        case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+        case 74: return VK_FORMAT_BC2_UNORM_BLOCK;
+        case 75: return VK_FORMAT_BC2_SRGB_BLOCK;
+        case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+        case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+        case 80: return VK_FORMAT_BC4_UNORM_BLOCK;
+        case 81: return VK_FORMAT_BC4_SNORM_BLOCK;
+        case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+        case 84: return VK_FORMAT_BC5_SNORM_BLOCK;
+        case 95: return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+        case 96: return VK_FORMAT_BC6H_SFLOAT_BLOCK;
+        case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+        case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+        default: return VK_FORMAT_UNDEFINED;
+        }
+    }
+
+    // legacy headers carry no color space, their color formats are taken as srgb
+    static VkFormat formatFromDdsPixelFormat(const DdsPixelFormat& pixelFormat) {
+        if (pixelFormat.flags & DDPF_FOURCC) {
+            switch (pixelFormat.fourCC) {
+            case fourCC('D', 'X', 'T', '1'): return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+            case fourCC('D', 'X', 'T', '2'):
+            case fourCC('D', 'X', 'T', '3'): return VK_FORMAT_BC2_SRGB_BLOCK;
+            case fourCC('D', 'X', 'T', '4'):
+            case fourCC('D', 'X', 'T', '5'): return VK_FORMAT_BC3_SRGB_BLOCK;
+            case fourCC('A', 'T', 'I', '1'):
+            case fourCC('B', 'C', '4', 'U'): return VK_FORMAT_BC4_UNORM_BLOCK;
+            case fourCC('B', 'C', '4', 'S'): return VK_FORMAT_BC4_SNORM_BLOCK;
+            case fourCC('A', 'T', 'I', '2'):
+            case fourCC('B', 'C', '5', 'U'): return VK_FORMAT_BC5_UNORM_BLOCK;
+            case fourCC('B', 'C', '5', 'S'): return VK_FORMAT_BC5_SNORM_BLOCK;
+            default: return VK_FORMAT_UNDEFINED;
+            }
+        }
+        if ((pixelFormat.flags & DDPF_RGB) && pixelFormat.rgbBitCount == 32 &&
+            pixelFormat.rBitMask == 0x000000ff && pixelFormat.gBitMask == 0x0000ff00 &&
+            pixelFormat.bBitMask == 0x00ff0000 && pixelFormat.aBitMask == 0xff000000) {
+            return VK_FORMAT_R8G8B8A8_SRGB;
+        }
+        return VK_FORMAT_UNDEFINED;
+    }
+
+    static uint64_t levelSize(VkFormat format, uint32_t width, uint32_t height) {
+        uint64_t blockBytes = formatBlockBytes(format);
+        if (!MTextureFile::isCompressed(format)) {
+            return uint64_t{ width } * height * blockBytes;
+        }
+        return uint64_t{ (width + 3) / 4 } * ((height + 3) / 4) * blockBytes;
+    }
+
+    // a chain never goes on past 1x1
+    static uint32_t clampLevelCount(uint32_t levelCount, uint32_t width, uint32_t height) {
+        uint32_t fullChain = 1;
+        for (uint32_t size = std::max(width, height); size > 1; size >>= 1) {
+            fullChain++;
+        }
+        return std::clamp(levelCount, 1u, fullChain);
+    }
+
+    std::unique_ptr<MTextureFile> MTextureFile::open(const std::string& filepath) {
+        std::unique_ptr<MTextureFile> texture{ new MTextureFile() };
+        texture->file = MMappedFile::open(filepath);
+        if (texture->file == nullptr) {
+            return nullptr;
+        }
+
+        const auto* bytes = static_cast<const uint8_t*>(texture->file->data());
+        size_t size = texture->file->size();
+        bool parsed = false;
+        if (size >= sizeof(Ktx2Header) && memcmp(bytes, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0) {
+            parsed = texture->parseKtx2();
+        }
+        else if (size >= sizeof(uint32_t) + sizeof(DdsHeader) &&
+            *reinterpret_cast<const uint32_t*>(bytes) == DDS_MAGIC) {
+            parsed = texture->parseDds();
+        }
+        return parsed ? std::move(texture) : nullptr;
+    }
+
+    const void* MTextureFile::getLevelData(uint32_t level) const {
+        return static_cast<const char*>(file->data()) + levels[level].offset;
+    }
+
+    uint64_t MTextureFile::getChainSize(uint32_t baseLevel) const {
+        uint64_t size = 0;
+        for (uint32_t level = baseLevel; level < levels.size(); level++) {
+            size += levels[level].size;
+        }
+        return size;
+    }
+
+    bool MTextureFile::isCompressed(VkFormat format) {
+        return format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB;
+    }
+
+    bool MTextureFile::parseKtx2() {
+        const auto* header = static_cast<const Ktx2Header*>(file->data());
+        format = static_cast<VkFormat>(header->vkFormat);
+        if (formatBlockBytes(format) == 0 || header->supercompressionScheme != 0 ||
+            header->pixelWidth == 0 || header->pixelHeight == 0 || header->pixelDepth != 0 ||
+            header->layerCount > 1 || header->faceCount != 1) {
+            return false;
+        }
+
+        // a level count of 0 asks the loader to generate the mips, only the base is stored
+        uint32_t levelCount = std::max(header->levelCount, 1u);
+        if (levelCount != clampLevelCount(levelCount, header->pixelWidth, header->pixelHeight) ||
+            sizeof(Ktx2Header) + uint64_t{ levelCount } * sizeof(Ktx2Level) > file->size()) {
+            return false;
+        }
+
+        const auto* levelIndex = reinterpret_cast<const Ktx2Level*>(
+            static_cast<const char*>(file->data()) + sizeof(Ktx2Header));
+        levels.resize(levelCount);
+        for (uint32_t i = 0; i < levelCount; i++) {
+            Level& level = levels[i];
+            level.width = std::max(header->pixelWidth >> i, 1u);
+            level.height = std::max(header->pixelHeight >> i, 1u);
+            level.offset = levelIndex[i].byteOffset;
+            level.size = levelSize(format, level.width, level.height);
+            if (levelIndex[i].byteLength != level.size || level.offset + level.size > file->size()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool MTextureFile::parseDds() {
+        const char* base = static_cast<const char*>(file->data());
+        const auto* header = reinterpret_cast<const DdsHeader*>(base + sizeof(uint32_t));
+        uint64_t dataOffset = sizeof(uint32_t) + sizeof(DdsHeader);
+        if (header->size != sizeof(DdsHeader) || header->width == 0 || header->height == 0 ||
+            (header->caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME)) ||
+            ((header->flags & DDSD_DEPTH) && header->depth > 1)) {
+            return false;
+        }
+
+        if ((header->pixelFormat.flags & DDPF_FOURCC) && header->pixelFormat.fourCC == fourCC('D', 'X', '1', '0')) {
+            if (file->size() < dataOffset + sizeof(DdsHeaderDx10)) {
+                return false;
+            }
+            const auto* dx10 = reinterpret_cast<const DdsHeaderDx10*>(base + dataOffset);
+            if (dx10->resourceDimension != DDS_DIMENSION_TEXTURE2D || dx10->arraySize > 1 ||
+                (dx10->miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE)) {
+                return false;
+            }
+            format = formatFromDxgi(dx10->dxgiFormat);
+            dataOffset += sizeof(DdsHeaderDx10);
+        }
+        else {
+            format = formatFromDdsPixelFormat(header->pixelFormat);
+        }
+        if (format == VK_FORMAT_UNDEFINED) {
+            return false;
+        }
+
+        uint32_t levelCount = (header->flags & DDSD_MIPMAPCOUNT) ? header->mipMapCount : 1;
+        levelCount = clampLevelCount(levelCount, header->width, header->height);
+        return layOutPackedChain(dataOffset, header->width, header->height, levelCount);
+    }
+
+    bool MTextureFile::layOutPackedChain(uint64_t offset, uint32_t width, uint32_t height, uint32_t levelCount) {
+        levels.resize(levelCount);
+        for (uint32_t i = 0; i < levelCount; i++) {
+            Level& level = levels[i];
+            level.width = std::max(width >> i, 1u);
+            level.height = std::max(height >> i, 1u);
+            level.offset = offset;
+            level.size = levelSize(format, level.width, level.height);
+            offset += level.size;
+        }
+        return offset <= file->size();
+    }
+
+}
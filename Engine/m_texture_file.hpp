@@ -0,0 +1,59 @@
+#pragma once
+
+#include "m_mapped_file.hpp"
+
+// libs
+#include <vulkan/vulkan.h>
+
+// std
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace m {
+
+    // A 2D texture in a KTX2 or DDS file with its whole mip chain, memory mapped so the levels
+    // are uploaded straight out of the page cache. Only formats that can be copied as they are
+    // get through: BC1 to BC7 and rgba8. Array, cube and volume textures, KTX2 supercompression
+    // and Basis Universal payloads are rejected.
+    class MTextureFile {
+    public:
+        struct Level {
+            uint64_t offset;  // from the start of the file
+            uint64_t size;
+            uint32_t width;
+            uint32_t height;
+        };
+
+        // returns nullptr if the file doesn't exist or isn't a texture this can load
+        static std::unique_ptr<MTextureFile> open(const std::string& filepath);
+
+        MTextureFile(const MTextureFile&) = delete;
+        MTextureFile& operator=(const MTextureFile&) = delete;
+
+        VkFormat getFormat() const { return format; }
+        uint32_t getWidth() const { return levels[0].width; }
+        uint32_t getHeight() const { return levels[0].height; }
+        uint32_t getLevelCount() const { return static_cast<uint32_t>(levels.size()); }
+        const Level& getLevel(uint32_t level) const { return levels[level]; }
+        const void* getLevelData(uint32_t level) const;
+
+        // bytes of the levels from baseLevel to the smallest
+        uint64_t getChainSize(uint32_t baseLevel) const;
+
+        static bool isCompressed(VkFormat format);
+
+    private:
+        MTextureFile() = default;
+
+        bool parseKtx2();
+        bool parseDds();
+        // fills in the sizes of a chain packed largest level first from offset
+        bool layOutPackedChain(uint64_t offset, uint32_t width, uint32_t height, uint32_t levelCount);
+
+        std::unique_ptr<MMappedFile> file;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        std::vector<Level> levels;
+    };
+}
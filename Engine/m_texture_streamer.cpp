@@ -0,0 +1,264 @@
+#include "m_texture_streamer.hpp"
+
+#include "m_swap_chain.hpp"
+#include "m_trace.hpp"
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace m {
+
+    MTextureStreamer::MTextureStreamer(MDevice& device, MBindlessTable& bindlessTable, VkDeviceSize budget)
+        : mDevice{ device }, bindlessTable{ bindlessTable }, budget{ budget } {}
+
+    MTextureStreamer::~MTextureStreamer() {
+        // the jobs write into the loads, and the transfer queue into the images
+        MJobSystem::shared().wait(loadCounter);
+        mDevice.getUploadManager().waitIdle();
+    }
+
+    MTextureStreamer::Handle MTextureStreamer::load(const std::string& filepath) {
+        auto file = MTextureFile::open(filepath);
+        if (file == nullptr) {
+            throw std::runtime_error("failed to load texture " + filepath + "!");
+        }
+        if (MTextureFile::isCompressed(file->getFormat()) && !mDevice.getFeatures().textureCompressionBC) {
+            throw std::runtime_error("device can't sample the BC compressed texture " + filepath + "!");
+        }
+
+        uint32_t tailLevel = 0;
+        while (tailLevel + 1 < file->getLevelCount() &&
+            std::max(file->getLevel(tailLevel).width, file->getLevel(tailLevel).height) > TAIL_SIZE) {
+            tailLevel++;
+        }
+        Chain tail = createChain(*file, tailLevel);
+
+        StreamedTexture& texture = textures.emplace_back();
+        texture.tail = std::move(tail);
+        texture.filepath = filepath;
+        texture.wantedLevel = tailLevel;
+        committedBytes += file->getChainSize(tailLevel);
+        texture.file = std::move(file);
+        return static_cast<Handle>(textures.size() - 1);
+    }
+
+    void MTextureStreamer::update(FrameInfo& frameInfo, float viewportHeight) {
+        M_TRACE_ZONE("MTextureStreamer::update");
+        frameNumber++;
+
+        // the fence of the last frame that could sample these has been waited on
+        auto stillInUse = std::partition(
+            retiredTextures.begin(),
+            retiredTextures.end(),
+            [this](const std::pair<uint64_t, std::unique_ptr<MTexture>>& retired) {
+                return frameNumber - retired.first >= MSwapChain::MAX_FRAMES_IN_FLIGHT;
+            });
+        retiredTextures.erase(retiredTextures.begin(), stillInUse);
+
+        // the jobs only record their uploads, this hands them to the transfer queue
+        mDevice.getUploadManager().flush();
+
+        finishLoads();
+        gatherDemand(frameInfo, viewportHeight);
+        startLoads();
+    }
+
+    MTextureStreamer::Chain MTextureStreamer::createChain(const MTextureFile& file, uint32_t baseLevel) {
+        const MTextureFile::Level& base = file.getLevel(baseLevel);
+        Chain chain{};
+        chain.baseLevel = baseLevel;
+        chain.texture = std::make_unique<MTexture>(
+            mDevice, file.getFormat(), base.width, base.height, file.getLevelCount() - baseLevel);
+
+        std::vector<MUploadManager::ImageLevel> levels;
+        levels.reserve(file.getLevelCount() - baseLevel);
+        for (uint32_t level = baseLevel; level < file.getLevelCount(); level++) {
+            const MTextureFile::Level& source = file.getLevel(level);
+            levels.push_back({ file.getLevelData(level), source.size, source.width, source.height });
+        }
+        chain.token = mDevice.getUploadManager().uploadImage(chain.texture->getImage(), levels);
+        return chain;
+    }
+
+    uint32_t MTextureStreamer::bindlessIndexOf(const StreamedTexture& texture) const {
+        return texture.streamed.texture ? texture.streamed.bindlessIndex : texture.tail.bindlessIndex;
+    }
+
+    void MTextureStreamer::finishLoads() {
+        MUploadManager& uploadManager = mDevice.getUploadManager();
+        for (StreamedTexture& texture : textures) {
+            if (texture.tail.bindlessIndex == MBindlessTable::WHITE_TEXTURE &&
+                uploadManager.isComplete(texture.tail.token)) {
+                texture.tail.bindlessIndex = bindlessTable.addTexture(*texture.tail.texture);
+            }
+        }
+
+        for (size_t i = 0; i < loads.size();) {
+            Load& load = *loads[i];
+            if (!load.recorded.load(std::memory_order_acquire) ||
+                (!load.error && !uploadManager.isComplete(load.chain.token))) {
+                i++;
+                continue;
+            }
+
+            StreamedTexture& texture = textures[load.handle];
+            texture.load = nullptr;
+            if (load.error) {
+                committedBytes -= texture.file->getChainSize(load.baseLevel);
+                texture.loadFailed = true;
+                try {
+                    std::rethrow_exception(load.error);
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "failed to stream " << texture.filepath << ": " << e.what() << std::endl;
+                }
+                catch (...) {
+                    std::cerr << "failed to stream " << texture.filepath << std::endl;
+                }
+            }
+            else {
+                releaseStreamed(texture);
+                texture.streamed = std::move(load.chain);
+                texture.streamed.bindlessIndex = bindlessTable.addTexture(*texture.streamed.texture);
+            }
+            loads[i] = std::move(loads.back());
+            loads.pop_back();
+        }
+    }
+
+    void MTextureStreamer::gatherDemand(FrameInfo& frameInfo, float viewportHeight) {
+        glm::vec3 cameraPosition = frameInfo.camera.getPosition();
+        // screen height in pixels of a unit long segment at unit distance
+        float pixelsPerUnit = std::abs(frameInfo.camera.getProjection()[1][1]) * viewportHeight * .5f;
+
+        frameInfo.registry.view<TransformComponent, ModelComponent, StreamedTextureComponent>().each(
+            [&](MEntity, TransformComponent& transform, ModelComponent& model, StreamedTextureComponent& streamed) {
+            assert(streamed.texture < textures.size() && "Unknown streamed texture");
+            StreamedTexture& texture = textures[streamed.texture];
+            if (texture.lastUsedFrame != frameNumber) {
+                texture.lastUsedFrame = frameNumber;
+                texture.wantedLevel = texture.tail.baseLevel;
+                texture.screenSize = 0.f;
+            }
+
+            // a chain evicted later this frame keeps its slot until the frames in flight are done
+            model.textureIndex = bindlessIndexOf(texture);
+            if (model.model == nullptr) return;
+
+            // the texture is taken to stretch once across the bounding sphere, so its largest
+            // level wants as many texels as the sphere's diameter covers pixels
+            const glm::mat4& matrix = transform.mat4();
+            const MModel::Bounds& bounds = model.model->getBounds();
+            float scale = glm::max(
+                glm::length(glm::vec3(matrix[0])),
+                glm::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+            float radius = bounds.radius * scale;
+            float distance = glm::length(glm::vec3(matrix * glm::vec4(bounds.center, 1.f)) - cameraPosition);
+            float pixels = distance > radius
+                ? pixelsPerUnit * 2.f * radius / distance
+                : std::numeric_limits<float>::max();
+
+            float texels = static_cast<float>(std::max(texture.file->getWidth(), texture.file->getHeight()));
+            uint32_t level = 0;
+            if (pixels < texels) {
+                level = static_cast<uint32_t>(std::log2(texels / std::max(pixels, 1.f)));
+            }
+            texture.wantedLevel = std::min(texture.wantedLevel, level);
+            texture.screenSize = std::max(texture.screenSize, pixels);
+        });
+    }
+
+    void MTextureStreamer::startLoads() {
+        candidates.clear();
+        for (Handle handle = 0; handle < textures.size(); handle++) {
+            const StreamedTexture& texture = textures[handle];
+            if (texture.load == nullptr && !texture.loadFailed && texture.lastUsedFrame == frameNumber &&
+                texture.wantedLevel < texture.residentLevel()) {
+                candidates.push_back(handle);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [this](Handle a, Handle b) {
+            return textures[a].screenSize > textures[b].screenSize;
+        });
+
+        VkDeviceSize streamedBytes = 0;
+        for (Handle handle : candidates) {
+            if (streamedBytes >= MAX_STREAMED_PER_FRAME) {
+                break;
+            }
+            StreamedTexture& texture = textures[handle];
+            VkDeviceSize bytes = texture.file->getChainSize(texture.wantedLevel);
+            if (committedBytes + bytes > budget && !evict(bytes)) {
+                continue;
+            }
+            committedBytes += bytes;
+            streamedBytes += bytes;
+
+            auto load = std::make_unique<Load>();
+            load->handle = handle;
+            load->baseLevel = texture.wantedLevel;
+            Load* pending = load.get();
+            const MTextureFile* file = texture.file.get();
+            texture.load = pending;
+            loads.push_back(std::move(load));
+
+            // reading the levels out of the mapping is where the file is paged in
+            MJobSystem::shared().schedule(
+                [this, pending, file]() {
+                    try {
+                        pending->chain = createChain(*file, pending->baseLevel);
+                    }
+                    catch (...) {
+                        pending->error = std::current_exception();
+                    }
+                    pending->recorded.store(true, std::memory_order_release);
+                },
+                &loadCounter);
+        }
+    }
+
+    bool MTextureStreamer::evict(VkDeviceSize bytes) {
+        // a texture used this frame only counts when it holds finer levels than it asked for,
+        // dropping what is on screen at the resolution it wants would just stream it back in
+        std::vector<Handle> evictable;
+        for (Handle handle = 0; handle < textures.size(); handle++) {
+            const StreamedTexture& texture = textures[handle];
+            if (texture.streamed.texture && texture.load == nullptr &&
+                (texture.lastUsedFrame != frameNumber || texture.wantedLevel > texture.streamed.baseLevel)) {
+                evictable.push_back(handle);
+            }
+        }
+        std::sort(evictable.begin(), evictable.end(), [this](Handle a, Handle b) {
+            return textures[a].lastUsedFrame < textures[b].lastUsedFrame;
+        });
+
+        for (Handle handle : evictable) {
+            if (committedBytes + bytes <= budget) {
+                break;
+            }
+            releaseStreamed(textures[handle]);
+        }
+        return committedBytes + bytes <= budget;
+    }
+
+    void MTextureStreamer::releaseStreamed(StreamedTexture& texture) {
+        if (!texture.streamed.texture) {
+            return;
+        }
+        bindlessTable.removeTexture(texture.streamed.bindlessIndex);
+        committedBytes -= texture.file->getChainSize(texture.streamed.baseLevel);
+        retiredTextures.push_back({ frameNumber, std::move(texture.streamed.texture) });
+        texture.streamed = {};
+    }
+
+}
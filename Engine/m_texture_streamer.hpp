@@ -0,0 +1,118 @@
+#pragma once
+
+#include "m_bindless_table.hpp"
+#include "m_device.hpp"
+#include "m_frame_info.hpp"
+#include "m_job_system.hpp"
+#include "m_texture.hpp"
+#include "m_texture_file.hpp"
+#include "m_upload_manager.hpp"
+
+// std
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace m {
+
+    // Streams the mip chains of KTX2 and DDS textures under a fixed memory budget. Loading a
+    // texture maps its file and uploads just the mip tail, the levels of TAIL_SIZE and below,
+    // which stays resident for good. Every frame the models with a StreamedTextureComponent ask
+    // for the level whose texels match the pixels they cover on screen, and textures asked for a
+    // finer level than they hold are loaded again from that level down on the job system, the
+    // largest on screen first. A finished chain takes a new bindless slot, and the one it replaces
+    // is destroyed once no frame in flight can sample it.
+    //
+    // The budget counts the bytes of the resident chains and of the ones loading. When a load
+    // doesn't fit, the least recently used textures holding finer levels than they were last asked
+    // for drop back to their tail until it does, and otherwise it waits for a later frame. A
+    // texture whose chain fails to load is logged and keeps its tail.
+    class MTextureStreamer {
+    public:
+        using Handle = uint32_t;
+
+        static constexpr VkDeviceSize DEFAULT_BUDGET = 256 * 1024 * 1024;
+        static constexpr uint32_t TAIL_SIZE = 64;
+        // loads started in one frame stop after this many bytes, so a burst of demand is spread
+        // over several frames. the first one is always started
+        static constexpr VkDeviceSize MAX_STREAMED_PER_FRAME = 16 * 1024 * 1024;
+
+        MTextureStreamer(MDevice& device, MBindlessTable& bindlessTable, VkDeviceSize budget = DEFAULT_BUDGET);
+        ~MTextureStreamer();
+
+        MTextureStreamer(const MTextureStreamer&) = delete;
+        MTextureStreamer& operator=(const MTextureStreamer&) = delete;
+
+        // throws if the file can't be loaded or its format can't be sampled. the texture is white
+        // until its tail is uploaded
+        Handle load(const std::string& filepath);
+
+        // call once per frame after MBindlessTable::beginFrame, once the transforms are up to date
+        // and before the models' texture indices are read
+        void update(FrameInfo& frameInfo, float viewportHeight);
+
+        VkDeviceSize getBudget() const { return budget; }
+        VkDeviceSize getCommittedBytes() const { return committedBytes; }
+
+    private:
+        // levels from baseLevel to the smallest, in an image of their own
+        struct Chain {
+            std::unique_ptr<MTexture> texture{};
+            uint32_t baseLevel = 0;
+            MUploadManager::Token token = 0;
+            uint32_t bindlessIndex = MBindlessTable::WHITE_TEXTURE;  // set once the upload is done
+        };
+
+        // a chain being created and recorded on the job system
+        struct Load {
+            Handle handle = 0;
+            uint32_t baseLevel = 0;
+            Chain chain{};
+            std::exception_ptr error{};
+            std::atomic<bool> recorded{ false };
+        };
+
+        struct StreamedTexture {
+            std::unique_ptr<MTextureFile> file;
+            std::string filepath;
+            Chain tail{};
+            Chain streamed{};  // finer levels, no texture while only the tail is resident
+            Load* load = nullptr;
+            // finest level and most pixels asked for during the last frame the texture was used
+            uint32_t wantedLevel = 0;
+            float screenSize = 0.f;
+            uint64_t lastUsedFrame = 0;
+            bool loadFailed = false;  // stays on the tail rather than failing again every frame
+
+            uint32_t residentLevel() const { return streamed.texture ? streamed.baseLevel : tail.baseLevel; }
+        };
+
+        Chain createChain(const MTextureFile& file, uint32_t baseLevel);
+        uint32_t bindlessIndexOf(const StreamedTexture& texture) const;
+
+        void finishLoads();
+        void gatherDemand(FrameInfo& frameInfo, float viewportHeight);
+        void startLoads();
+        // drops least recently used chains until bytes more fit, false if they still don't
+        bool evict(VkDeviceSize bytes);
+        // back to the tail, the image is destroyed once the frames in flight are done with it
+        void releaseStreamed(StreamedTexture& texture);
+
+        MDevice& mDevice;
+        MBindlessTable& bindlessTable;
+        VkDeviceSize budget;
+        VkDeviceSize committedBytes = 0;
+
+        std::vector<StreamedTexture> textures;
+        std::vector<std::unique_ptr<Load>> loads;
+        std::vector<std::pair<uint64_t, std::unique_ptr<MTexture>>> retiredTextures;  // frame retired
+        std::vector<Handle> candidates;
+        MJobSystem::Counter loadCounter;
+        uint64_t frameNumber = 0;
+    };
+
+}
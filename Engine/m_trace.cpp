@@ -0,0 +1,123 @@
+#include "m_trace.hpp"
+
+// std
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace m {
+
+    namespace {
+
+        struct ThreadRing {
+            std::array<MTrace::Event, MTrace::RING_CAPACITY> events;
+            std::atomic<uint64_t> written{ 0 };
+            uint32_t threadId = 0;
+            std::string threadName;  // guarded by Registry::mutex
+        };
+
+        // rings outlive their threads, so zones of a finished thread still get exported
+        struct Registry {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<ThreadRing>> rings;
+        };
+
+        Registry& registry() {
+            static Registry instance;
+            return instance;
+        }
+
+        ThreadRing& threadRing() {
+            thread_local ThreadRing* ring = nullptr;
+            if (ring == nullptr) {
+                Registry& reg = registry();
+                std::lock_guard<std::mutex> lock{ reg.mutex };
+                reg.rings.push_back(std::make_unique<ThreadRing>());
+                ring = reg.rings.back().get();
+                ring->threadId = static_cast<uint32_t>(reg.rings.size());
+            }
+            return *ring;
+        }
+
+        void writeEscaped(std::ostream& out, const std::string& text) {
+            for (char c : text) {
+                if (c == '"' || c == '\\') out << '\\';
+                out << c;
+            }
+        }
+
+    }
+
+    void MTrace::setThreadName(const std::string& name) {
+        ThreadRing& ring = threadRing();
+        std::lock_guard<std::mutex> lock{ registry().mutex };
+        ring.threadName = name;
+    }
+
+    void MTrace::record(const char* name, int64_t startNs, int64_t endNs) {
+        ThreadRing& ring = threadRing();
+        uint64_t index = ring.written.load(std::memory_order_relaxed);
+        ring.events[index % RING_CAPACITY] = { name, startNs, endNs - startNs };
+        ring.written.store(index + 1, std::memory_order_release);
+    }
+
+    bool MTrace::writeChromeTrace(const std::string& filepath) {
+        std::ofstream out{ filepath, std::ios::trunc };
+        if (!out.is_open()) {
+            return false;
+        }
+
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock{ reg.mutex };
+
+        // timestamps relative to the earliest zone keep the numbers readable
+        int64_t origin = INT64_MAX;
+        for (const auto& ring : reg.rings) {
+            uint64_t written = ring->written.load(std::memory_order_acquire);
+            uint64_t first = written > RING_CAPACITY ? written - RING_CAPACITY : 0;
+            for (uint64_t i = first; i < written; i++) {
+                origin = std::min(origin, ring->events[i % RING_CAPACITY].startNs);
+            }
+        }
+
+        // microseconds with nanosecond digits. the default six significant digits would round
+        // timestamps past a second to whole microseconds and beyond
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool firstEvent = true;
+        auto separator = [&]() {
+            out << (firstEvent ? "\n" : ",\n");
+            firstEvent = false;
+        };
+
+        for (const auto& ring : reg.rings) {
+            if (!ring->threadName.empty()) {
+                separator();
+                out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->threadId
+                    << ",\"args\":{\"name\":\"";
+                writeEscaped(out, ring->threadName);
+                out << "\"}}";
+            }
+
+            uint64_t written = ring->written.load(std::memory_order_acquire);
+            uint64_t first = written > RING_CAPACITY ? written - RING_CAPACITY : 0;
+            for (uint64_t i = first; i < written; i++) {
+                const Event& event = ring->events[i % RING_CAPACITY];
+                separator();
+                out << "{\"name\":\"";
+                writeEscaped(out, event.name);
+                out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->threadId
+                    << ",\"ts\":" << (event.startNs - origin) / 1000.0
+                    << ",\"dur\":" << event.durationNs / 1000.0 << "}";
+            }
+        }
+
+        out << "\n]}\n";
+        return out.good();
+    }
+
+}
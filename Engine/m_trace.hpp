@@ -0,0 +1,78 @@
+#pragma once
+
+// std
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace m {
+
+    // Scoped CPU zones recorded into a ring buffer per thread and exported as Chrome trace JSON,
+    // which chrome://tracing and ui.perfetto.dev open. Recording a zone takes two clock reads and
+    // a store into the calling thread's ring, no locks; only a thread's first zone registers its
+    // ring under a mutex. When a ring wraps the oldest zones are overwritten.
+    //
+    // Zones are off until setEnabled(true), and compile out entirely with MOCHA_NO_TRACE.
+    class MTrace {
+    public:
+        static constexpr size_t RING_CAPACITY = 1 << 16;  // zones kept per thread
+
+        struct Event {
+            const char* name;  // must outlive the trace, in practice a string literal
+            int64_t startNs;
+            int64_t durationNs;
+        };
+
+        static void setEnabled(bool enabled) { enabledFlag().store(enabled, std::memory_order_relaxed); }
+        static bool isEnabled() { return enabledFlag().load(std::memory_order_relaxed); }
+
+        // shows up as the thread's name in the trace viewer
+        static void setThreadName(const std::string& name);
+
+        static int64_t now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+        static void record(const char* name, int64_t startNs, int64_t endNs);
+
+        // zones still being written while this runs may come out torn, so call it once the
+        // threads being traced are idle
+        static bool writeChromeTrace(const std::string& filepath);
+
+    private:
+        static std::atomic<bool>& enabledFlag() {
+            static std::atomic<bool> enabled{ false };
+            return enabled;
+        }
+    };
+
+    class MTraceZone {
+    public:
+        explicit MTraceZone(const char* name)
+            : name{ MTrace::isEnabled() ? name : nullptr }, startNs{ this->name ? MTrace::now() : 0 } {}
+        ~MTraceZone() {
+            if (name != nullptr) {
+                MTrace::record(name, startNs, MTrace::now());
+            }
+        }
+
+        MTraceZone(const MTraceZone&) = delete;
+        MTraceZone& operator=(const MTraceZone&) = delete;
+
+    private:
+        const char* name;
+        int64_t startNs;
+    };
+
+}
+
+#ifdef MOCHA_NO_TRACE
+#define M_TRACE_ZONE(name)
+#else
+#define M_TRACE_CONCAT_INNER(a, b) a##b
+#define M_TRACE_CONCAT(a, b) M_TRACE_CONCAT_INNER(a, b)
+// times the rest of the enclosing block
+#define M_TRACE_ZONE(name) ::m::MTraceZone M_TRACE_CONCAT(traceZone, __LINE__){ name }
+#endif
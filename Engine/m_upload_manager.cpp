@@ -0,0 +1,338 @@
+#include "m_upload_manager.hpp"
+
+// std
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace m {
+
+    static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+    MUploadManager::MUploadManager(MDevice& device) : mDevice{ device } {
+        VkCommandPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = device.getTransferQueueFamily();
+        poolInfo.flags =
+            VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+        if (vkCreateCommandPool(device.device(), &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload command pool!");
+        }
+
+        // the ring lives as long as the manager, the linear staging pools would never rewind under it
+        stagingRing = std::make_unique<MBuffer>(
+            device,
+            STAGING_RING_SIZE,
+            1,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        stagingRing->map();
+    }
+
+    MUploadManager::~MUploadManager() {
+        waitIdle();
+        for (auto fence : freeFences) {
+            vkDestroyFence(mDevice.device(), fence, nullptr);
+        }
+        vkDestroyCommandPool(mDevice.device(), commandPool, nullptr);
+    }
+
+    MUploadManager::Token MUploadManager::uploadBuffer(
+        VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset) {
+        std::lock_guard<std::mutex> lock{ mutex };
+
+        VkBuffer srcBuffer;
+        VkDeviceSize srcOffset = 0;
+        memcpy(stage(size, srcBuffer, srcOffset), data, static_cast<size_t>(size));
+
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = srcOffset;
+        copyRegion.dstOffset = dstOffset;
+        copyRegion.size = size;
+        vkCmdCopyBuffer(recording.commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+
+        Token token = recording.token;
+        if (recording.ringBytes >= BATCH_SUBMIT_THRESHOLD) {
+            submitBatch();
+        }
+        return token;
+    }
+
+    MUploadManager::Token MUploadManager::uploadImage(
+        VkImage dstImage, const std::vector<ImageLevel>& levels) {
+        assert(!levels.empty() && "An image upload needs at least one level");
+        std::lock_guard<std::mutex> lock{ mutex };
+
+        // the whole chain is staged in one piece so its copies and barriers land in one batch.
+        // buffer offsets of compressed copies have to be multiples of the block size, which the
+        // staging alignment is
+        std::vector<VkBufferImageCopy> regions(levels.size());
+        VkDeviceSize stagingSize = 0;
+        for (size_t i = 0; i < levels.size(); i++) {
+            stagingSize = (stagingSize + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+            regions[i].bufferOffset = stagingSize;
+            regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            regions[i].imageSubresource.mipLevel = static_cast<uint32_t>(i);
+            regions[i].imageSubresource.layerCount = 1;
+            regions[i].imageExtent = { levels[i].width, levels[i].height, 1 };
+            stagingSize += levels[i].size;
+        }
+
+        VkBuffer srcBuffer;
+        VkDeviceSize srcOffset = 0;
+        char* staging = static_cast<char*>(stage(stagingSize, srcBuffer, srcOffset));
+        for (size_t i = 0; i < levels.size(); i++) {
+            memcpy(staging + regions[i].bufferOffset, levels[i].data, static_cast<size_t>(levels[i].size));
+            regions[i].bufferOffset += srcOffset;
+        }
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = dstImage;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = static_cast<uint32_t>(levels.size());
+        barrier.subresourceRange.layerCount = 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            recording.commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            0,
+            nullptr,
+            0,
+            nullptr,
+            1,
+            &barrier);
+
+        vkCmdCopyBufferToImage(
+            recording.commandBuffer,
+            srcBuffer,
+            dstImage,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t>(regions.size()),
+            regions.data());
+
+        // the transfer queue may not know the fragment stage. nothing samples the image before
+        // the token completes, and the frames that do are submitted after the fence signalled
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(
+            recording.commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0,
+            0,
+            nullptr,
+            0,
+            nullptr,
+            1,
+            &barrier);
+
+        Token token = recording.token;
+        if (recording.ringBytes >= BATCH_SUBMIT_THRESHOLD) {
+            submitBatch();
+        }
+        return token;
+    }
+
+    MUploadManager::Token MUploadManager::flush() {
+        std::lock_guard<std::mutex> lock{ mutex };
+
+        if (recording.commandBuffer == VK_NULL_HANDLE) {
+            return nextToken - 1;
+        }
+        Token token = recording.token;
+        submitBatch();
+        return token;
+    }
+
+    bool MUploadManager::isComplete(Token token) {
+        std::lock_guard<std::mutex> lock{ mutex };
+        retireCompleted();
+        return token <= completedToken;
+    }
+
+    void MUploadManager::wait(Token token) {
+        std::lock_guard<std::mutex> lock{ mutex };
+
+        if (recording.commandBuffer != VK_NULL_HANDLE && token >= recording.token) {
+            submitBatch();
+        }
+        while (completedToken < token && !inFlight.empty()) {
+            retireOldest();
+        }
+    }
+
+    void MUploadManager::waitIdle() {
+        std::lock_guard<std::mutex> lock{ mutex };
+
+        if (recording.commandBuffer != VK_NULL_HANDLE) {
+            submitBatch();
+        }
+        while (!inFlight.empty()) {
+            retireOldest();
+        }
+    }
+
+    void MUploadManager::beginBatch() {
+        assert(recording.commandBuffer == VK_NULL_HANDLE && "A batch is already being recorded");
+
+        if (!freeCommandBuffers.empty()) {
+            recording.commandBuffer = freeCommandBuffers.back();
+            freeCommandBuffers.pop_back();
+        }
+        else {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandPool = commandPool;
+            allocInfo.commandBufferCount = 1;
+            if (vkAllocateCommandBuffers(mDevice.device(), &allocInfo, &recording.commandBuffer) !=
+                VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate upload command buffer!");
+            }
+        }
+
+        if (!freeFences.empty()) {
+            recording.fence = freeFences.back();
+            freeFences.pop_back();
+        }
+        else {
+            VkFenceCreateInfo fenceInfo = {};
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            if (vkCreateFence(mDevice.device(), &fenceInfo, nullptr, &recording.fence) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create upload fence!");
+            }
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(recording.commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin upload command buffer!");
+        }
+
+        recording.token = nextToken++;
+    }
+
+    void MUploadManager::submitBatch() {
+        if (vkEndCommandBuffer(recording.commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record upload command buffer!");
+        }
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &recording.commandBuffer;
+
+        {
+            std::lock_guard<std::mutex> queueLock{ mDevice.getQueueMutex() };
+            if (vkQueueSubmit(mDevice.transferQueue(), 1, &submitInfo, recording.fence) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit upload batch!");
+            }
+        }
+
+        inFlight.push_back(std::move(recording));
+        recording = {};
+    }
+
+    void MUploadManager::retireCompleted() {
+        while (!inFlight.empty() &&
+            vkGetFenceStatus(mDevice.device(), inFlight.front().fence) == VK_SUCCESS) {
+            retireOldest();
+        }
+    }
+
+    void MUploadManager::retireOldest() {
+        assert(!inFlight.empty() && "No upload batch in flight");
+        Batch& batch = inFlight.front();
+
+        vkWaitForFences(
+            mDevice.device(),
+            1,
+            &batch.fence,
+            VK_TRUE,
+            std::numeric_limits<uint64_t>::max());
+        vkResetFences(mDevice.device(), 1, &batch.fence);
+
+        freeFences.push_back(batch.fence);
+        freeCommandBuffers.push_back(batch.commandBuffer);
+        ringUsed -= batch.ringBytes;
+        completedToken = batch.token;
+
+        inFlight.pop_front();
+    }
+
+    void* MUploadManager::stage(VkDeviceSize size, VkBuffer& srcBuffer, VkDeviceSize& srcOffset) {
+        if (recording.commandBuffer == VK_NULL_HANDLE) {
+            beginBatch();
+        }
+
+        if (size > STAGING_RING_SIZE) {
+            // too big for the ring, give it its own staging buffer that lives as long as the batch
+            auto overflow = std::make_unique<MBuffer>(
+                mDevice,
+                size,
+                1,
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                1,
+                MAllocationKind::Staging);
+            overflow->map();
+            srcBuffer = overflow->getBuffer();
+            srcOffset = 0;
+            void* mapped = overflow->getMappedMemory();
+            recording.overflowBuffers.push_back(std::move(overflow));
+            return mapped;
+        }
+
+        while (!reserveRing(size, srcOffset)) {
+            // ring is full, push out what we have and wait for the oldest batch to hand its
+            // space back
+            if (recording.ringBytes > 0) {
+                submitBatch();
+                beginBatch();
+            }
+            else {
+                retireOldest();
+            }
+        }
+        srcBuffer = stagingRing->getBuffer();
+        return static_cast<char*>(stagingRing->getMappedMemory()) + srcOffset;
+    }
+
+    bool MUploadManager::reserveRing(VkDeviceSize size, VkDeviceSize& offset) {
+        if (ringUsed == 0) {
+            ringHead = 0;
+        }
+
+        VkDeviceSize aligned = (ringHead + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+        VkDeviceSize padding = aligned - ringHead;
+        if (aligned + size > STAGING_RING_SIZE) {
+            // doesn't fit before the end, skip the tail and wrap around to the start
+            padding = STAGING_RING_SIZE - ringHead;
+            aligned = 0;
+        }
+
+        if (ringUsed + padding + size > STAGING_RING_SIZE) {
+            return false;
+        }
+
+        ringUsed += padding + size;
+        recording.ringBytes += padding + size;
+        ringHead = aligned + size;
+        offset = aligned;
+        return true;
+    }
+
+}
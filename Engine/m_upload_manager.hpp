@@ -0,0 +1,88 @@
+#pragma once
+
+#include "m_buffer.hpp"
+#include "m_device.hpp"
+
+// std
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace m {
+
+    // Records buffer and image uploads into batches on the transfer queue. Data is copied into a
+    // persistently mapped staging ring, so nothing waits on the GPU unless the ring runs full.
+    // Every upload returns a token that can be polled to find out when the destination is safe
+    // to use.
+    class MUploadManager {
+    public:
+        using Token = uint64_t;
+
+        static constexpr VkDeviceSize STAGING_RING_SIZE = 64 * 1024 * 1024;
+        // a batch is submitted on its own once it has staged this much
+        static constexpr VkDeviceSize BATCH_SUBMIT_THRESHOLD = STAGING_RING_SIZE / 4;
+
+        // tightly packed texels or compressed blocks of one mip level
+        struct ImageLevel {
+            const void* data;
+            VkDeviceSize size;
+            uint32_t width;
+            uint32_t height;
+        };
+
+        MUploadManager(MDevice& device);
+        ~MUploadManager();
+
+        MUploadManager(const MUploadManager&) = delete;
+        MUploadManager& operator=(const MUploadManager&) = delete;
+
+        Token uploadBuffer(
+            VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+
+        // writes levels[i] to mip i of a color image with one layer, whatever it held before is
+        // discarded. the image is left in SHADER_READ_ONLY_OPTIMAL, and has to be shared with
+        // the transfer queue family when that is a different one
+        Token uploadImage(VkImage dstImage, const std::vector<ImageLevel>& levels);
+
+        // submits everything recorded so far, returns the token of the last upload
+        Token flush();
+        bool isComplete(Token token);
+        void wait(Token token);
+        void waitIdle();
+
+    private:
+        struct Batch {
+            Token token = 0;
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+            VkFence fence = VK_NULL_HANDLE;
+            VkDeviceSize ringBytes = 0;  // ring space this batch holds until it retires
+            std::vector<std::unique_ptr<MBuffer>> overflowBuffers{};
+        };
+
+        void beginBatch();
+        void submitBatch();
+        void retireCompleted();
+        void retireOldest();
+        bool reserveRing(VkDeviceSize size, VkDeviceSize& offset);
+        // staging space for size bytes in the recording batch, returns where to write them
+        void* stage(VkDeviceSize size, VkBuffer& srcBuffer, VkDeviceSize& srcOffset);
+
+        MDevice& mDevice;
+        VkCommandPool commandPool;
+        std::unique_ptr<MBuffer> stagingRing;
+
+        VkDeviceSize ringHead = 0;
+        VkDeviceSize ringUsed = 0;
+
+        Batch recording{};
+        std::deque<Batch> inFlight;
+        std::vector<VkCommandBuffer> freeCommandBuffers;
+        std::vector<VkFence> freeFences;
+
+        Token nextToken = 1;
+        Token completedToken = 0;
+        std::mutex mutex;
+    };
+
+}
@@ -5,11 +5,15 @@
 
 namespace m {
 
-	MWindow::MWindow(int w, int h, std::string name) : width{ w }, height{ h }, windowName{ name }{
-		initWindow();
+	MWindow::MWindow(int w, int h, std::string name, bool headless)
+		: width{ w }, height{ h }, headless{ headless }, windowName{ name } {
+		if (!headless) {
+			initWindow();
+		}
 	}
 
 	MWindow::~MWindow() {
+		if (headless) return;
 		glfwDestroyWindow(window);
 		glfwTerminate();
 	}
@@ -25,6 +29,9 @@ namespace m {
 	}
 
 	void MWindow::createWindowSurface(VkInstance instance, VkSurfaceKHR* surface) {
+		if (headless) {
+			throw std::runtime_error("A headless window has no surface!");
+		}
 		if (glfwCreateWindowSurface(instance, window, nullptr, surface) != VK_SUCCESS) {
 			throw std::runtime_error("Failed to create window surface!");
 		}
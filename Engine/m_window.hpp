@@ -8,13 +8,15 @@ namespace m {
 
 	class MWindow {
 	public:
-		MWindow(int w, int h, std::string name);
+		// a headless window never touches GLFW, it only carries the extent to render at
+		MWindow(int w, int h, std::string name, bool headless = false);
 		~MWindow();
 
 		MWindow(const MWindow&) = delete;
 		MWindow& operator=(const MWindow&) = delete;
 
-		bool shouldClose() { return glfwWindowShouldClose(window); }
+		bool shouldClose() { return window != nullptr && glfwWindowShouldClose(window); }
+		bool isHeadless() const { return headless; }
 		VkExtent2D getExtent() { return { static_cast<uint32_t>(width), static_cast<uint32_t>(height) }; };
 		bool wasWindowResized() { return framebufferResized; }
 		void resetWindowResizedFlag() { framebufferResized = false; }
@@ -29,8 +31,9 @@ namespace m {
 		int width;
 		int height;
 		bool framebufferResized = false;
+		bool headless;
 
 		std::string windowName;
-		GLFWwindow* window;
+		GLFWwindow* window = nullptr;
 	};
 }
\ No newline at end of file
@@ -1,10 +1,137 @@
 #include "first_app.hpp"
+#include "m_mesh_cache.hpp"
+#include "m_trace.hpp"
 #include <cstdlib>
+#include <cstring>
 #include <stdexcept>
 #include <iostream>
 
-int main() {
-	m::FirstApp app{};
+int main(int argc, char** argv) {
+	// Engine --cook <dir> writes the mesh cache for every model below dir and exits
+	if (argc >= 3 && std::strcmp(argv[1], "--cook") == 0) {
+		return m::MMeshCache::cookDirectory(argv[2]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// Engine --headless [--frames N] [--output dir] renders offscreen, N frames (1 by default),
+	// writing each one to dir as a ppm.
+	// Engine --benchmark [--objects N] [--lights N] [--meshes N] [--frames N] [--warmup N]
+	// [--seed N] [--camera-path file] [--report file] renders a synthetic scene along a camera
+	// path and writes frame timings as JSON, combine with --headless to run without a display.
+	// Engine --record-path file saves the path flown in an interactive session for --camera-path.
+	// Engine --gpu-profile file writes the GPU time of every profiler scope as JSON on exit.
+	// Engine --trace file records CPU zones and writes them as a Chrome trace on exit.
+	// Engine --render-mode direct|instanced|gpu picks how objects are drawn, and
+	// --no-parallel-recording records the render pass inline on the main thread.
+	// Engine --no-meshlet-culling draws whole objects in gpu mode, --cone-culling also drops
+	// meshlets facing away from the camera
+	// Engine --stream-texture file streams a KTX2 or DDS texture onto the models, repeat it to
+	// hand several out in turn. works with --benchmark too
+	m::FirstApp::Settings settings{};
+	std::string traceFile;
+	uint32_t frameCount = 0;
+	bool frameCountGiven = false;
+	for (int i = 1; i < argc; i++) {
+		auto hasValue = [&](const char* option) {
+			return std::strcmp(argv[i], option) == 0 && i + 1 < argc;
+		};
+		auto number = [&]() { return static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)); };
+
+		if (std::strcmp(argv[i], "--headless") == 0) {
+			settings.headless = true;
+		}
+		else if (std::strcmp(argv[i], "--benchmark") == 0) {
+			settings.benchmark = true;
+		}
+		else if (hasValue("--frames")) {
+			frameCount = number();
+			frameCountGiven = true;
+		}
+		else if (hasValue("--output")) {
+			settings.outputDirectory = argv[++i];
+		}
+		else if (hasValue("--record-path")) {
+			settings.recordPathFile = argv[++i];
+		}
+		else if (hasValue("--gpu-profile")) {
+			settings.gpuProfileFile = argv[++i];
+		}
+		else if (hasValue("--trace")) {
+			traceFile = argv[++i];
+		}
+		else if (hasValue("--render-mode")) {
+			const char* mode = argv[++i];
+			if (std::strcmp(mode, "direct") == 0) {
+				settings.renderMode = m::SimpleRenderSystem::RenderMode::Direct;
+			}
+			else if (std::strcmp(mode, "instanced") == 0) {
+				settings.renderMode = m::SimpleRenderSystem::RenderMode::Instanced;
+			}
+			else if (std::strcmp(mode, "gpu") == 0) {
+				settings.renderMode = m::SimpleRenderSystem::RenderMode::GpuDriven;
+			}
+			else {
+				std::cerr << "unknown render mode " << mode << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else if (std::strcmp(argv[i], "--no-parallel-recording") == 0) {
+			settings.parallelRecording = false;
+		}
+		else if (std::strcmp(argv[i], "--no-meshlet-culling") == 0) {
+			settings.meshletCulling = false;
+		}
+		else if (std::strcmp(argv[i], "--cone-culling") == 0) {
+			settings.coneCulling = true;
+		}
+		else if (hasValue("--stream-texture")) {
+			settings.streamedTextures.push_back(argv[++i]);
+		}
+		else if (hasValue("--objects")) {
+			settings.benchmarkConfig.objectCount = number();
+		}
+		else if (hasValue("--lights")) {
+			settings.benchmarkConfig.lightCount = number();
+		}
+		else if (hasValue("--meshes")) {
+			settings.benchmarkConfig.meshCount = number();
+		}
+		else if (hasValue("--warmup")) {
+			settings.benchmarkConfig.warmupFrames = number();
+		}
+		else if (hasValue("--seed")) {
+			settings.benchmarkConfig.seed = number();
+		}
+		else if (hasValue("--camera-path")) {
+			settings.benchmarkConfig.cameraPathFile = argv[++i];
+		}
+		else if (hasValue("--report")) {
+			settings.benchmarkConfig.reportPath = argv[++i];
+		}
+		else {
+			std::cerr << "unknown argument " << argv[i] << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	// the benchmark stops itself after its own frame count
+	if (settings.benchmark) {
+		if (frameCountGiven) {
+			settings.benchmarkConfig.frameCount = frameCount;
+		}
+	}
+	else if (frameCountGiven) {
+		settings.frameCount = frameCount;
+	}
+	else if (settings.headless) {
+		settings.frameCount = 1;
+	}
+
+	if (!traceFile.empty()) {
+		m::MTrace::setEnabled(true);
+		m::MTrace::setThreadName("Main");
+	}
+
+	m::FirstApp app{ settings };
 
 	try{
 		app.run();
@@ -12,6 +139,10 @@ int main() {
 		std::cerr << e.what() << std::endl;
 		return EXIT_FAILURE;
 	}
+
+	if (!traceFile.empty() && !m::MTrace::writeChromeTrace(traceFile)) {
+		std::cerr << "failed to write trace to " << traceFile << std::endl;
+	}
 	return EXIT_SUCCESS;
 
-}
\ No newline at end of file
+}
@@ -3,17 +3,13 @@
 layout (location = 0) in vec2 fragOffset;
 layout (location = 0) out vec4 outColor;
 
-struct PointLight {
-  vec4 position; // ignore w
-  vec4 color; // w is intensity
-};
-
 layout(set = 0, binding = 0) uniform GlobalUbo {
   mat4 projection;
   mat4 view;
   mat4 invView;
   vec4 ambientLightColor; // w is intensity
-  PointLight pointLights[10];
+  vec4 clusterDepth; // near, far, slice scale, slice bias
+  vec2 screenSize;
   int numLights;
 } ubo;
 
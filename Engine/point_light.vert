@@ -11,17 +11,13 @@ const vec2 OFFSETS[6] = vec2[](
 
 layout (location = 0) out vec2 fragOffset;
 
-struct PointLight {
-  vec4 position; // ignore w
-  vec4 color; // w is intensity
-};
-
 layout(set = 0, binding = 0) uniform GlobalUbo {
   mat4 projection;
   mat4 view;
   mat4 invView;
   vec4 ambientLightColor; // w is intensity
-  PointLight pointLights[10];
+  vec4 clusterDepth; // near, far, slice scale, slice bias
+  vec2 screenSize;
   int numLights;
 } ubo;
 
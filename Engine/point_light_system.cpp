@@ -1,5 +1,8 @@
 #include "point_light_system.hpp"
 
+#include "m_gpu_profiler.hpp"
+#include "m_trace.hpp"
+
 // libs
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -7,9 +10,9 @@
 #include <glm/gtc/constants.hpp>
 
 // std
+#include <algorithm>
 #include <array>
 #include <cassert>
-#include <map>
 #include <stdexcept>
 
 namespace m {
@@ -68,40 +71,32 @@ namespace m {
             pipelineConfig);
     }
 
-    void PointLightSystem::update(FrameInfo& frameInfo, GlobalUbo& ubo) {
-        auto rotateLight = glm::rotate(glm::mat4(1.f), 0.5f * frameInfo.frameTime, { 0.f, -1.f, 0.f });
-        int lightIndex = 0;
-        for (auto& kv : frameInfo.gameObjects) {
-            auto& obj = kv.second;
-            if (obj.pointLight == nullptr) continue;
-
-            assert(lightIndex < MAX_LIGHTS && "Point lights exceed maximum specified");
-
-            // update light position
-            obj.transform.translation = glm::vec3(rotateLight * glm::vec4(obj.transform.translation, 1.f));
+    void PointLightSystem::update(FrameInfo& frameInfo, MEntity lightRig) {
+        M_TRACE_ZONE("PointLightSystem::update");
+        if (!frameInfo.registry.valid(lightRig)) return;
 
-            // copy light to ubo
-            ubo.pointLights[lightIndex].position = glm::vec4(obj.transform.translation, 1.f);
-            ubo.pointLights[lightIndex].color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
-
-            lightIndex += 1;
-        }
-        ubo.numLights = lightIndex;
+        auto& transform = frameInfo.registry.get<TransformComponent>(lightRig);
+        glm::vec3 rotation = transform.getRotation();
+        rotation.y = glm::mod(rotation.y - 0.5f * frameInfo.frameTime, glm::two_pi<float>());
+        transform.setRotation(rotation);
     }
 
     void PointLightSystem::render(FrameInfo& frameInfo) {
-         // sort lights
-        std::map<float, MGameObject::id_t> sorted;
-        for (auto& kv : frameInfo.gameObjects) {
-            auto& obj = kv.second;
-            if (obj.pointLight == nullptr) continue;
-
+        // sort lights back to front for blending
+        sortedLights.clear();
+        frameInfo.registry.view<TransformComponent, PointLightComponent>().each(
+            [&](MEntity, TransformComponent& transform, PointLightComponent& light) {
             // calculate distance
-            auto offset = frameInfo.camera.getPosition() - obj.transform.translation;
+            auto offset = frameInfo.camera.getPosition() - transform.getWorldPosition();
             float disSquared = glm::dot(offset, offset);
-            sorted[disSquared] = obj.getId();
-        }
-
+            sortedLights.push_back({ disSquared, &transform, &light });
+        });
+        std::sort(
+            sortedLights.begin(),
+            sortedLights.end(),
+            [](const SortedLight& a, const SortedLight& b) { return a.distanceSquared > b.distanceSquared; });
+
+        MGpuProfiler::Scope scope{ frameInfo.profiler, frameInfo.commandBuffer, "PointLightSystem" };
         mPipeline->bind(frameInfo.commandBuffer);
 
         vkCmdBindDescriptorSets(
@@ -114,15 +109,11 @@ namespace m {
             0,
             nullptr);
 
-        // iterate through sorted lights in reverse order
-        for (auto it = sorted.rbegin(); it != sorted.rend(); ++it) {
-            // use game obj id to find light object
-            auto& obj = frameInfo.gameObjects.at(it->second);
-
+        for (const auto& sorted : sortedLights) {
             PointLightPushConstants push{};
-            push.position = glm::vec4(obj.transform.translation, 1.f);
-            push.color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
-            push.radius = obj.transform.scale.x;
+            push.position = glm::vec4(sorted.transform->getWorldPosition(), 1.f);
+            push.color = glm::vec4(sorted.light->color, sorted.light->lightIntensity);
+            push.radius = sorted.transform->getScale().x;
 
             vkCmdPushConstants(
                 frameInfo.commandBuffer,
@@ -132,6 +123,7 @@ namespace m {
                 sizeof(PointLightPushConstants),
                 &push);
             vkCmdDraw(frameInfo.commandBuffer, 6, 1, 0, 0);
+            frameInfo.stats.drawCalls++;
         }
     }
 
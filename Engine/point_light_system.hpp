@@ -20,10 +20,18 @@ namespace m {
         PointLightSystem(const PointLightSystem&) = delete;
         PointLightSystem& operator=(const PointLightSystem&) = delete;
 
-        void update(FrameInfo& frameInfo, GlobalUbo& ubo);
+        // spins the rig the lights are parented to, LightClusterSystem uploads them once the
+        // scene graph has carried them along
+        void update(FrameInfo& frameInfo, MEntity lightRig);
         void render(FrameInfo& frameInfo);
 
     private:
+        struct SortedLight {
+            float distanceSquared;
+            const TransformComponent* transform;
+            const PointLightComponent* light;
+        };
+
         void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
         void createPipeline(VkRenderPass renderPass);
 
@@ -31,5 +39,7 @@ namespace m {
 
         std::unique_ptr<MPipeline> mPipeline;
         VkPipelineLayout pipelineLayout;
+
+        std::vector<SortedLight> sortedLights;
     };
 }
\ No newline at end of file
@@ -1,5 +1,11 @@
 #include "simple_render_system.hpp"
 
+#include "m_gpu_profiler.hpp"
+#include "m_renderer.hpp"
+#include "m_swap_chain.hpp"
+#include "m_job_system.hpp"
+#include "m_trace.hpp"
+
 // libs
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -8,35 +14,107 @@
 #include <glm/gtc/constants.hpp>
 
 // std
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cmath>
+#include <cstddef>
 #include <stdexcept>
+#include <string>
 
 namespace m {
 
+    // a mat3 takes three vec4 columns in the push block, which keeps it within the 128 bytes
+    // every device has
     struct SimplePushConstantData {
         glm::mat4 modelMatrix{ 1.f };
-        glm::mat4 normalMatrix{ 1.f };
+        glm::mat3x4 normalMatrix{ 1.f };
+        uint32_t textureIndex = 0;
+    };
+
+    // matches Push in cull.comp and meshlet_cull.comp
+    struct CullPushConstants {
+        glm::vec4 frustumPlanes[MFrustum::Count];
+        glm::vec4 cameraPosition;
+        uint32_t objectCount;
+        uint32_t compact;
+        uint32_t meshletFlags;
+        uint32_t maxDraws;
+    };
+
+    static constexpr uint32_t MESHLET_CULLING = 1;
+    static constexpr uint32_t CONE_CULLING = 2;
+
+    // matches MeshletDispatch in cull.comp, a VkDispatchIndirectCommand and the task count
+    struct MeshletDispatch {
+        uint32_t groupCountX;
+        uint32_t groupCountY;
+        uint32_t groupCountZ;
+        uint32_t taskCount;
     };
 
+    // rotation keeps lengths, so only the longest axis of the matrix grows the bounding sphere.
+    // the axes carry the parents' scale as well
+    static float maxAxisScale(const glm::mat4& matrix) {
+        return glm::max(
+            glm::length(glm::vec3(matrix[0])),
+            glm::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+    }
+
     SimpleRenderSystem::SimpleRenderSystem(
-        MDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout)
-        : mDevice{ device } {
-        createPipelineLayout(globalSetLayout);
-        createPipeline(renderPass);
+        MDevice& device,
+        VkRenderPass renderPass,
+        VkDescriptorSetLayout globalSetLayout,
+        VkDescriptorSetLayout bindlessSetLayout,
+        RenderMode mode,
+        MMeshPool* meshPool)
+        : mDevice{ device }, meshPool{ meshPool } {
+        renderMode = mode;
+        if (renderMode == RenderMode::GpuDriven && !supportsGpuDriven()) {
+            renderMode = RenderMode::Instanced;
+        }
+
+        createPipelineLayout(globalSetLayout, bindlessSetLayout);
+        switch (renderMode) {
+        case RenderMode::Direct:
+            createPipeline(renderPass);
+            break;
+        case RenderMode::Instanced:
+            createInstancedPipeline(renderPass);
+            instanceBuffers.resize(MSwapChain::MAX_FRAMES_IN_FLIGHT);
+            break;
+        case RenderMode::GpuDriven:
+            // objects outside the mesh pool are drawn the Direct way
+            createPipeline(renderPass);
+            createGpuDrivenPipelines(renderPass, globalSetLayout, bindlessSetLayout);
+            break;
+        }
     }
 
     SimpleRenderSystem::~SimpleRenderSystem() {
         vkDestroyPipelineLayout(mDevice.device(), pipelineLayout, nullptr);
+        vkDestroyPipelineLayout(mDevice.device(), cullPipelineLayout, nullptr);
+        vkDestroyPipelineLayout(mDevice.device(), gpuPipelineLayout, nullptr);
+    }
+
+    bool SimpleRenderSystem::supportsGpuDriven() const {
+        // the indirect draws carry the object index in firstInstance
+        return meshPool != nullptr && mDevice.getFeatures().drawIndirectFirstInstance;
+    }
+
+    bool SimpleRenderSystem::usesMeshletCulling() const {
+        // the number of meshlets left is only known on the GPU
+        return meshletCulling && mDevice.getFeatures().drawIndirectCount;
     }
 
-    void SimpleRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+    void SimpleRenderSystem::createPipelineLayout(
+        VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout bindlessSetLayout) {
         VkPushConstantRange pushConstantRange{};
         pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
         pushConstantRange.offset = 0;
         pushConstantRange.size = sizeof(SimplePushConstantData);
 
-        std::vector<VkDescriptorSetLayout> descriptorSetLayouts{ globalSetLayout };
+        std::vector<VkDescriptorSetLayout> descriptorSetLayouts{ globalSetLayout, bindlessSetLayout };
 
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -59,7 +137,7 @@ namespace m {
         pipelineConfig.pipelineLayout = pipelineLayout;
         mPipeline = std::make_unique<MPipeline>(
             mDevice,
-            "simple_shader.vert.spv",
+            std::string("simple_shader") + MModel::VERTEX_SHADER_SUFFIX,
             "simple_shader.frag.spv",
             pipelineConfig);
         
@@ -67,36 +145,705 @@ namespace m {
         std::cout << "Present mode: V-Sync" << std::endl;
     }
 
+    void SimpleRenderSystem::createInstancedPipeline(VkRenderPass renderPass) {
+        assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
+
+        PipelineConfigInfo pipelineConfig{};
+        MPipeline::defaultPipelineConfigInfo(pipelineConfig);
+
+        // binding 1 steps once per instance, each mat4 is fed in as four vec4 columns
+        VkVertexInputBindingDescription instanceBinding{};
+        instanceBinding.binding = 1;
+        instanceBinding.stride = sizeof(InstanceData);
+        instanceBinding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+        pipelineConfig.bindingDescriptions.push_back(instanceBinding);
+
+        for (uint32_t column = 0; column < 4; column++) {
+            pipelineConfig.attributeDescriptions.push_back({
+                4 + column,
+                1,
+                VK_FORMAT_R32G32B32A32_SFLOAT,
+                static_cast<uint32_t>(offsetof(InstanceData, modelMatrix) + column * sizeof(glm::vec4)) });
+        }
+        for (uint32_t column = 0; column < 4; column++) {
+            pipelineConfig.attributeDescriptions.push_back({
+                8 + column,
+                1,
+                VK_FORMAT_R32G32B32A32_SFLOAT,
+                static_cast<uint32_t>(offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec4)) });
+        }
+        pipelineConfig.attributeDescriptions.push_back({
+            12, 1, VK_FORMAT_R32_UINT, static_cast<uint32_t>(offsetof(InstanceData, textureIndex)) });
+
+        pipelineConfig.renderPass = renderPass;
+        pipelineConfig.pipelineLayout = pipelineLayout;
+        instancedPipeline = std::make_unique<MPipeline>(
+            mDevice,
+            std::string("simple_shader_instanced") + MModel::VERTEX_SHADER_SUFFIX,
+            "simple_shader.frag.spv",
+            pipelineConfig);
+    }
+
+    void SimpleRenderSystem::createGpuDrivenPipelines(
+        VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout bindlessSetLayout) {
+        const uint32_t frameCount = MSwapChain::MAX_FRAMES_IN_FLIGHT;
+        gpuDescriptorPool =
+            MDescriptorPool::Builder(mDevice)
+            .setMaxSets(2 * frameCount)
+            .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8 * frameCount)
+            .build();
+
+        cullSetLayout =
+            MDescriptorSetLayout::Builder(mDevice)
+            .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+            .build();
+        objectSetLayout =
+            MDescriptorSetLayout::Builder(mDevice)
+            .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+            .build();
+
+        VkPushConstantRange cullPushRange{};
+        cullPushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        cullPushRange.offset = 0;
+        cullPushRange.size = sizeof(CullPushConstants);
+
+        VkDescriptorSetLayout cullLayouts[] = { cullSetLayout->getDescriptorSetLayout() };
+        VkPipelineLayoutCreateInfo cullLayoutInfo{};
+        cullLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        cullLayoutInfo.setLayoutCount = 1;
+        cullLayoutInfo.pSetLayouts = cullLayouts;
+        cullLayoutInfo.pushConstantRangeCount = 1;
+        cullLayoutInfo.pPushConstantRanges = &cullPushRange;
+        if (vkCreatePipelineLayout(mDevice.device(), &cullLayoutInfo, nullptr, &cullPipelineLayout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create cull pipeline layout!");
+        }
+        cullPipeline = std::make_unique<MPipeline>(mDevice, "cull.comp.spv", cullPipelineLayout);
+        meshletCullPipeline = std::make_unique<MPipeline>(mDevice, "meshlet_cull.comp.spv", cullPipelineLayout);
+
+        // the bindless set keeps the same number as in the other modes, which share the fragment
+        // shader, so the objects go in set 2
+        VkDescriptorSetLayout gpuLayouts[] = {
+            globalSetLayout, bindlessSetLayout, objectSetLayout->getDescriptorSetLayout() };
+        VkPipelineLayoutCreateInfo gpuLayoutInfo{};
+        gpuLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        gpuLayoutInfo.setLayoutCount = 3;
+        gpuLayoutInfo.pSetLayouts = gpuLayouts;
+        if (vkCreatePipelineLayout(mDevice.device(), &gpuLayoutInfo, nullptr, &gpuPipelineLayout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create gpu driven pipeline layout!");
+        }
+
+        PipelineConfigInfo pipelineConfig{};
+        MPipeline::defaultPipelineConfigInfo(pipelineConfig);
+        pipelineConfig.renderPass = renderPass;
+        pipelineConfig.pipelineLayout = gpuPipelineLayout;
+        gpuPipeline = std::make_unique<MPipeline>(
+            mDevice,
+            std::string("simple_shader_gpu") + MModel::VERTEX_SHADER_SUFFIX,
+            "simple_shader.frag.spv",
+            pipelineConfig);
+
+        gpuFrames.resize(frameCount);
+    }
+
+    void SimpleRenderSystem::collectObjects(FrameInfo& frameInfo) {
+        M_TRACE_ZONE("SimpleRenderSystem::collectObjects");
+        lodCameraPosition = frameInfo.camera.getPosition();
+        // screen height in pixels of a unit long segment at unit distance
+        lodPixelsPerUnit = std::abs(frameInfo.camera.getProjection()[1][1]) * frameInfo.extent.height * .5f;
+        if (renderMode == RenderMode::GpuDriven) {
+            collectGpuDriven(frameInfo);
+        }
+        else {
+            collectVisible(frameInfo);
+        }
+        objectsCollected = true;
+    }
+
+    void SimpleRenderSystem::prepareFrame(FrameInfo& frameInfo) {
+        M_TRACE_ZONE("SimpleRenderSystem::prepareFrame");
+        if (!objectsCollected) {
+            collectObjects(frameInfo);
+        }
+        if (renderMode == RenderMode::GpuDriven) {
+            prepareGpuDriven(frameInfo);
+        }
+    }
+
     void SimpleRenderSystem::renderGameObjects(FrameInfo& frameInfo) {
-        mPipeline->bind(frameInfo.commandBuffer);
+        M_TRACE_ZONE("SimpleRenderSystem::renderGameObjects");
+        if (!objectsCollected) {
+            collectObjects(frameInfo);
+        }
+        objectsCollected = false;
 
-        vkCmdBindDescriptorSets(
+        if (frameInfo.renderer == nullptr) {
+            MGpuProfiler::Scope scope{ frameInfo.profiler, frameInfo.commandBuffer, "SimpleRenderSystem" };
+            recordDraws(frameInfo);
+            return;
+        }
+
+        // only Direct mode records a command per object, the others stay on this thread
+        if (renderMode == RenderMode::Direct && drawItems.size() > OBJECTS_PER_RECORDING_CHUNK) {
+            renderDirectParallel(frameInfo);
+            return;
+        }
+
+        VkCommandBuffer primaryCommandBuffer = frameInfo.commandBuffer;
+        frameInfo.commandBuffer = frameInfo.renderer->beginSecondaryCommandBuffer(0);
+        {
+            MGpuProfiler::Scope scope{ frameInfo.profiler, frameInfo.commandBuffer, "SimpleRenderSystem" };
+            recordDraws(frameInfo);
+        }
+        frameInfo.renderer->endSecondaryCommandBuffer(frameInfo.commandBuffer);
+        vkCmdExecuteCommands(primaryCommandBuffer, 1, &frameInfo.commandBuffer);
+        frameInfo.commandBuffer = primaryCommandBuffer;
+    }
+
+    void SimpleRenderSystem::recordDraws(FrameInfo& frameInfo) {
+        switch (renderMode) {
+        case RenderMode::GpuDriven:
+            renderGpuDriven(frameInfo);
+            // drawItems holds whatever prepareFrame found outside the mesh pool
+            if (!drawItems.empty()) {
+                renderDirect(frameInfo);
+            }
+            break;
+        case RenderMode::Direct:
+            if (!drawItems.empty()) {
+                renderDirect(frameInfo);
+            }
+            break;
+        case RenderMode::Instanced:
+            if (!drawItems.empty()) {
+                renderInstanced(frameInfo);
+            }
+            break;
+        }
+    }
+
+    void SimpleRenderSystem::collectVisible(FrameInfo& frameInfo) {
+        drawItems.clear();
+        culler.clear();
+        frameInfo.registry.view<TransformComponent, ModelComponent>().each(
+            [&](MEntity, TransformComponent& transform, ModelComponent& renderable) {
+            if (renderable.model == nullptr || !renderable.model->isReady()) return;
+            addDrawItem(renderable, transform);
+        });
+        cullDrawItems(frameInfo);
+        submittedObjectCount = 0;
+    }
+
+    void SimpleRenderSystem::addDrawItem(ModelComponent& renderable, TransformComponent& transform) {
+        DrawItem item{ renderable.model.get(), &transform, transform.mat4(), renderable.textureIndex, 0 };
+
+        const MModel::Bounds& bounds = item.model->getBounds();
+        float scale = maxAxisScale(item.modelMatrix);
+        glm::vec3 center = glm::vec3(item.modelMatrix * glm::vec4(bounds.center, 1.f));
+        culler.addSphere(center, bounds.radius * scale);
+
+        renderable.lod = selectLod(*item.model, center, bounds.radius * scale, scale, renderable.lod);
+        item.lod = renderable.lod;
+        drawItems.push_back(item);
+    }
+
+    uint32_t SimpleRenderSystem::selectLod(
+        const MModel& model, const glm::vec3& center, float radius, float scale, uint32_t currentLod) const {
+        uint32_t lodCount = model.getLodCount();
+        if (lodCount == 1) {
+            return 0;
+        }
+
+        // the errors are distances on the mesh, seen from the nearest point of its sphere
+        float distance = glm::length(center - lodCameraPosition) - radius;
+        if (distance <= 0.f) {
+            return 0;
+        }
+        float pixelsPerModelUnit = lodPixelsPerUnit * scale / distance;
+
+        uint32_t lod = std::min(currentLod, lodCount - 1);
+        while (lod > 0 && model.getLod(lod).error * pixelsPerModelUnit > LOD_ERROR_PIXELS) {
+            lod--;
+        }
+        while (lod + 1 < lodCount &&
+            model.getLod(lod + 1).error * pixelsPerModelUnit < LOD_ERROR_PIXELS * (1.f - LOD_HYSTERESIS)) {
+            lod++;
+        }
+        return lod;
+    }
+
+    void SimpleRenderSystem::cullDrawItems(FrameInfo& frameInfo) {
+        size_t candidateCount = drawItems.size();
+        if (frustumCulling) {
+            culler.cull(frameInfo.camera.getFrustum(), visibility);
+
+            size_t visibleCount = 0;
+            for (size_t i = 0; i < drawItems.size(); i++) {
+                if (visibility[i]) {
+                    drawItems[visibleCount++] = drawItems[i];
+                }
+            }
+            drawItems.resize(visibleCount);
+        }
+
+        visibleObjectCount = static_cast<uint32_t>(drawItems.size());
+        culledObjectCount = static_cast<uint32_t>(candidateCount - drawItems.size());
+        frameInfo.stats.objectsDrawn += visibleObjectCount;
+        frameInfo.stats.objectsCulled += culledObjectCount;
+    }
+
+    void SimpleRenderSystem::renderDirect(FrameInfo& frameInfo) {
+        recordDirect(frameInfo.commandBuffer, frameInfo, 0, drawItems.size());
+        frameInfo.stats.drawCalls += static_cast<uint32_t>(drawItems.size());
+    }
+
+    void SimpleRenderSystem::renderDirectParallel(FrameInfo& frameInfo) {
+        MRenderer& renderer = *frameInfo.renderer;
+        size_t chunkCount = std::min<size_t>(
+            renderer.getRecordingSlotCount(),
+            (drawItems.size() + OBJECTS_PER_RECORDING_CHUNK - 1) / OBJECTS_PER_RECORDING_CHUNK);
+        size_t chunkSize = (drawItems.size() + chunkCount - 1) / chunkCount;
+
+        // the primary buffer takes nothing but vkCmdExecuteCommands inside the pass, so there is
+        // no GPU scope around the chunks
+        chunkCommandBuffers.resize(chunkCount);
+        MJobSystem::shared().parallelFor(chunkCount, 1, [&](size_t first, size_t last) {
+            for (size_t chunk = first; chunk < last; chunk++) {
+                M_TRACE_ZONE("SimpleRenderSystem record chunk");
+                // every thread records from its own slot, so no two threads share a command pool
+                VkCommandBuffer commandBuffer = renderer.beginSecondaryCommandBuffer(MJobSystem::threadIndex());
+                size_t begin = chunk * chunkSize;
+                recordDirect(commandBuffer, frameInfo, begin, std::min(begin + chunkSize, drawItems.size()));
+                renderer.endSecondaryCommandBuffer(commandBuffer);
+                chunkCommandBuffers[chunk] = commandBuffer;
+            }
+        });
+
+        vkCmdExecuteCommands(
             frameInfo.commandBuffer,
+            static_cast<uint32_t>(chunkCommandBuffers.size()),
+            chunkCommandBuffers.data());
+        frameInfo.stats.drawCalls += static_cast<uint32_t>(drawItems.size());
+    }
+
+    void SimpleRenderSystem::recordDirect(
+        VkCommandBuffer commandBuffer, const FrameInfo& frameInfo, size_t begin, size_t end) const {
+        mPipeline->bind(commandBuffer);
+
+        // the textures are all in the bindless set, so nothing is bound per draw
+        VkDescriptorSet sets[] = { frameInfo.globalDescriptorSet, frameInfo.bindlessDescriptorSet };
+        vkCmdBindDescriptorSets(
+            commandBuffer,
             VK_PIPELINE_BIND_POINT_GRAPHICS,
             pipelineLayout,
             0,
-            1,
-            &frameInfo.globalDescriptorSet,
+            2,
+            sets,
             0,
             nullptr);
 
-        for (auto& kv : frameInfo.gameObjects) {
-            auto& obj = kv.second;
-            if (obj.model == nullptr) continue;
-
+        for (size_t i = begin; i < end; i++) {
+            const DrawItem& item = drawItems[i];
             SimplePushConstantData push{};
-            push.modelMatrix = obj.transform.mat4();
-            push.normalMatrix = obj.transform.normalMatrix();
+            push.modelMatrix = item.model->positionMatrix(item.modelMatrix);
+            push.normalMatrix = glm::mat3x4(item.transform->normalMatrix());
+            push.textureIndex = item.textureIndex;
 
             vkCmdPushConstants(
-                frameInfo.commandBuffer,
+                commandBuffer,
                 pipelineLayout,
                 VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
                 0,
                 sizeof(SimplePushConstantData),
                 &push);
-            obj.model->bind(frameInfo.commandBuffer);
-            obj.model->draw(frameInfo.commandBuffer);
+            item.model->bind(commandBuffer);
+            item.model->draw(commandBuffer, 1, 0, item.lod);
+        }
+    }
+
+    void SimpleRenderSystem::renderInstanced(FrameInfo& frameInfo) {
+        // count the objects per model and LOD first, so every batch gets one contiguous run of
+        // instances
+        batches.clear();
+        batchLookup.clear();
+        for (const auto& item : drawItems) {
+            auto found = batchLookup.find({ item.model, item.lod });
+            if (found == batchLookup.end()) {
+                found = batchLookup.emplace(std::make_pair(item.model, item.lod), batches.size()).first;
+                batches.push_back({ item.model, item.lod, 0, 0 });
+            }
+            batches[found->second].instanceCount++;
+        }
+
+        uint32_t instanceTotal = 0;
+        for (auto& batch : batches) {
+            batch.firstInstance = instanceTotal;
+            instanceTotal += batch.instanceCount;
+            batch.instanceCount = 0;
+        }
+
+        MBuffer& instanceBuffer = reserveInstanceBuffer(frameInfo.frameIndex, instanceTotal);
+        auto* instances = static_cast<InstanceData*>(instanceBuffer.getMappedMemory());
+        for (const auto& item : drawItems) {
+            InstanceBatch& batch = batches[batchLookup[{ item.model, item.lod }]];
+            InstanceData& instance = instances[batch.firstInstance + batch.instanceCount++];
+            instance.modelMatrix = item.model->positionMatrix(item.modelMatrix);
+            instance.normalMatrix = item.transform->normalMatrix();
+            instance.textureIndex = item.textureIndex;
+        }
+        instanceBuffer.flush();
+
+        instancedPipeline->bind(frameInfo.commandBuffer);
+
+        VkDescriptorSet sets[] = { frameInfo.globalDescriptorSet, frameInfo.bindlessDescriptorSet };
+        vkCmdBindDescriptorSets(
+            frameInfo.commandBuffer,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            pipelineLayout,
+            0,
+            2,
+            sets,
+            0,
+            nullptr);
+
+        VkBuffer buffers[] = { instanceBuffer.getBuffer() };
+        VkDeviceSize offsets[] = { 0 };
+        vkCmdBindVertexBuffers(frameInfo.commandBuffer, 1, 1, buffers, offsets);
+
+        for (auto& batch : batches) {
+            batch.model->bind(frameInfo.commandBuffer);
+            batch.model->draw(frameInfo.commandBuffer, batch.instanceCount, batch.firstInstance, batch.lod);
+            frameInfo.stats.drawCalls++;
+        }
+    }
+
+    MBuffer& SimpleRenderSystem::reserveInstanceBuffer(int frameIndex, uint32_t instanceCount) {
+        auto& buffer = instanceBuffers[frameIndex];
+        if (buffer == nullptr || buffer->getInstanceCount() < instanceCount) {
+            // the fence for this frame index has been waited on, so the old buffer is idle
+            uint32_t capacity = buffer == nullptr ? 1024 : buffer->getInstanceCount();
+            while (capacity < instanceCount) {
+                capacity *= 2;
+            }
+
+            buffer = std::make_unique<MBuffer>(
+                mDevice,
+                sizeof(InstanceData),
+                capacity,
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            buffer->map();
+        }
+        return *buffer;
+    }
+
+    void SimpleRenderSystem::collectGpuDriven(FrameInfo& frameInfo) {
+        pooledObjects.clear();
+        drawItems.clear();
+        culler.clear();
+        frameInfo.registry.view<TransformComponent, ModelComponent>().each(
+            [&](MEntity, TransformComponent& transform, ModelComponent& renderable) {
+            if (renderable.model == nullptr || !renderable.model->isReady()) return;
+
+            if (!renderable.model->isPooled()) {
+                addDrawItem(renderable, transform);
+                return;
+            }
+            pooledObjects.push_back({ renderable.model.get(), &transform, &renderable });
+        });
+        cullDrawItems(frameInfo);
+        // how many of these the cull shader keeps stays on the GPU
+        submittedObjectCount = static_cast<uint32_t>(pooledObjects.size());
+        frameInfo.stats.objectsSubmitted += submittedObjectCount;
+
+        // the matrices are cached on the transforms, but copying them out still adds up with
+        // many objects
+        objectScratch.resize(pooledObjects.size());
+        MJobSystem::shared().parallelFor(pooledObjects.size(), TRANSFORM_GRAIN_SIZE, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; i++) {
+                const PooledObject& pooled = pooledObjects[i];
+                ObjectData& object = objectScratch[i];
+                // the cull shader takes the mesh's sphere through the same matrix as the vertices
+                const glm::mat4& modelMatrix = pooled.transform->mat4();
+                object.modelMatrix = pooled.model->positionMatrix(modelMatrix);
+                object.normalMatrix = pooled.transform->normalMatrix();
+                object.meshId = pooled.model->getMeshId();
+                object.textureIndex = pooled.renderable->textureIndex;
+
+                // every object has a component of its own, so the jobs don't share any
+                const MModel::Bounds& bounds = pooled.model->getBounds();
+                float scale = maxAxisScale(modelMatrix);
+                glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(bounds.center, 1.f));
+                pooled.renderable->lod = selectLod(
+                    *pooled.model, center, bounds.radius * scale, scale, pooled.renderable->lod);
+                object.lod = pooled.renderable->lod;
+            }
+        });
+
+        gpuMaxDraws = static_cast<uint32_t>(pooledObjects.size());
+        if (usesMeshletCulling()) {
+            for (size_t i = 0; i < pooledObjects.size(); i++) {
+                uint32_t meshletCount = pooledObjects[i].model->getMeshletCount(objectScratch[i].lod);
+                gpuMaxDraws += meshletCount > 0 ? meshletCount - 1 : 0;
+            }
+        }
+    }
+
+    void SimpleRenderSystem::prepareGpuDriven(FrameInfo& frameInfo) {
+        GpuFrame& frame = gpuFrames[frameInfo.frameIndex];
+        frame.objectCount = static_cast<uint32_t>(objectScratch.size());
+        if (frame.objectCount == 0) {
+            return;
+        }
+
+        frame.maxDraws = gpuMaxDraws;
+        reserveGpuFrame(frame, frame.objectCount, frame.maxDraws);
+        frame.objectBuffer->writeToBuffer(
+            objectScratch.data(), sizeof(ObjectData) * objectScratch.size());
+        frame.objectBuffer->flush();
+
+        VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+        MGpuProfiler::Scope scope{ frameInfo.profiler, commandBuffer, "Cull" };
+        bool meshlets = usesMeshletCulling();
+        vkCmdFillBuffer(commandBuffer, frame.drawCountBuffer->getBuffer(), 0, sizeof(uint32_t), 0);
+        if (meshlets) {
+            MeshletDispatch dispatch{ 0, 1, 1, 0 };
+            vkCmdUpdateBuffer(
+                commandBuffer, frame.meshletDispatchBuffer->getBuffer(), 0, sizeof(dispatch), &dispatch);
+        }
+
+        VkMemoryBarrier clearBarrier{};
+        clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        // the meshlet dispatch is read as it was cleared when no object gets that far
+        clearBarrier.dstAccessMask =
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+            0,
+            1,
+            &clearBarrier,
+            0,
+            nullptr,
+            0,
+            nullptr);
+
+        CullPushConstants push{};
+        MFrustum frustum = frameInfo.camera.getFrustum();
+        for (int i = 0; i < MFrustum::Count; i++) {
+            // a plane nothing can be behind turns culling off
+            push.frustumPlanes[i] = frustumCulling ? frustum.planes[i] : glm::vec4{ 0.f, 0.f, 0.f, 1.f };
+        }
+        push.cameraPosition = glm::vec4(frameInfo.camera.getPosition(), 1.f);
+        push.objectCount = frame.objectCount;
+        push.compact = mDevice.getFeatures().drawIndirectCount ? 1 : 0;
+        push.meshletFlags = meshlets ? MESHLET_CULLING | (coneCulling ? CONE_CULLING : 0) : 0;
+        push.maxDraws = frame.maxDraws;
+
+        cullPipeline->bind(commandBuffer);
+        vkCmdBindDescriptorSets(
+            commandBuffer,
+            VK_PIPELINE_BIND_POINT_COMPUTE,
+            cullPipelineLayout,
+            0,
+            1,
+            &frame.cullSet,
+            0,
+            nullptr);
+        vkCmdPushConstants(
+            commandBuffer,
+            cullPipelineLayout,
+            VK_SHADER_STAGE_COMPUTE_BIT,
+            0,
+            sizeof(CullPushConstants),
+            &push);
+        vkCmdDispatch(commandBuffer, (frame.objectCount + 63) / 64, 1, 1);
+
+        if (meshlets) {
+            VkMemoryBarrier taskBarrier{};
+            taskBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            taskBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            taskBarrier.dstAccessMask =
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+            vkCmdPipelineBarrier(
+                commandBuffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                0,
+                1,
+                &taskBarrier,
+                0,
+                nullptr,
+                0,
+                nullptr);
+
+            // same layout, so the set and push constants stay bound
+            meshletCullPipeline->bind(commandBuffer);
+            vkCmdDispatchIndirect(commandBuffer, frame.meshletDispatchBuffer->getBuffer(), 0);
+        }
+
+        VkMemoryBarrier cullBarrier{};
+        cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+            0,
+            1,
+            &cullBarrier,
+            0,
+            nullptr,
+            0,
+            nullptr);
+    }
+
+    void SimpleRenderSystem::renderGpuDriven(FrameInfo& frameInfo) {
+        GpuFrame& frame = gpuFrames[frameInfo.frameIndex];
+        if (frame.objectCount == 0) {
+            return;
+        }
+
+        VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+        gpuPipeline->bind(commandBuffer);
+
+        VkDescriptorSet sets[] = { frameInfo.globalDescriptorSet, frameInfo.bindlessDescriptorSet, frame.objectSet };
+        vkCmdBindDescriptorSets(
+            commandBuffer,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            gpuPipelineLayout,
+            0,
+            3,
+            sets,
+            0,
+            nullptr);
+        meshPool->bind(commandBuffer);
+
+        const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+        VkBuffer drawCommands = frame.drawCommandBuffer->getBuffer();
+        const DeviceFeatures& features = mDevice.getFeatures();
+        if (features.drawIndirectCount) {
+            vkCmdDrawIndexedIndirectCount(
+                commandBuffer,
+                drawCommands,
+                0,
+                frame.drawCountBuffer->getBuffer(),
+                0,
+                frame.maxDraws,
+                stride);
+            frameInfo.stats.drawCalls++;
+        }
+        else if (features.multiDrawIndirect) {
+            // culled objects are left in place with an instance count of zero
+            vkCmdDrawIndexedIndirect(commandBuffer, drawCommands, 0, frame.objectCount, stride);
+            frameInfo.stats.drawCalls++;
+        }
+        else {
+            for (uint32_t i = 0; i < frame.objectCount; i++) {
+                vkCmdDrawIndexedIndirect(commandBuffer, drawCommands, i * stride, 1, stride);
+            }
+            frameInfo.stats.drawCalls += frame.objectCount;
+        }
+    }
+
+    void SimpleRenderSystem::reserveGpuFrame(GpuFrame& frame, uint32_t objectCount, uint32_t maxDraws) {
+        auto grow = [](const std::unique_ptr<MBuffer>& buffer, uint32_t count) {
+            uint32_t capacity = buffer == nullptr ? 1024 : buffer->getInstanceCount();
+            while (capacity < count) {
+                capacity *= 2;
+            }
+            return capacity;
+        };
+        bool objectsFit = frame.objectBuffer != nullptr && frame.objectBuffer->getInstanceCount() >= objectCount;
+        bool drawsFit =
+            frame.drawCommandBuffer != nullptr && frame.drawCommandBuffer->getInstanceCount() >= maxDraws;
+        if (objectsFit && drawsFit) {
+            return;
+        }
+
+        if (!objectsFit) {
+            uint32_t capacity = grow(frame.objectBuffer, objectCount);
+            frame.objectBuffer = std::make_unique<MBuffer>(
+                mDevice,
+                sizeof(ObjectData),
+                capacity,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            frame.objectBuffer->map();
+
+            // at most a task per object
+            frame.meshletTaskBuffer = std::make_unique<MBuffer>(
+                mDevice,
+                sizeof(uint32_t) * 4,
+                capacity,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        }
+
+        if (!drawsFit) {
+            frame.drawCommandBuffer = std::make_unique<MBuffer>(
+                mDevice,
+                sizeof(VkDrawIndexedIndirectCommand),
+                grow(frame.drawCommandBuffer, maxDraws),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        }
+
+        if (frame.drawCountBuffer == nullptr) {
+            frame.drawCountBuffer = std::make_unique<MBuffer>(
+                mDevice,
+                sizeof(uint32_t),
+                1,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            frame.meshletDispatchBuffer = std::make_unique<MBuffer>(
+                mDevice,
+                sizeof(MeshletDispatch),
+                1,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        }
+
+        auto objectInfo = frame.objectBuffer->descriptorInfo();
+        auto meshInfo = meshPool->meshInfoDescriptor();
+        auto drawInfo = frame.drawCommandBuffer->descriptorInfo();
+        auto countInfo = frame.drawCountBuffer->descriptorInfo();
+        auto dispatchInfo = frame.meshletDispatchBuffer->descriptorInfo();
+        auto taskInfo = frame.meshletTaskBuffer->descriptorInfo();
+        auto meshletInfo = meshPool->meshletDescriptor();
+
+        // this frame's fence has been waited on, so its sets are free to rewrite
+        MDescriptorWriter cullWriter{ *cullSetLayout, *gpuDescriptorPool };
+        cullWriter
+            .writeBuffer(0, &objectInfo)
+            .writeBuffer(1, &meshInfo)
+            .writeBuffer(2, &drawInfo)
+            .writeBuffer(3, &countInfo)
+            .writeBuffer(4, &dispatchInfo)
+            .writeBuffer(5, &taskInfo)
+            .writeBuffer(6, &meshletInfo);
+        MDescriptorWriter objectWriter{ *objectSetLayout, *gpuDescriptorPool };
+        objectWriter.writeBuffer(0, &objectInfo);
+
+        if (frame.cullSet == VK_NULL_HANDLE) {
+            cullWriter.build(frame.cullSet);
+            objectWriter.build(frame.objectSet);
+        }
+        else {
+            cullWriter.overwrite(frame.cullSet);
+            objectWriter.overwrite(frame.objectSet);
         }
     }
 
@@ -1,34 +1,208 @@
 #pragma once
 
+#include "m_buffer.hpp"
 #include "m_camera.hpp"
+#include "m_descriptors.hpp"
 #include "m_device.hpp"
 #include "m_frame_info.hpp"
+#include "m_frustum_culler.hpp"
 #include "m_game_object.hpp"
+#include "m_mesh_pool.hpp"
 #include "m_pipeline.hpp"
 
 //std
 #include <memory>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace m {
 	class SimpleRenderSystem {
 	public:
+		// with FrameInfo::renderer set, Direct mode splits its objects into chunks of at least this
+		// many and records them in parallel
+		static constexpr size_t OBJECTS_PER_RECORDING_CHUNK = 256;
+		// objects per job when computing the GpuDriven object matrices
+		static constexpr size_t TRANSFORM_GRAIN_SIZE = 1024;
+		// an object gets the coarsest LOD whose error covers at most this many pixels on screen.
+		// a coarser one than drawn last frame has to fit LOD_HYSTERESIS below it, so an object
+		// sitting on a boundary doesn't switch back and forth
+		static constexpr float LOD_ERROR_PIXELS = 1.f;
+		static constexpr float LOD_HYSTERESIS = .25f;
+
+		enum class RenderMode {
+			Direct,  // push constants and a draw per object
+			Instanced,  // one instanced draw per model, transforms in a per frame vertex buffer
+			GpuDriven,  // pooled models are culled by a compute shader and drawn indirectly
+		};
+
+		// only the pipelines mode draws with are created. GpuDriven mode needs the pool the
+		// models were loaded into, and falls back to Instanced when there is none or the device
+		// can't draw it. bindlessSetLayout is MBindlessTable's, the objects' textures are read from it
 		SimpleRenderSystem(
-			MDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+			MDevice& device,
+			VkRenderPass renderPass,
+			VkDescriptorSetLayout globalSetLayout,
+			VkDescriptorSetLayout bindlessSetLayout,
+			RenderMode mode,
+			MMeshPool* meshPool = nullptr);
 		~SimpleRenderSystem();
 
 		SimpleRenderSystem(const SimpleRenderSystem&) = delete;
 		SimpleRenderSystem& operator=(const SimpleRenderSystem&) = delete;
 
+		bool supportsGpuDriven() const;
+		RenderMode getRenderMode() const { return renderMode; }
+
+		void setFrustumCulling(bool enabled) { frustumCulling = enabled; }
+		bool getFrustumCulling() const { return frustumCulling; }
+		// GpuDriven mode culls the meshlets of the objects that pass against the frustum too, when
+		// the device can draw a count the GPU wrote
+		void setMeshletCulling(bool enabled) { meshletCulling = enabled; }
+		bool getMeshletCulling() const { return meshletCulling; }
+		// and drops meshlets facing away from the camera. off by default, as the pipelines draw
+		// both sides of a triangle and open meshes show their insides
+		void setConeCulling(bool enabled) { coneCulling = enabled; }
+		bool getConeCulling() const { return coneCulling; }
+
+		// objects drawn and objects rejected by the frustum on the CPU in the last
+		// renderGameObjects call, and in GpuDriven mode the pooled objects left to the cull shader
+		uint32_t getVisibleObjectCount() const { return visibleObjectCount; }
+		uint32_t getCulledObjectCount() const { return culledObjectCount; }
+		uint32_t getSubmittedObjectCount() const { return submittedObjectCount; }
+
+		// gathers and culls the frame's objects without recording anything, so it can run as a
+		// task next to the other systems' updates. prepareFrame does it when it wasn't called
+		void collectObjects(FrameInfo& frameInfo);
+		// records the work that has to happen outside the render pass, call it before
+		// beginSwapChainRenderPass every frame
+		void prepareFrame(FrameInfo& frameInfo);
 		void renderGameObjects(FrameInfo& frameInfo);
 
 	private:
-		void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
+		struct InstanceData {
+			glm::mat4 modelMatrix{ 1.f };
+			glm::mat4 normalMatrix{ 1.f };
+			uint32_t textureIndex = 0;
+		};
+
+		// an object that passed the cull, with the model matrix the cull already needed
+		struct DrawItem {
+			MModel* model;
+			TransformComponent* transform;
+			glm::mat4 modelMatrix;
+			uint32_t textureIndex;
+			uint32_t lod;
+		};
+
+		struct PooledObject {
+			MModel* model;
+			TransformComponent* transform;
+			ModelComponent* renderable;
+		};
+
+		struct InstanceBatch {
+			MModel* model;
+			uint32_t lod;
+			uint32_t firstInstance;
+			uint32_t instanceCount;
+		};
+
+		struct BatchKeyHasher {
+			size_t operator()(const std::pair<MModel*, uint32_t>& key) const {
+				return std::hash<MModel*>{}(key.first) ^ (std::hash<uint32_t>{}(key.second) << 1);
+			}
+		};
+
+		// matches ObjectData in cull.comp and simple_shader_gpu.vert
+		struct ObjectData {
+			glm::mat4 modelMatrix{ 1.f };
+			glm::mat4 normalMatrix{ 1.f };
+			uint32_t meshId = 0;
+			uint32_t textureIndex = 0;
+			uint32_t lod = 0;
+			uint32_t padding = 0;
+		};
+
+		struct GpuFrame {
+			std::unique_ptr<MBuffer> objectBuffer;
+			std::unique_ptr<MBuffer> drawCommandBuffer;
+			std::unique_ptr<MBuffer> drawCountBuffer;
+			// the indirect dispatch of the meshlet pass and the objects it takes, see cull.comp
+			std::unique_ptr<MBuffer> meshletDispatchBuffer;
+			std::unique_ptr<MBuffer> meshletTaskBuffer;
+			VkDescriptorSet cullSet = VK_NULL_HANDLE;
+			VkDescriptorSet objectSet = VK_NULL_HANDLE;
+			uint32_t objectCount = 0;  // objects dispatched this frame
+			uint32_t maxDraws = 0;  // draws the cull passes may write this frame
+		};
+
+		void createPipelineLayout(VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout bindlessSetLayout);
 		void createPipeline(VkRenderPass renderPass);
+		void createInstancedPipeline(VkRenderPass renderPass);
+		void createGpuDrivenPipelines(
+			VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout bindlessSetLayout);
+
+		void collectVisible(FrameInfo& frameInfo);
+		void addDrawItem(ModelComponent& renderable, TransformComponent& transform);
+		// center and radius of the bounding sphere in world space, scale the longest axis of the
+		// model matrix
+		uint32_t selectLod(
+			const MModel& model, const glm::vec3& center, float radius, float scale, uint32_t currentLod) const;
+		void cullDrawItems(FrameInfo& frameInfo);
+		void recordDraws(FrameInfo& frameInfo);
+		void renderDirect(FrameInfo& frameInfo);
+		void renderDirectParallel(FrameInfo& frameInfo);
+		void recordDirect(VkCommandBuffer commandBuffer, const FrameInfo& frameInfo, size_t begin, size_t end) const;
+		void renderInstanced(FrameInfo& frameInfo);
+		MBuffer& reserveInstanceBuffer(int frameIndex, uint32_t instanceCount);
+
+		void collectGpuDriven(FrameInfo& frameInfo);
+		void prepareGpuDriven(FrameInfo& frameInfo);
+		void renderGpuDriven(FrameInfo& frameInfo);
+		void reserveGpuFrame(GpuFrame& frame, uint32_t objectCount, uint32_t maxDraws);
+		bool usesMeshletCulling() const;
 
 		MDevice& mDevice;
 
 		std::unique_ptr<MPipeline> mPipeline;
+		std::unique_ptr<MPipeline> instancedPipeline;
 		VkPipelineLayout pipelineLayout;
+
+		RenderMode renderMode = RenderMode::Instanced;
+		bool frustumCulling = true;
+		bool meshletCulling = true;
+		bool coneCulling = false;
+
+		MFrustumCuller culler;
+		std::vector<uint8_t> visibility;
+		std::vector<DrawItem> drawItems;
+		bool objectsCollected = false;
+		// from the camera of the frame being collected, see selectLod
+		glm::vec3 lodCameraPosition{ 0.f };
+		float lodPixelsPerUnit = 0.f;
+		std::vector<VkCommandBuffer> chunkCommandBuffers;
+		uint32_t visibleObjectCount = 0;
+		uint32_t culledObjectCount = 0;
+		uint32_t submittedObjectCount = 0;
+
+		// one per frame in flight, grown when the scene outgrows it
+		std::vector<std::unique_ptr<MBuffer>> instanceBuffers;
+		std::vector<InstanceBatch> batches;
+		std::unordered_map<std::pair<MModel*, uint32_t>, size_t, BatchKeyHasher> batchLookup;  // model, lod
+
+		MMeshPool* meshPool;
+		std::unique_ptr<MDescriptorPool> gpuDescriptorPool;
+		std::unique_ptr<MDescriptorSetLayout> cullSetLayout;
+		std::unique_ptr<MDescriptorSetLayout> objectSetLayout;
+		VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+		VkPipelineLayout gpuPipelineLayout = VK_NULL_HANDLE;
+		std::unique_ptr<MPipeline> cullPipeline;
+		std::unique_ptr<MPipeline> meshletCullPipeline;
+		std::unique_ptr<MPipeline> gpuPipeline;
+		std::vector<GpuFrame> gpuFrames;
+		std::vector<PooledObject> pooledObjects;
+		std::vector<ObjectData> objectScratch;
+		uint32_t gpuMaxDraws = 0;  // one per object, or per meshlet of an object culled by meshlet
 	};
 }
\ No newline at end of file
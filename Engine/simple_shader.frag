@@ -1,13 +1,19 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout (location = 0) in vec3 fragColor;
 layout (location = 1) in vec3 fragPosWorld;
 layout (location = 2) in vec3 fragNormalWorld;
+layout (location = 3) in vec2 fragUv;
+layout (location = 4) flat in uint fragTextureIndex;
 
 layout (location = 0) out vec4 outColor;
 
+const uvec3 CLUSTER_GRID = uvec3(16, 9, 24);
+const uint MAX_LIGHTS_PER_CLUSTER = 128;
+
 struct PointLight {
-  vec4 position; // ignore w
+  vec4 position; // w is range
   vec4 color; // w is intensity
 };
 
@@ -16,14 +22,34 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
   mat4 view;
   mat4 invView;
   vec4 ambientLightColor; // w is intensity
-  PointLight pointLights[10];
+  vec4 clusterDepth; // near, far, slice scale, slice bias
+  vec2 screenSize;
   int numLights;
 } ubo;
 
-layout(push_constant) uniform Push {
-  mat4 modelMatrix;
-  mat4 normalMatrix;
-} push;
+layout(std430, set = 0, binding = 1) readonly buffer Lights {
+  PointLight lights[];
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer ClusterCounts {
+  uint clusterCounts[];
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer ClusterIndices {
+  uint clusterIndices[];
+};
+
+// MBindlessTable's set, instanced draws mix textures so the index isn't uniform
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+uint clusterIndex(vec3 positionWorld) {
+  float viewDepth = (ubo.view * vec4(positionWorld, 1.0)).z;
+  uvec2 tile = uvec2(gl_FragCoord.xy / ubo.screenSize * vec2(CLUSTER_GRID.xy));
+  uint slice = uint(max(log(viewDepth) * ubo.clusterDepth.z + ubo.clusterDepth.w, 0.0));
+  tile = min(tile, CLUSTER_GRID.xy - 1);
+  slice = min(slice, CLUSTER_GRID.z - 1);
+  return tile.x + CLUSTER_GRID.x * (tile.y + CLUSTER_GRID.y * slice);
+}
 
 void main() {
   vec3 diffuseLight = ubo.ambientLightColor.xyz * ubo.ambientLightColor.w;
@@ -33,10 +59,15 @@ void main() {
   vec3 cameraPosWorld = ubo.invView[3].xyz;
   vec3 viewDirection = normalize(cameraPosWorld - fragPosWorld);
 
-  for (int i = 0; i < ubo.numLights; i++) {
-    PointLight light = ubo.pointLights[i];
+  uint cluster = clusterIndex(fragPosWorld);
+  uint lightCount = clusterCounts[cluster];
+  for (uint i = 0; i < lightCount; i++) {
+    PointLight light = lights[clusterIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i]];
     vec3 directionToLight = light.position.xyz - fragPosWorld;
-    float attenuation = 1.0 / dot(directionToLight, directionToLight); // distance squared
+    float distanceSquared = dot(directionToLight, directionToLight);
+    // fades to zero at the range, so the light doesn't pop at cluster edges
+    float rangeFalloff = clamp(1.0 - distanceSquared / (light.position.w * light.position.w), 0, 1);
+    float attenuation = rangeFalloff * rangeFalloff / distanceSquared;
     directionToLight = normalize(directionToLight);
 
     float cosAngIncidence = max(dot(surfaceNormal, directionToLight), 0);
@@ -52,5 +83,6 @@ void main() {
     specularLight += intensity * blinnTerm;
   }
   
-  outColor = vec4(diffuseLight * fragColor + specularLight * fragColor, 1.0);
+  vec3 albedo = fragColor * texture(textures[nonuniformEXT(fragTextureIndex)], fragUv).rgb;
+  outColor = vec4(diffuseLight * albedo + specularLight * albedo, 1.0);
 }
\ No newline at end of file
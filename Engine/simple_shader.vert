@@ -1,37 +1,36 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 color;
-layout(location = 2) in vec3 normal;
-layout(location = 3) in vec2 uv;
+#include "vertex_input.glsl"
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 fragPosWorld;
 layout(location = 2) out vec3 fragNormalWorld;
-
-struct PointLight {
-  vec4 position; // ignore w
-  vec4 color; // w is intensity
-};
+layout(location = 3) out vec2 fragUv;
+layout(location = 4) flat out uint fragTextureIndex;
 
 layout(set = 0, binding = 0) uniform GlobalUbo {
   mat4 projection;
   mat4 view;
   mat4 invView;
   vec4 ambientLightColor; // w is intensity
-  PointLight pointLights[10];
+  vec4 clusterDepth; // near, far, slice scale, slice bias
+  vec2 screenSize;
   int numLights;
 } ubo;
 
 layout(push_constant) uniform Push {
   mat4 modelMatrix;
-  mat4 normalMatrix;
+  mat3 normalMatrix;
+  uint textureIndex;
 } push;
 
 void main() {
   vec4 positionWorld = push.modelMatrix * vec4(position, 1.0);
   gl_Position = ubo.projection * ubo.view * positionWorld;
-  fragNormalWorld = normalize(mat3(push.normalMatrix) * normal);
+  fragNormalWorld = normalize(push.normalMatrix * decodeNormal());
   fragPosWorld = positionWorld.xyz;
   fragColor = color;
+  fragUv = uv;
+  fragTextureIndex = push.textureIndex;
 }
\ No newline at end of file
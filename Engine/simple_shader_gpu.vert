@@ -0,0 +1,45 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "vertex_input.glsl"
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragPosWorld;
+layout(location = 2) out vec3 fragNormalWorld;
+layout(location = 3) out vec2 fragUv;
+layout(location = 4) flat out uint fragTextureIndex;
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+  mat4 projection;
+  mat4 view;
+  mat4 invView;
+  vec4 ambientLightColor; // w is intensity
+  vec4 clusterDepth; // near, far, slice scale, slice bias
+  vec2 screenSize;
+  int numLights;
+} ubo;
+
+struct ObjectData {
+  mat4 modelMatrix;
+  mat4 normalMatrix;
+  uint meshId;
+  uint textureIndex;
+  uint lod;
+  uint padding;
+};
+
+// set 1 is the bindless set the fragment shader reads
+layout(std430, set = 2, binding = 0) readonly buffer Objects {
+  ObjectData objects[];
+};
+
+void main() {
+  ObjectData object = objects[gl_InstanceIndex];
+  vec4 positionWorld = object.modelMatrix * vec4(position, 1.0);
+  gl_Position = ubo.projection * ubo.view * positionWorld;
+  fragNormalWorld = normalize(mat3(object.normalMatrix) * decodeNormal());
+  fragPosWorld = positionWorld.xyz;
+  fragColor = color;
+  fragUv = uv;
+  fragTextureIndex = object.textureIndex;
+}
@@ -0,0 +1,35 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "vertex_input.glsl"
+
+// per instance, a mat4 takes four locations
+layout(location = 4) in mat4 instanceModelMatrix;
+layout(location = 8) in mat4 instanceNormalMatrix;
+layout(location = 12) in uint instanceTextureIndex;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragPosWorld;
+layout(location = 2) out vec3 fragNormalWorld;
+layout(location = 3) out vec2 fragUv;
+layout(location = 4) flat out uint fragTextureIndex;
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+  mat4 projection;
+  mat4 view;
+  mat4 invView;
+  vec4 ambientLightColor; // w is intensity
+  vec4 clusterDepth; // near, far, slice scale, slice bias
+  vec2 screenSize;
+  int numLights;
+} ubo;
+
+void main() {
+  vec4 positionWorld = instanceModelMatrix * vec4(position, 1.0);
+  gl_Position = ubo.projection * ubo.view * positionWorld;
+  fragNormalWorld = normalize(mat3(instanceNormalMatrix) * decodeNormal());
+  fragPosWorld = positionWorld.xyz;
+  fragColor = color;
+  fragUv = uv;
+  fragTextureIndex = instanceTextureIndex;
+}
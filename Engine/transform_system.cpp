@@ -0,0 +1,96 @@
+#include "transform_system.hpp"
+
+#include "m_job_system.hpp"
+#include "m_trace.hpp"
+
+// std
+#include <cmath>
+
+namespace m {
+
+    void TransformSystem::update(MRegistry& registry) {
+        M_TRACE_ZONE("TransformSystem::update");
+        dirtyTransforms.clear();
+        for (TransformComponent& transform : registry.pool<TransformComponent>().data()) {
+            if (transform.dirty) {
+                dirtyTransforms.push_back(&transform);
+            }
+        }
+
+        size_t count = dirtyTransforms.size();
+        rotationX.resize(count);
+        rotationY.resize(count);
+        rotationZ.resize(count);
+        for (auto& element : rotations) {
+            element.resize(count);
+        }
+        MJobSystem::shared().parallelFor(count, GRAIN_SIZE, [this](size_t first, size_t last) {
+            updateRange(first, last);
+        });
+    }
+
+    glm::mat3 TransformSystem::rotationMatrix(const glm::vec3& rotation) {
+        glm::mat3 result;
+        std::array<float*, 9> out;
+        for (int i = 0; i < 9; i++) {
+            out[i] = &result[i / 3][i % 3];
+        }
+        computeRotations(&rotation.x, &rotation.y, &rotation.z, out, 1);
+        return result;
+    }
+
+    void TransformSystem::computeRotations(
+        const float* x, const float* y, const float* z, const std::array<float*, 9>& out, size_t count) {
+        float* m00 = out[0];
+        float* m01 = out[1];
+        float* m02 = out[2];
+        float* m10 = out[3];
+        float* m11 = out[4];
+        float* m12 = out[5];
+        float* m20 = out[6];
+        float* m21 = out[7];
+        float* m22 = out[8];
+        for (size_t i = 0; i < count; i++) {
+            const float c3 = std::cos(z[i]);
+            const float s3 = std::sin(z[i]);
+            const float c2 = std::cos(x[i]);
+            const float s2 = std::sin(x[i]);
+            const float c1 = std::cos(y[i]);
+            const float s1 = std::sin(y[i]);
+            m00[i] = c1 * c3 + s1 * s2 * s3;
+            m01[i] = c2 * s3;
+            m02[i] = c1 * s2 * s3 - c3 * s1;
+            m10[i] = c3 * s1 * s2 - c1 * s3;
+            m11[i] = c2 * c3;
+            m12[i] = c1 * c3 * s2 + s1 * s3;
+            m20[i] = c2 * s1;
+            m21[i] = -s2;
+            m22[i] = c1 * c2;
+        }
+    }
+
+    void TransformSystem::updateRange(size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const glm::vec3& rotation = dirtyTransforms[i]->rotation;
+            rotationX[i] = rotation.x;
+            rotationY[i] = rotation.y;
+            rotationZ[i] = rotation.z;
+        }
+
+        std::array<float*, 9> out;
+        for (size_t element = 0; element < out.size(); element++) {
+            out[element] = rotations[element].data() + begin;
+        }
+        computeRotations(
+            rotationX.data() + begin, rotationY.data() + begin, rotationZ.data() + begin, out, end - begin);
+
+        for (size_t i = begin; i < end; i++) {
+            glm::mat3 rotationMatrix{
+                rotations[0][i], rotations[1][i], rotations[2][i],
+                rotations[3][i], rotations[4][i], rotations[5][i],
+                rotations[6][i], rotations[7][i], rotations[8][i] };
+            dirtyTransforms[i]->storeMatrices(rotationMatrix);
+        }
+    }
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "m_ecs.hpp"
+#include "m_game_object.hpp"
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <array>
+#include <cstddef>
+#include <vector>
+
+namespace m {
+    // Recomputes the cached matrices of the transforms that changed since the last frame. The
+    // rotations of the dirty transforms are gathered into separate x, y and z arrays and the
+    // rotation matrices are built from those in a plain loop over floats the compiler can
+    // vectorize, then scaled and written back into the components.
+    class TransformSystem {
+    public:
+        static constexpr size_t GRAIN_SIZE = 1024;  // transforms per job in update
+
+        TransformSystem() = default;
+
+        TransformSystem(const TransformSystem&) = delete;
+        TransformSystem& operator=(const TransformSystem&) = delete;
+
+        // runs after the frame's transforms are set and before anything reads their matrices
+        void update(MRegistry& registry);
+
+        // transforms recomputed by the last update
+        size_t getUpdatedCount() const { return dirtyTransforms.size(); }
+
+        // the YXZ rotation matrix of a single transform, computed the same way as the batch
+        static glm::mat3 rotationMatrix(const glm::vec3& rotation);
+
+    private:
+        // out[column * 3 + row][i] is the element of the i-th rotation matrix
+        static void computeRotations(
+            const float* x, const float* y, const float* z, const std::array<float*, 9>& out, size_t count);
+
+        void updateRange(size_t begin, size_t end);
+
+        std::vector<TransformComponent*> dirtyTransforms;
+        std::vector<float> rotationX;
+        std::vector<float> rotationY;
+        std::vector<float> rotationZ;
+        std::array<std::vector<float>, 9> rotations;
+    };
+}
@@ -0,0 +1,27 @@
+// the model vertex attributes in the layout MOCHA_VERTEX_FORMAT picks, see MModel::GpuVertex.
+// with 1 the position comes in quantized and the model matrix the CPU hands over decodes it
+#ifndef MOCHA_VERTEX_FORMAT
+#define MOCHA_VERTEX_FORMAT 0
+#endif
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 color;
+#if MOCHA_VERTEX_FORMAT == 1
+layout(location = 2) in vec2 octahedralNormal;
+#else
+layout(location = 2) in vec3 vertexNormal;
+#endif
+layout(location = 3) in vec2 uv;
+
+vec3 decodeNormal() {
+#if MOCHA_VERTEX_FORMAT == 1
+  // unfold the lower hemisphere, see encodeOctahedral in m_model.cpp
+  vec3 normal = vec3(octahedralNormal, 1.0 - abs(octahedralNormal.x) - abs(octahedralNormal.y));
+  float fold = max(-normal.z, 0.0);
+  normal.x += normal.x >= 0.0 ? -fold : fold;
+  normal.y += normal.y >= 0.0 ? -fold : fold;
+  return normal;
+#else
+  return vertexNormal;
+#endif
+}